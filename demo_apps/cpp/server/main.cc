@@ -20,14 +20,20 @@
 #include "demo_service.smf.fb.h"
 
 class storage_service final : public smf_gen::demo::SmfStorage {
-  virtual seastar::future<smf::rpc_typed_envelope<smf_gen::demo::Response>>
-  Get(smf::rpc_recv_typed_context<smf_gen::demo::Request> &&rec) final {
-    smf::rpc_typed_envelope<smf_gen::demo::Response> data;
+  using SmfStorage::Get;
+  // builds the reply in place, no smf_gen::demo::ResponseT in between
+  virtual seastar::future<smf::rpc_builder_envelope<smf_gen::demo::Response>>
+  Get(smf::rpc_recv_typed_context<smf_gen::demo::Request> &&rec,
+      smf::rpc_builder_envelope<smf_gen::demo::Response> &&out) final {
     // return the same payload
-    if (rec) { data.data->name = rec->name()->c_str(); }
-    data.envelope.set_status(200);
+    flatbuffers::Offset<flatbuffers::String> name;
+    if (rec && rec->name()) {
+      name = out.builder().CreateString(rec->name());
+    }
+    out.finish(smf_gen::demo::CreateResponse(out.builder(), name));
+    out.envelope.set_status(200);
     return seastar::make_ready_future<
-      smf::rpc_typed_envelope<smf_gen::demo::Response>>(std::move(data));
+      smf::rpc_builder_envelope<smf_gen::demo::Response>>(std::move(out));
   }
 };
 
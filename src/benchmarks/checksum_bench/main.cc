@@ -8,6 +8,8 @@
 #include <benchmark/benchmark.h>
 #include <xxhash.h>
 
+#include "smf/rpc_header_utils.h"
+
 static constexpr uint32_t kPayloadSize = 1 << 29;
 static char kPayload[kPayloadSize]{};
 
@@ -40,4 +42,31 @@ BENCHMARK(BM_hash64)
   ->Args({1 << 20, 1 << 20})
   ->Args({1 << 29, 1 << 29});
 
+// 64B to 16MB - what rpc_checksum_payload sees per frame
+static void
+frame_sizes(benchmark::internal::Benchmark *b) {
+  b->RangeMultiplier(4)->Range(1 << 6, 1 << 24);
+}
+
+template <smf::checksum_type Type>
+static void
+BM_rpc_checksum_payload(benchmark::State &state) {
+  std::memset(kPayload, 'x', state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+      smf::rpc_checksum_payload(kPayload, state.range(0), Type));
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_TEMPLATE(BM_rpc_checksum_payload, smf::checksum_type::xxhash64)
+  ->Apply(frame_sizes);
+#if SMF_HAS_XXH3
+BENCHMARK_TEMPLATE(BM_rpc_checksum_payload, smf::checksum_type::xxh3)
+  ->Apply(frame_sizes);
+#endif
+BENCHMARK_TEMPLATE(BM_rpc_checksum_payload, smf::checksum_type::crc32c)
+  ->Apply(frame_sizes);
+BENCHMARK_TEMPLATE(BM_rpc_checksum_payload, smf::checksum_type::none)
+  ->Apply(frame_sizes);
+
 BENCHMARK_MAIN();
@@ -0,0 +1,215 @@
+// Copyright 2019 SMF Authors
+//
+
+//
+// Note
+// Throughput (bytes_per_second) and compression ratio of the codecs, the
+// payload checksum and the full compression filter round trips, over a corpus
+// of real flatbuffers. Use it to pick filter settings per service.
+//
+// Every benchmark takes {payload size, field entropy %}. An entropy of 0 is a
+// repeated dictionary word, 100 is uniformly random printable bytes.
+//
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <seastar/core/sstring.hh>
+#include <seastar/core/temporary_buffer.hh>
+
+#include "demo_service_generated.h"
+#include "kv_generated.h"
+#include "smf/compression.h"
+#include "smf/lz4_filter.h"
+#include "smf/random.h"
+#include "smf/rpc_header_utils.h"
+#include "smf/rpc_recv_context.h"
+#include "smf/rpc_typed_envelope.h"
+#include "smf/zstd_filter.h"
+
+// enough distinct messages to defeat the branch predictor & caches
+static constexpr uint32_t kCorpusSize = 16;
+// same as smf::load_channel
+static constexpr uint32_t kMinCompressionSize = 1024;
+
+enum class corpus_kind { kv, demo };
+
+static seastar::sstring
+gen_field(smf::random &r, uint32_t sz, uint32_t entropy_pct) {
+  static const char kWord[] = "flatbuffers_payload_";
+  static const seastar::sstring kDict = "abcdefghijklmnopqrstuvwxyz"
+                                        "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                        "1234567890"
+                                        "!@#$%^&*()"
+                                        "`~-_=+[{]}|;:'\",<.>/?";
+  seastar::sstring ret;
+  ret.resize(sz);
+  for (uint32_t i = 0; i < sz; ++i) {
+    if (r.next() % 100 < entropy_pct) {
+      ret[i] = kDict[r.next() % kDict.size()];
+    } else {
+      ret[i] = kWord[i % (sizeof(kWord) - 1)];
+    }
+  }
+  return ret;
+}
+
+template <corpus_kind Kind>
+static std::vector<seastar::temporary_buffer<char>>
+make_corpus(uint32_t size, uint32_t entropy_pct) {
+  smf::random r;
+  std::vector<seastar::temporary_buffer<char>> ret;
+  ret.reserve(kCorpusSize);
+  for (auto i = 0u; i < kCorpusSize; ++i) {
+    if constexpr (Kind == corpus_kind::kv) {
+      smf::rpc_typed_envelope<kvpair> e;
+      e.data->key = gen_field(r, size / 4, entropy_pct);
+      e.data->value = gen_field(r, size - size / 4, entropy_pct);
+      ret.push_back(std::move(e.serialize_data().letter.body));
+    } else {
+      smf::rpc_typed_envelope<smf_gen::demo::Request> e;
+      e.data->name = gen_field(r, size, entropy_pct);
+      ret.push_back(std::move(e.serialize_data().letter.body));
+    }
+  }
+  return ret;
+}
+
+static void
+corpus_args(benchmark::internal::Benchmark *b) {
+  for (int64_t size : {1 << 8, 1 << 12, 1 << 16, 1 << 20}) {
+    for (int64_t entropy : {0, 25, 50, 100}) {
+      b->Args({size, entropy});
+    }
+  }
+}
+
+template <corpus_kind Kind, smf::codec_type Type, smf::compression_level Level>
+static void
+BM_codec_compress(benchmark::State &state) {
+  auto corpus = make_corpus<Kind>(state.range(0), state.range(1));
+  auto codec = smf::codec::make_unique(Type, Level);
+  uint64_t in = 0, out = 0, i = 0;
+  for (auto _ : state) {
+    auto &buf = corpus[i++ % corpus.size()];
+    auto compressed = codec->compress(buf);
+    in += buf.size();
+    out += compressed.size();
+    benchmark::DoNotOptimize(compressed);
+  }
+  state.SetBytesProcessed(in);
+  state.counters["ratio"] = out == 0 ? 0 : static_cast<double>(in) / out;
+}
+
+template <corpus_kind Kind, smf::codec_type Type, smf::compression_level Level>
+static void
+BM_codec_uncompress(benchmark::State &state) {
+  auto corpus = make_corpus<Kind>(state.range(0), state.range(1));
+  auto codec = smf::codec::make_unique(Type, Level);
+  std::vector<seastar::temporary_buffer<char>> compressed;
+  uint64_t in = 0, out = 0, i = 0;
+  for (auto &b : corpus) {
+    compressed.push_back(codec->compress(b));
+  }
+  for (auto _ : state) {
+    auto &buf = compressed[i++ % compressed.size()];
+    auto plain = codec->uncompress(buf);
+    in += buf.size();
+    out += plain.size();
+    benchmark::DoNotOptimize(plain);
+  }
+  // report bytes produced, so it is comparable to the compress side
+  state.SetBytesProcessed(out);
+  state.counters["ratio"] = in == 0 ? 0 : static_cast<double>(out) / in;
+}
+
+#define SMF_CODEC_BENCHMARK(kind, type, level)                                 \
+  BENCHMARK_TEMPLATE(BM_codec_compress, kind, type, level)                     \
+    ->Apply(corpus_args);                                                      \
+  BENCHMARK_TEMPLATE(BM_codec_uncompress, kind, type, level)                   \
+    ->Apply(corpus_args)
+
+SMF_CODEC_BENCHMARK(corpus_kind::kv, smf::codec_type::lz4,
+                    smf::compression_level::fastest);
+SMF_CODEC_BENCHMARK(corpus_kind::kv, smf::codec_type::lz4,
+                    smf::compression_level::best);
+SMF_CODEC_BENCHMARK(corpus_kind::kv, smf::codec_type::zstd,
+                    smf::compression_level::fastest);
+SMF_CODEC_BENCHMARK(corpus_kind::kv, smf::codec_type::zstd,
+                    smf::compression_level::best);
+SMF_CODEC_BENCHMARK(corpus_kind::demo, smf::codec_type::lz4,
+                    smf::compression_level::fastest);
+SMF_CODEC_BENCHMARK(corpus_kind::demo, smf::codec_type::lz4,
+                    smf::compression_level::best);
+SMF_CODEC_BENCHMARK(corpus_kind::demo, smf::codec_type::zstd,
+                    smf::compression_level::fastest);
+SMF_CODEC_BENCHMARK(corpus_kind::demo, smf::codec_type::zstd,
+                    smf::compression_level::best);
+
+template <corpus_kind Kind>
+static void
+BM_rpc_checksum_payload(benchmark::State &state) {
+  auto corpus = make_corpus<Kind>(state.range(0), state.range(1));
+  uint64_t in = 0, i = 0;
+  for (auto _ : state) {
+    auto &buf = corpus[i++ % corpus.size()];
+    benchmark::DoNotOptimize(smf::rpc_checksum_payload(buf.get(), buf.size()));
+    in += buf.size();
+  }
+  state.SetBytesProcessed(in);
+}
+BENCHMARK_TEMPLATE(BM_rpc_checksum_payload, corpus_kind::kv)
+  ->Apply(corpus_args);
+BENCHMARK_TEMPLATE(BM_rpc_checksum_payload, corpus_kind::demo)
+  ->Apply(corpus_args);
+
+/// \brief what a request pays end to end on the filters: sender checksum,
+/// compression filter, receiver checksum verification, decompression filter
+template <corpus_kind Kind, typename CompressionFilter,
+          typename DecompressionFilter>
+static void
+BM_filter_round_trip(benchmark::State &state) {
+  auto corpus = make_corpus<Kind>(state.range(0), state.range(1));
+  auto limits = seastar::make_lw_shared<smf::rpc_connection_limits>(
+    uint64_t(1) << 30, std::chrono::minutes(1));
+  const auto address =
+    seastar::socket_address(sockaddr_in{AF_INET, INADDR_ANY, {0}});
+  CompressionFilter compress(kMinCompressionSize);
+  DecompressionFilter decompress;
+  uint64_t in = 0, wire = 0, i = 0;
+  for (auto _ : state) {
+    smf::rpc_envelope e;
+    e.letter.body = corpus[i++ % corpus.size()].share();
+    smf::checksum_rpc(e.letter.header, e.letter.body.get(),
+                      e.letter.body.size());
+    in += e.letter.body.size();
+
+    auto out = compress(std::move(e)).get0();
+    wire += out.letter.body.size();
+    benchmark::DoNotOptimize(smf::rpc_checksum_payload(
+      out.letter.body.get(), out.letter.body.size()));
+
+    smf::rpc_recv_context ctx(limits, address, out.letter.header,
+                              std::move(out.letter.body));
+    auto received = decompress(std::move(ctx)).get0();
+    benchmark::DoNotOptimize(received.payload);
+  }
+  state.SetBytesProcessed(in);
+  state.counters["ratio"] = wire == 0 ? 0 : static_cast<double>(in) / wire;
+}
+BENCHMARK_TEMPLATE(BM_filter_round_trip, corpus_kind::kv,
+                   smf::lz4_compression_filter, smf::lz4_decompression_filter)
+  ->Apply(corpus_args);
+BENCHMARK_TEMPLATE(BM_filter_round_trip, corpus_kind::kv,
+                   smf::zstd_compression_filter, smf::zstd_decompression_filter)
+  ->Apply(corpus_args);
+BENCHMARK_TEMPLATE(BM_filter_round_trip, corpus_kind::demo,
+                   smf::lz4_compression_filter, smf::lz4_decompression_filter)
+  ->Apply(corpus_args);
+BENCHMARK_TEMPLATE(BM_filter_round_trip, corpus_kind::demo,
+                   smf::zstd_compression_filter, smf::zstd_decompression_filter)
+  ->Apply(corpus_args);
+
+BENCHMARK_MAIN();
@@ -17,6 +17,7 @@
 
 #include "kv_generated.h"
 #include "smf/native_type_utils.h"
+#include "smf/rpc_builder_envelope.h"
 
 static inline kvpairT
 gen_kv(uint32_t sz) {
@@ -178,4 +179,51 @@ BENCHMARK(BM_alloc_hybrid)
   ->Args({1 << 18, 1 << 18})
   ->Threads(1);
 
+static void
+BM_alloc_pooled(benchmark::State &state) {
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto kv = gen_kv(state.range(0));
+    state.ResumeTiming();
+    auto buf = smf::native_table_as_buffer<kvpair>(kv);
+    benchmark::DoNotOptimize(buf);
+  }
+}
+BENCHMARK(BM_alloc_pooled)
+  ->Args({1 << 1, 1 << 1})
+  ->Args({1 << 2, 1 << 2})
+  ->Args({1 << 4, 1 << 4})
+  ->Args({1 << 8, 1 << 8})
+  ->Args({1 << 12, 1 << 12})
+  ->Args({1 << 16, 1 << 16})
+  ->Args({1 << 18, 1 << 18})
+  ->Threads(1);
+
+// what a handler using the generated builder overload pays: strings go
+// straight from the request into the builder, no NativeTableType in between
+static void
+BM_alloc_builder_envelope(benchmark::State &state) {
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto kv = gen_kv(state.range(0));
+    state.ResumeTiming();
+    smf::rpc_builder_envelope<kvpair> e;
+    auto &bdr = e.builder();
+    auto key = bdr.CreateString(kv.key.data(), kv.key.size());
+    auto value = bdr.CreateString(kv.value.data(), kv.value.size());
+    e.finish(Createkvpair(bdr, key, value));
+    auto env = e.serialize_data();
+    benchmark::DoNotOptimize(env);
+  }
+}
+BENCHMARK(BM_alloc_builder_envelope)
+  ->Args({1 << 1, 1 << 1})
+  ->Args({1 << 2, 1 << 2})
+  ->Args({1 << 4, 1 << 4})
+  ->Args({1 << 8, 1 << 8})
+  ->Args({1 << 12, 1 << 12})
+  ->Args({1 << 16, 1 << 16})
+  ->Args({1 << 18, 1 << 18})
+  ->Threads(1);
+
 BENCHMARK_MAIN();
@@ -17,6 +17,9 @@
 #define LZ4_MAX_INPUT_SIZE 0x7E000000
 #endif
 
+#include <algorithm>
+#include <cstring>
+
 #include <seastar/core/byteorder.hh>
 
 #include "smf/log.h"
@@ -24,11 +27,74 @@
 
 namespace smf {
 
+/// \brief per-shard scratch space for the compressors.
+///
+/// Both zstd and lz4 need a `*_compressBound()` sized destination, which for
+/// incompressible payloads is larger than the input. Compressing into this
+/// scratch area and copying out exactly `compressed size` bytes means the
+/// oversized allocation never outlives the call - previously it was kept
+/// alive (trimmed, but not freed) while the message sat in the output queue.
+///
+/// Requests larger than kMaxRetainedBytes get a one-off buffer that is
+/// released right after the copy, so the steady state footprint per core is
+/// bounded.
+///
+class compression_scratch {
+ public:
+  static constexpr std::size_t kMinRetainedBytes = 1 << 12;  // 4KB
+  static constexpr std::size_t kMaxRetainedBytes = 1 << 20;  // 1MB
+
+  /// \brief returns a writable region of at least `sz` bytes. Valid until
+  /// the next call to reserve() or copy_out() on this shard
+  char *
+  reserve(std::size_t sz) {
+    if (SMF_UNLIKELY(sz > kMaxRetainedBytes)) {
+      oversized_ = seastar::temporary_buffer<char>(sz);
+      return oversized_.get_write();
+    }
+    if (buf_.size() < sz) {
+      // grow geometrically so steady state does no allocations
+      const std::size_t next = std::max<std::size_t>(
+        {sz, kMinRetainedBytes, std::min(kMaxRetainedBytes, buf_.size() * 2)});
+      buf_ = seastar::temporary_buffer<char>(next);
+    }
+    return buf_.get_write();
+  }
+
+  /// \brief copies the first `sz` bytes of the last reserved region into a
+  /// right-sized buffer and drops any one-off oversized allocation
+  seastar::temporary_buffer<char>
+  copy_out(std::size_t sz) {
+    const char *src = oversized_.empty() ? buf_.get() : oversized_.get();
+    seastar::temporary_buffer<char> ret(sz);
+    std::memcpy(ret.get_write(), src, sz);
+    oversized_ = seastar::temporary_buffer<char>();
+    return ret;
+  }
+
+ private:
+  seastar::temporary_buffer<char> buf_;
+  seastar::temporary_buffer<char> oversized_;
+};
+
+static thread_local compression_scratch scratch;
+
 class zstd_codec final : public codec {
  public:
   ~zstd_codec() {}
   zstd_codec(codec_type type, compression_level level) : codec(type, level) {}
 
+  virtual std::optional<std::size_t>
+  uncompressed_size(const char *data, std::size_t sz) final {
+    auto zstd_size =
+      ZSTD_findDecompressedSize(static_cast<const void *>(data), sz);
+    if (zstd_size == ZSTD_CONTENTSIZE_ERROR ||
+        zstd_size == ZSTD_CONTENTSIZE_UNKNOWN) {
+      return std::nullopt;
+    }
+    return zstd_size;
+  }
+
   virtual seastar::temporary_buffer<char>
   uncompress(const seastar::temporary_buffer<char> &data) final {
     return uncompress(data.get(), data.size());
@@ -67,15 +133,13 @@ class zstd_codec final : public codec {
   compress(const char *data, std::size_t sz) final {
     auto const body_size = ZSTD_compressBound(sz);
 
-    seastar::temporary_buffer<char> buf(body_size);
-
     // prepare inputs
-    void *dst = static_cast<void *>(buf.get_write());
+    void *dst = static_cast<void *>(scratch.reserve(body_size));
     const void *src = reinterpret_cast<const void *>(data);
 
     // create compressed buffers
     auto zstd_compressed_size =
-      ZSTD_compress(dst, buf.size(), src, sz, 3 /*default compression level*/);
+      ZSTD_compress(dst, body_size, src, sz, zstd_level());
     // check erros
     auto zstd_err = ZSTD_isError(zstd_compressed_size);
     LOG_THROW_IF(zstd_err != 0,
@@ -83,8 +147,14 @@ class zstd_codec final : public codec {
                  "Code: {}, Desciption: {}",
                  zstd_err, ZSTD_getErrorName(zstd_err));
 
-    buf.trim(zstd_compressed_size);
-    return buf;
+    return scratch.copy_out(zstd_compressed_size);
+  }
+
+ private:
+  int
+  zstd_level() const {
+    // `fastest` keeps the historical default of 3
+    return level() == compression_level::best ? 19 : 3;
   }
 };
 
@@ -96,6 +166,12 @@ class lz4_fast_codec final : public codec {
   lz4_fast_codec(codec_type type, compression_level level)
     : codec(type, level) {}
 
+  virtual std::optional<std::size_t>
+  uncompressed_size(const char *data, std::size_t sz) final {
+    if (sz < 4) { return std::nullopt; }
+    return seastar::read_le<uint32_t>(data);
+  }
+
   virtual seastar::temporary_buffer<char>
   compress(const seastar::temporary_buffer<char> &data) final {
     return compress(data.get(), data.size());
@@ -105,13 +181,15 @@ class lz4_fast_codec final : public codec {
   compress(const char *data, std::size_t size) final {
     const int max_dst_size = LZ4_compressBound(size);
 
-    seastar::temporary_buffer<char> buf(max_dst_size + 4);
+    char *dst = scratch.reserve(max_dst_size + 4);
 
     const int compressed_data_size =
-      LZ4_compress_default(data, buf.get_write() + 4, size, max_dst_size);
+      level() == compression_level::best
+        ? LZ4_compress_HC(data, dst + 4, size, max_dst_size, LZ4HC_CLEVEL_MAX)
+        : LZ4_compress_default(data, dst + 4, size, max_dst_size);
 
-    LOG_THROW_IF(compressed_data_size < 0, ,
-                 "A negative result from LZ4_compress_default indicates a "
+    LOG_THROW_IF(compressed_data_size < 0,
+                 "A negative result from LZ4_compress_* indicates a "
                  "failure trying to compress the data.  See exit code {} "
                  "for value returned.",
                  compressed_data_size);
@@ -121,9 +199,8 @@ class lz4_fast_codec final : public codec {
                  "because the destination buffer couldn't hold all the "
                  "information.");
 
-    seastar::write_le<uint32_t>(buf.get_write(), size);
-    buf.trim(compressed_data_size + 4);
-    return buf;
+    seastar::write_le<uint32_t>(dst, size);
+    return scratch.copy_out(compressed_data_size + 4);
   }
 
   virtual seastar::temporary_buffer<char>
@@ -149,7 +226,12 @@ class lz4_fast_codec final : public codec {
     LOG_THROW_IF(decompressed_size == 0,
                  "I'm not sure this function can ever return 0.  "
                  "Documentation in lz4.h doesn't indicate so.");
-    buf.trim(decompressed_size);
+    if (SMF_UNLIKELY(static_cast<uint32_t>(decompressed_size) != orig)) {
+      // never keep the over-allocation alive; copy into an exact buffer
+      seastar::temporary_buffer<char> exact(decompressed_size);
+      std::memcpy(exact.get_write(), buf.get(), decompressed_size);
+      return exact;
+    }
     return buf;
   }
 };
@@ -0,0 +1,126 @@
+// Copyright 2019 SMF Authors
+//
+
+#include "smf/crc32c.h"
+
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+#include "smf/macros.h"
+
+namespace smf {
+
+// reflected Castagnoli polynomial
+static constexpr uint32_t kCrc32cPoly = 0x82f63b78;
+
+static std::array<uint32_t, 256>
+make_crc32c_table() {
+  std::array<uint32_t, 256> t{};
+  for (uint32_t i = 0; i < t.size(); ++i) {
+    uint32_t c = i;
+    for (int k = 0; k < 8; ++k) {
+      c = (c & 1) ? (c >> 1) ^ kCrc32cPoly : c >> 1;
+    }
+    t[i] = c;
+  }
+  return t;
+}
+
+static uint32_t
+crc32c_sw(uint32_t crc, const char *buf, std::size_t len) {
+  static const std::array<uint32_t, 256> kTable = make_crc32c_table();
+  auto p = reinterpret_cast<const uint8_t *>(buf);
+  while (len-- > 0) {
+    crc = kTable[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) static uint32_t
+crc32c_hw(uint32_t crc, const char *buf, std::size_t len) {
+  uint64_t crc64 = crc;
+  while (len >= sizeof(uint64_t)) {
+    uint64_t v;
+    std::memcpy(&v, buf, sizeof(v));
+    crc64 = _mm_crc32_u64(crc64, v);
+    buf += sizeof(v);
+    len -= sizeof(v);
+  }
+  crc = static_cast<uint32_t>(crc64);
+  while (len-- > 0) {
+    crc = _mm_crc32_u8(crc, static_cast<uint8_t>(*buf++));
+  }
+  return crc;
+}
+#endif
+
+uint32_t
+crc32c_extend(uint32_t crc, const char *buf, std::size_t len) {
+#if defined(__x86_64__)
+  static const bool kHasSSE42 = __builtin_cpu_supports("sse4.2");
+  if (SMF_LIKELY(kHasSSE42)) { return ~crc32c_hw(~crc, buf, len); }
+#endif
+  return ~crc32c_sw(~crc, buf, len);
+}
+
+// crc32c_combine() - same technique as zlib's crc32_combine(): applying
+// len_b zero bytes to crc_a is a linear operator over GF(2), computed by
+// repeated squaring of the "one zero bit" matrix
+
+static uint32_t
+gf2_matrix_times(const uint32_t *mat, uint32_t vec) {
+  uint32_t sum = 0;
+  while (vec) {
+    if (vec & 1) { sum ^= *mat; }
+    vec >>= 1;
+    mat++;
+  }
+  return sum;
+}
+
+static void
+gf2_matrix_square(uint32_t *square, const uint32_t *mat) {
+  for (int n = 0; n < 32; n++) {
+    square[n] = gf2_matrix_times(mat, mat[n]);
+  }
+}
+
+uint32_t
+crc32c_combine(uint32_t crc_a, uint32_t crc_b, uint64_t len_b) {
+  if (len_b == 0) { return crc_a; }
+  uint32_t even[32];
+  uint32_t odd[32];
+  // operator for one zero bit in odd
+  odd[0] = kCrc32cPoly;
+  uint32_t row = 1;
+  for (int n = 1; n < 32; n++) {
+    odd[n] = row;
+    row <<= 1;
+  }
+  // two zero bits in even, then four zero bits in odd
+  gf2_matrix_square(even, odd);
+  gf2_matrix_square(odd, even);
+  // apply len_b zero bytes to crc_a; the first square is one zero byte
+  do {
+    gf2_matrix_square(even, odd);
+    if (len_b & 1) { crc_a = gf2_matrix_times(even, crc_a); }
+    len_b >>= 1;
+    if (len_b == 0) { break; }
+    gf2_matrix_square(odd, even);
+    if (len_b & 1) { crc_a = gf2_matrix_times(odd, crc_a); }
+    len_b >>= 1;
+  } while (len_b != 0);
+  return crc_a ^ crc_b;
+}
+
+uint32_t
+crc32c(const char *buf, std::size_t len) {
+  return crc32c_extend(0, buf, len);
+}
+
+}  // namespace smf
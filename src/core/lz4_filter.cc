@@ -5,6 +5,7 @@
 #include <utility>
 
 #include "smf/compression.h"
+#include "smf/log.h"
 #include "smf/rpc_header_utils.h"
 #include "smf/rpc_recv_context.h"
 
@@ -19,10 +20,16 @@ lz4_compression_filter::operator()(rpc_envelope &&e) {
       rpc::compression_flags::compression_flags_none) {
     return seastar::make_ready_future<rpc_envelope>(std::move(e));
   }
-  if (e.letter.body.size() <= min_compression_size) {
+  if (e.letter.payload_size() <= min_compression_size) {
+    return seastar::make_ready_future<rpc_envelope>(std::move(e));
+  }
+  // file backed payloads are streamed from disk as is
+  if (e.letter.file_range) {
     return seastar::make_ready_future<rpc_envelope>(std::move(e));
   }
 
+  // codecs need the payload contiguous
+  e.letter.linearize();
   auto buf = compressor->compress(e.letter.body);
   e.letter.body = std::move(buf);
   e.letter.header.mutate_compression(
@@ -36,6 +43,7 @@ seastar::future<rpc_recv_context>
 lz4_decompression_filter::operator()(rpc_recv_context &&ctx) {
   if (ctx.header.compression() ==
       rpc::compression_flags::compression_flags_lz4) {
+    ctx.reserve_uncompressed(*compressor);
     auto buf = compressor->uncompress(ctx.payload);
     ctx.payload = std::move(buf);
     ctx.header.mutate_compression(
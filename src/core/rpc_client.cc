@@ -20,6 +20,9 @@
 using namespace std::chrono_literals;
 
 namespace smf {
+/// \brief tries to open the connection new calls move to after a GOAWAY
+static constexpr uint32_t kGoawayConnectAttempts = 5;
+
 class invalid_connection_state final : public std::exception {
  public:
   virtual const char *
@@ -45,9 +48,14 @@ rpc_client::rpc_client(seastar::ipv4_addr addr) : server_addr(addr) {
 }
 
 rpc_client::rpc_client(rpc_client_opts opts) : server_addr(opts.server_addr) {
+  LOG_THROW_IF(opts.checksum == checksum_type::none && !opts.credentials,
+               "Payloads without checksum are only allowed over TLS");
+  LOG_THROW_IF(!rpc_checksum_supported(opts.checksum),
+               "xxh3 checksums need xxhash >= 0.8");
   limits_ = seastar::make_lw_shared<rpc_connection_limits>(
     opts.memory_avail_for_client, opts.recv_timeout);
   creds_ = opts.credentials;
+  checksum_ = opts.checksum;
   dispatch_gate_ = std::make_unique<seastar::gate>();
   serialize_writes_.ensure_space_for_waiters(1);
 }
@@ -60,7 +68,8 @@ rpc_client::rpc_client(rpc_client &&o) noexcept
     out_filters_(std::move(o.out_filters_)),
     dispatch_gate_(std::move(o.dispatch_gate_)),
     serialize_writes_(std::move(o.serialize_writes_)),
-    hist_(std::move(o.hist_)), session_idx_(o.session_idx_) {}
+    hist_(std::move(o.hist_)), session_idx_(o.session_idx_),
+    checksum_(o.checksum_), migration_(std::move(o.migration_)) {}
 
 seastar::future<>
 rpc_client::stop() {
@@ -83,6 +92,10 @@ rpc_client::enable_histogram_metrics() {
 seastar::future<std::optional<rpc_recv_context>>
 rpc_client::raw_send(rpc_envelope e) {
   using opt_recv_t = std::optional<rpc_recv_context>;
+  if (SMF_UNLIKELY(migration_)) {
+    return migration_->get_future().then(
+      [this, e = std::move(e)]() mutable { return raw_send(std::move(e)); });
+  }
   if (SMF_UNLIKELY(!is_conn_valid())) {
     return seastar::make_exception_future<opt_recv_t>(
       invalid_connection_state());
@@ -94,6 +107,7 @@ rpc_client::raw_send(rpc_envelope e) {
   DLOG_THROW_IF(rpc_slots_.find(session_idx_) != rpc_slots_.end(),
                 "RPC slot already allocated");
   auto work = seastar::make_lw_shared<work_item>(session_idx_);
+  work->conn = conn_;
   auto measure = is_histogram_enabled() ? hist_->auto_measure() : nullptr;
 
   rpc_slots_.insert({session_idx_, work});
@@ -103,8 +117,10 @@ rpc_client::raw_send(rpc_envelope e) {
   // apply the first set of outgoing filters, then return promise
   return stage_outgoing_filters(std::move(e))
     .then([this, work](rpc_envelope e) {
+      // no-op unless the caller did not serialize with our checksum
+      e.set_checksum_type(checksum_);
       // dispatch the write concurrently!
-      (void)dispatch_write(std::move(e));
+      (void)dispatch_write(work->conn, std::move(e));
       return work->pr.get_future();
     })
     .then([this, m = std::move(measure)](opt_recv_t r) mutable {
@@ -127,12 +143,9 @@ rpc_client::raw_send(rpc_envelope e) {
 }
 seastar::future<>
 rpc_client::reconnect() {
-  fail_outstanding_futures();
-  return stop().then([this] {
-    // ensure that gate is closed
-    // gates can only be closed but not reopened
-    LOG_THROW_IF(!dispatch_gate_->is_closed(),
-                 "Dispatch gate is not properly closed. Unrecoverable error.");
+  if (conn_) { fail_connection(conn_); }
+  // connections draining after a GOAWAY finish their calls first
+  return dispatch_gate_->close().then([this] {
     dispatch_gate_ = std::make_unique<seastar::gate>();
     conn_ = nullptr;
     return connect();
@@ -145,8 +158,15 @@ rpc_client::connect() {
                "Client already connected to server: `{}'. connect "
                "called more than once.",
                server_addr);
+  return open_connection().then([this](auto conn) {
+    conn_ = conn;
+    start_reads(conn);
+  });
+}
 
-  return seastar::async([&] {
+seastar::future<seastar::lw_shared_ptr<rpc_connection>>
+rpc_client::open_connection() {
+  return seastar::async([this] {
     auto socket = seastar::make_lw_shared<seastar::socket>(
       seastar::engine().net().socket());
     auto servaddr = seastar::make_ipv4_address(server_addr);
@@ -155,38 +175,102 @@ rpc_client::connect() {
     auto fd =
       socket->connect(servaddr, sockaddr, seastar::transport::TCP).get();
     if (creds_) {
-
-      fd = seastar::tls::wrap_client(std::move(creds_), std::move(fd),
-                                     seastar::sstring{})
+      // copy; reconnect() needs the credentials again
+      fd = seastar::tls::wrap_client(creds_, std::move(fd), seastar::sstring{})
              .get();
     }
 
-    conn_ = seastar::make_lw_shared<rpc_connection>(
+    auto conn = seastar::make_lw_shared<rpc_connection>(
       std::move(fd), std::move(sockaddr), limits_);
+    conn->allow_unchecked_payloads = !!creds_;
+    return conn;
+  });
+}
+
+void
+rpc_client::start_reads(seastar::lw_shared_ptr<rpc_connection> conn) {
+  // dispatch in background
+  (void)seastar::with_gate(*dispatch_gate_,
+                           [this, conn]() mutable { return do_reads(conn); });
+}
 
-    // dispatch in background
-    (void)seastar::with_gate(*dispatch_gate_,
-                             [this]() mutable { return do_reads(); });
-    seastar::make_ready_future<>().get();
+void
+rpc_client::handle_goaway(seastar::lw_shared_ptr<rpc_connection> conn) {
+  if (conn != conn_ || migration_) { return; }
+  LOG_INFO("Server {} is going away; moving to a new connection",
+           server_addr);
+  // the server may be restarting; give it a moment
+  auto attempt = [this](uint32_t i) {
+    return seastar::sleep(std::chrono::milliseconds(100 * i)).then([this] {
+      return open_connection();
+    });
+  };
+  auto f = seastar::with_gate(*dispatch_gate_, [attempt] {
+    return seastar::repeat_until_value([attempt, i = 0u]() mutable {
+      using ret_t = std::optional<seastar::lw_shared_ptr<rpc_connection>>;
+      // by value; the action is moved once the first attempt sleeps
+      return attempt(i++).then_wrapped([n = i](auto f) {
+        try {
+          return ret_t(f.get0());
+        } catch (...) {
+          if (n >= kGoawayConnectAttempts) { throw; }
+          LOG_INFO("Could not reconnect after a GOAWAY: {}",
+                   std::current_exception());
+          return ret_t{};
+        }
+      });
+    });
   });
-};
+  migration_ = seastar::shared_future<>(
+    f.then_wrapped([this, old = conn](auto f) {
+      migration_ = std::nullopt;
+      try {
+        conn_ = f.get0();
+        start_reads(conn_);
+      } catch (...) {
+        LOG_ERROR("Could not move away from {}: {}", server_addr,
+                  std::current_exception());
+        // calls in flight still complete on the old connection
+        conn_ = nullptr;
+        close_if_drained(old);
+        throw;
+      }
+      close_if_drained(old);
+    }));
+}
+
+void
+rpc_client::close_if_drained(seastar::lw_shared_ptr<rpc_connection> conn) {
+  if (conn == conn_ || !conn->is_valid()) { return; }
+  for (auto &p : rpc_slots_) {
+    if (p.second->conn == conn) { return; }
+  }
+  conn->disable();
+  try {
+    conn->socket.shutdown_input();
+    conn->socket.shutdown_output();
+  } catch (...) {}
+}
 
 seastar::future<>
-rpc_client::dispatch_write(rpc_envelope e) {
+rpc_client::dispatch_write(seastar::lw_shared_ptr<rpc_connection> conn,
+                           rpc_envelope e) {
   // NOTE: The reason for the double gate, is that this future
   // is dispatched in the background
   return seastar::with_gate(
-    *dispatch_gate_, [this, e = std::move(e)]() mutable {
-      auto payload_size = e.size();
+    *dispatch_gate_, [this, conn, e = std::move(e)]() mutable {
+      // file backed payloads account their chunks while sending
+      auto payload_size = e.letter.in_memory_size();
       return seastar::with_semaphore(
-        conn_->limits->resources_available, payload_size,
-        [this, e = std::move(e)]() mutable {
+        conn->limits->resources_available, payload_size,
+        [this, conn, e = std::move(e)]() mutable {
           return seastar::with_semaphore(
-            serialize_writes_, 1, [this, e = std::move(e)]() mutable {
-              return rpc_envelope::send(&conn_->ostream, std::move(e))
-                .handle_exception([this](auto _) {
+            serialize_writes_, 1, [this, conn, e = std::move(e)]() mutable {
+              return rpc_envelope::send(&conn->ostream, std::move(e),
+                                        conn->limits.get())
+                .handle_exception([this, conn](auto _) {
                   LOG_INFO("Handling exception(2): {}", _);
-                  fail_outstanding_futures();
+                  fail_connection(conn);
                 });
             });
         });
@@ -195,79 +279,98 @@ rpc_client::dispatch_write(rpc_envelope e) {
 
 void
 rpc_client::fail_outstanding_futures() {
-  if (is_conn_valid()) {
+  if (conn_) { fail_connection(conn_); }
+  // connections draining after a GOAWAY
+  while (!rpc_slots_.empty()) {
+    fail_connection(rpc_slots_.begin()->second->conn);
+  }
+}
+
+void
+rpc_client::fail_connection(seastar::lw_shared_ptr<rpc_connection> conn) {
+  if (conn && conn->is_valid()) {
     DLOG_TRACE("Disabling connection to: {}", server_addr);
     try {
       // NOTE: This is critical. If we don't shutdown the input
       // the server *might* return data which we will leak since the
       // listening socket is still active. We must unregister from
       // seastar pollers via shutdown_* methods
-      conn_->disable();
-      conn_->socket.shutdown_input();
-      conn_->socket.shutdown_output();
+      conn->disable();
+      conn->socket.shutdown_input();
+      conn->socket.shutdown_output();
     } catch (...) {}
   }
-  while (!rpc_slots_.empty()) {
-    auto [session, promise_ptr] = *rpc_slots_.begin();
+  for (auto it = rpc_slots_.begin(); it != rpc_slots_.end();) {
+    if (it->second->conn != conn) {
+      ++it;
+      continue;
+    }
     LOG_INFO("Setting exceptional state for {} client_id={}", server_addr,
-             session);
-    promise_ptr->pr.set_exception(remote_connection_error());
-    rpc_slots_.erase(rpc_slots_.begin());
+             it->first);
+    it->second->pr.set_exception(remote_connection_error());
+    it = rpc_slots_.erase(it);
   }
 }
 
 seastar::future<>
-rpc_client::process_one_request() {
-  // due to a timeout exception, we make a copy of the conn in the
+rpc_client::process_one_request(seastar::lw_shared_ptr<rpc_connection> conn) {
+  // due to a timeout exception, we hold on to the conn in the
   // lambda capture param of the lw_shared_ptr
-  return rpc_recv_context::parse_header(conn_.get())
-    .then([this, conn = conn_](auto hdr) {
-      if (SMF_UNLIKELY(!hdr)) {
+  return rpc_recv_context::parse_header(conn.get())
+    .then([this, conn](auto hdr) {
+      // replies always carry a status; a request without an id is
+      // answered by the server instead, with a 400
+      if (SMF_UNLIKELY(!hdr || hdr->meta() == 0)) {
         conn->set_error("Could not parse header from server");
-        fail_outstanding_futures();
+        fail_connection(conn);
         return seastar::make_ready_future<>();
       }
       return rpc_recv_context::parse_payload(conn.get(), std::move(hdr.value()))
         .then([this, conn](std::optional<rpc_recv_context> opt) mutable {
-          DLOG_THROW_IF(read_counter_ <= 0,
-                        "Internal error. Invalid counter: {}", read_counter_);
           if (SMF_UNLIKELY(!opt)) {
             conn->set_error(
               "Could not parse response from server. Bad payload");
-            fail_outstanding_futures();
+            fail_connection(conn);
+            return seastar::make_ready_future<>();
+          }
+          if (rpc_is_goaway(opt->header)) {
+            handle_goaway(conn);
             return seastar::make_ready_future<>();
           }
+          DLOG_THROW_IF(read_counter_ <= 0,
+                        "Internal error. Invalid counter: {}", read_counter_);
           uint16_t sess = opt->session();
           auto it = rpc_slots_.find(sess);
           if (SMF_UNLIKELY(it == rpc_slots_.end())) {
             LOG_ERROR("Cannot find session: {}", sess);
             conn->set_error("Invalid session");
-            fail_outstanding_futures();
+            fail_connection(conn);
             return seastar::make_ready_future<>();
           }
           --read_counter_;
           it->second->pr.set_value(std::move(opt));
           rpc_slots_.erase(it);
+          close_if_drained(conn);
           return seastar::make_ready_future<>();
         });
     });
 }
 seastar::future<>
-rpc_client::do_reads() {
+rpc_client::do_reads(seastar::lw_shared_ptr<rpc_connection> conn) {
   auto timeout_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-                      conn_->limits->max_body_parsing_duration)
+                      conn->limits->max_body_parsing_duration)
                       .count();
 
   return seastar::do_until(
-           [this] { return !is_conn_valid(); },
-           [this, timeout_ms]() {
+           [conn] { return !conn->is_valid(); },
+           [this, conn, timeout_ms]() {
              auto timeout = seastar::timer<>::clock::now() +
                             std::chrono::milliseconds(timeout_ms);
-             return seastar::with_timeout(timeout, process_one_request());
+             return seastar::with_timeout(timeout, process_one_request(conn));
            })
-    .handle_exception([this](auto ep) {
+    .handle_exception([this, conn](auto ep) {
       LOG_INFO("Handling exception: {}", ep);
-      fail_outstanding_futures();
+      fail_connection(conn);
     });
 }
 
@@ -288,10 +391,17 @@ rpc_client::apply_outgoing_filters(rpc_envelope e) {
 
 seastar::future<rpc_recv_context>
 rpc_client::stage_incoming_filters(rpc_recv_context ctx) {
+  // no point in a SEDA hop through an empty stage
+  if (in_filters_.empty()) {
+    return seastar::make_ready_future<rpc_recv_context>(std::move(ctx));
+  }
   return incoming_stage(this, std::move(ctx));
 }
 seastar::future<rpc_envelope>
 rpc_client::stage_outgoing_filters(rpc_envelope e) {
+  if (out_filters_.empty()) {
+    return seastar::make_ready_future<rpc_envelope>(std::move(e));
+  }
   return outgoing_stage(this, std::move(e));
 }
 
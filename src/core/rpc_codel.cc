@@ -0,0 +1,27 @@
+// Copyright 2019 SMF Authors
+//
+#include "smf/rpc_codel.h"
+
+#include <algorithm>
+
+namespace smf {
+
+rpc_codel::rpc_codel(rpc_codel_args args)
+  : args_(args), interval_end_(clock::now() + args.interval) {}
+
+bool
+rpc_codel::should_reject(clock::duration sojourn, clock::time_point now) {
+  if (!args_.enabled) { return false; }
+  if (now > interval_end_) {
+    // a whole interval without dipping under target: standing queue
+    overloaded_ = min_sojourn_ > args_.target;
+    last_min_sojourn_ = min_sojourn_;
+    min_sojourn_ = sojourn;
+    interval_end_ = now + args_.interval;
+  } else {
+    min_sojourn_ = std::min(min_sojourn_, sojourn);
+  }
+  return overloaded_ && sojourn > 2 * args_.target;
+}
+
+}  // namespace smf
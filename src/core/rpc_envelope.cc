@@ -4,8 +4,10 @@
 
 #include <algorithm>
 #include <cstring>
+#include <limits>
 #include <utility>
 
+#include <seastar/core/scattered_message.hh>
 #include <smf/log.h>
 #include <smf/rpc_generated.h>
 
@@ -14,14 +16,144 @@
 
 namespace smf {
 
+/// \brief sets header size & checksum over the body and all the fragments.
+/// Runs once, at send time, however many fragments were appended
+static void
+checksum_fragmented_rpc(rpc_letter &l) {
+  rpc_payload_hasher h(rpc_checksum_type(l.header));
+  h.update(l.body.get(), l.body.size());
+  for (auto &f : l.fragments) {
+    h.update(f.get(), f.size());
+  }
+  l.header.mutate_checksum(h.digest());
+  l.header.mutate_size(l.payload_size());
+}
+
+/// \brief header, body & fragments as one vectored write
+static seastar::scattered_message<char>
+scatter_letter(rpc_letter &l) {
+  seastar::temporary_buffer<char> header_buf(rpc_envelope::kHeaderSize);
+  std::memcpy(header_buf.get_write(), reinterpret_cast<char *>(&l.header),
+              rpc_envelope::kHeaderSize);
+  seastar::scattered_message<char> msg;
+  msg.append(std::move(header_buf));
+  if (!l.body.empty()) { msg.append(std::move(l.body)); }
+  for (auto &f : l.fragments) {
+    msg.append(std::move(f));
+  }
+  l.fragments.clear();
+  return msg;
+}
+
+/// \brief reads the range one chunk at a time and calls `f` with each.
+/// Every chunk is accounted against `limits` - if any - until `f` is done
+/// with it. It does not *wait* for the units: the reply already holds the
+/// request's memory and waiting could deadlock with the incoming requests
+template <typename Func>
+static seastar::future<>
+for_each_file_chunk(rpc_file_range &r, rpc_connection_limits *limits,
+                    Func &&f) {
+  return seastar::do_with(
+    uint64_t(0), std::forward<Func>(f),
+    [&r, limits](uint64_t &pos, std::decay_t<Func> &f) {
+      return seastar::do_until(
+        [&r, &pos] { return pos >= r.size; },
+        [&r, &pos, &f, limits] {
+          const size_t len =
+            std::min<uint64_t>(rpc_envelope::kFileChunkSize, r.size - pos);
+          if (limits) { limits->resources_available.consume(len); }
+          return r.file.dma_read_exactly<char>(r.offset + pos, len)
+            .then([&pos, &f, len](seastar::temporary_buffer<char> buf) {
+              pos += len;
+              return f(std::move(buf));
+            })
+            .finally([limits, len] {
+              if (limits) { limits->admission.signal(nullptr, len); }
+            });
+        });
+    });
+}
+
+/// \brief the checksum goes in the header, *before* the payload. Use the
+/// precomputed checksum of the range if we can, or read it once to compute
+static seastar::future<>
+checksum_file_backed_rpc(rpc_letter &l, rpc_connection_limits *limits) {
+  auto &r = l.file_range.value();
+  const auto t = rpc_checksum_type(l.header);
+  l.header.mutate_size(l.payload_size());
+  if (t == checksum_type::none) {
+    l.header.mutate_checksum(0);
+    return seastar::make_ready_future<>();
+  }
+  if (r.checksum && r.checksum_algorithm == t) {
+    if (l.body.empty() && l.fragments.empty()) {
+      l.header.mutate_checksum(r.checksum.value());
+      return seastar::make_ready_future<>();
+    }
+    // only crc32c composes
+    if (t == checksum_type::crc32c) {
+      uint32_t crc = crc32c(l.body.get(), l.body.size());
+      for (auto &f : l.fragments) {
+        crc = crc32c_extend(crc, f.get(), f.size());
+      }
+      l.header.mutate_checksum(crc32c_combine(crc, r.checksum.value(), r.size));
+      return seastar::make_ready_future<>();
+    }
+  }
+  return seastar::do_with(rpc_payload_hasher(t), [&l, &r, limits](auto &h) {
+    h.update(l.body.get(), l.body.size());
+    for (auto &f : l.fragments) {
+      h.update(f.get(), f.size());
+    }
+    return for_each_file_chunk(r, limits,
+                               [&h](seastar::temporary_buffer<char> buf) {
+                                 h.update(buf.get(), buf.size());
+                                 return seastar::make_ready_future<>();
+                               })
+      .then([&l, &h] { l.header.mutate_checksum(h.digest()); });
+  });
+}
+
+static seastar::future<>
+send_file_backed(seastar::output_stream<char> *out, rpc_envelope e,
+                 rpc_connection_limits *limits) {
+  return seastar::do_with(std::move(e), [out, limits](rpc_envelope &e) {
+    return checksum_file_backed_rpc(e.letter, limits)
+      .then([out, &e] { return out->write(scatter_letter(e.letter)); })
+      .then([out, &e, limits] {
+        return for_each_file_chunk(
+          e.letter.file_range.value(), limits,
+          [out](seastar::temporary_buffer<char> buf) {
+            return out->write(std::move(buf));
+          });
+      })
+      .then([out] { return out->flush(); });
+  });
+}
+
 seastar::future<>
-rpc_envelope::send(seastar::output_stream<char> *out, rpc_envelope e) {
-  seastar::temporary_buffer<char> header_buf(kHeaderSize);
+rpc_envelope::send(seastar::output_stream<char> *out, rpc_envelope e,
+                   rpc_connection_limits *limits) {
+  if (SMF_UNLIKELY(e.letter.file_range)) {
+    return send_file_backed(out, std::move(e), limits);
+  }
+  if (!e.letter.fragments.empty()) {
+    checksum_fragmented_rpc(e.letter);
+    return out->write(scatter_letter(e.letter)).then([out] {
+      return out->flush();
+    });
+  }
   DLOG_THROW_IF(e.letter.header.size() == 0, "Invalid header size");
-  DLOG_THROW_IF(e.letter.header.checksum() == 0, "Invalid header checksum");
+  DLOG_THROW_IF(e.letter.header.checksum() == 0 &&
+                  rpc_checksum_type(e.letter.header) != checksum_type::none,
+                "Invalid header checksum");
   DLOG_ERROR_IF(e.letter.body.size() == 0, "Invalid payload. 0-size");
+  DLOG_THROW_IF(e.letter.header.size() != e.letter.payload_size(),
+                "Header size: {} does not match payload size: {}",
+                e.letter.header.size(), e.letter.payload_size());
   // use 0 copy iface in seastar
   // prepare the header locally
+  seastar::temporary_buffer<char> header_buf(kHeaderSize);
   std::memcpy(header_buf.get_write(),
               reinterpret_cast<char *>(&e.letter.header), kHeaderSize);
   // needs to be moved so we can do zero copy output buffer
@@ -45,6 +177,47 @@ rpc_envelope::operator=(rpc_envelope &&o) noexcept {
 rpc_envelope::rpc_envelope(rpc_envelope &&o) noexcept
   : letter(std::move(o.letter)) {}
 
+void
+rpc_envelope::set_checksum_type(checksum_type t) {
+  if (rpc_checksum_type(letter.header) == t) { return; }
+  LOG_THROW_IF(!rpc_checksum_supported(t), "xxh3 checksums need xxhash >= 0.8");
+  rpc_set_checksum_type(letter.header, t);
+  if (letter.payload_size() > 0) { update_checksum(); }
+}
+
+void
+rpc_envelope::update_checksum() {
+  if (letter.file_range) {
+    // computed while sending, see checksum_file_backed_rpc()
+    letter.header.mutate_size(letter.payload_size());
+    return;
+  }
+  if (SMF_UNLIKELY(!letter.fragments.empty())) {
+    // computed while sending, see checksum_fragmented_rpc()
+    letter.header.mutate_size(letter.payload_size());
+    return;
+  }
+  checksum_rpc(letter.header, letter.body.get(), letter.body.size());
+}
+
+void
+rpc_envelope::set_file_range(rpc_file_range range) {
+  LOG_THROW_IF(letter.file_range, "Envelope already has a file range");
+  LOG_THROW_IF(letter.payload_size() + range.size >
+                 std::numeric_limits<uint32_t>::max(),
+               "Payload of {} bytes does not fit in an rpc frame",
+               letter.payload_size() + range.size);
+  letter.file_range = std::move(range);
+  update_checksum();
+}
+
+size_t
+rpc_envelope::append_fragment(seastar::temporary_buffer<char> frag) {
+  const size_t offset = letter.append_fragment(std::move(frag));
+  letter.header.mutate_size(letter.payload_size());
+  return offset;
+}
+
 void
 rpc_envelope::add_dynamic_header(const char *header, const char *value) {
   DLOG_THROW_IF(header != nullptr, "Cannot add header with empty key");
@@ -0,0 +1,41 @@
+// Copyright 2019 SMF Authors
+//
+#include "smf/rpc_handler_offload.h"
+
+#include <seastar/core/thread.hh>
+
+#include "smf/log.h"
+
+namespace smf {
+
+rpc_handler_offload::rpc_handler_offload(
+  rpc_service_method_handle *h, seastar::scheduling_group group,
+  seastar::lw_shared_ptr<histogram> wait_hist)
+  : handle_(h), group_(group), wait_hist_(std::move(wait_hist)),
+    slots_(h->options.offload_concurrency) {
+  LOG_THROW_IF(h->options.offload_concurrency == 0,
+               "Method is not offloaded");
+}
+
+seastar::future<rpc_envelope>
+rpc_handler_offload::run(rpc_recv_context &&ctx) {
+  queued_++;
+  return seastar::with_semaphore(
+    slots_, 1,
+    [this, begin = clock::now(), ctx = std::move(ctx)]() mutable {
+      queued_--;
+      running_++;
+      wait_hist_->record(std::chrono::duration_cast<std::chrono::microseconds>(
+                           clock::now() - begin)
+                           .count());
+      seastar::thread_attributes attr;
+      attr.sched_group = group_;
+      return seastar::async(attr,
+                            [h = handle_, ctx = std::move(ctx)]() mutable {
+                              return h->apply(std::move(ctx)).get0();
+                            })
+        .finally([this] { running_--; });
+    });
+}
+
+}  // namespace smf
@@ -2,6 +2,10 @@
 //
 #include "smf/rpc_letter.h"
 
+#include <cstring>
+
+#include "smf/log.h"
+
 namespace smf {
 
 rpc_letter::rpc_letter() {}
@@ -15,26 +19,73 @@ rpc_letter::operator=(rpc_letter &&l) noexcept {
   header = l.header;
   dynamic_headers = std::move(l.dynamic_headers);
   body = std::move(l.body);
+  fragments = std::move(l.fragments);
+  file_range = std::move(l.file_range);
   return *this;
 }
 rpc_letter
 rpc_letter::share() {
-  return rpc_letter(header, dynamic_headers, body.share());
+  rpc_letter ret(header, dynamic_headers, body.share());
+  ret.fragments.reserve(fragments.size());
+  for (auto &f : fragments) {
+    ret.fragments.push_back(f.share());
+  }
+  // seastar::file is a shared handle
+  ret.file_range = file_range;
+  return ret;
 }
 
 rpc_letter::rpc_letter(rpc_letter &&o) noexcept
   : header(o.header), dynamic_headers(std::move(o.dynamic_headers)),
-    body(std::move(o.body)) {}
+    body(std::move(o.body)), fragments(std::move(o.fragments)),
+    file_range(std::move(o.file_range)) {}
 
 rpc_letter::~rpc_letter() {}
 
 size_t
 rpc_letter::size() const {
-  return sizeof(header) + body.size();
+  return sizeof(header) + payload_size();
+}
+size_t
+rpc_letter::payload_size() const {
+  size_t sz = body.size();
+  for (auto &f : fragments) {
+    sz += f.size();
+  }
+  if (file_range) { sz += file_range->size; }
+  return sz;
+}
+size_t
+rpc_letter::in_memory_size() const {
+  return size() - (file_range ? file_range->size : 0);
 }
 bool
 rpc_letter::empty() const {
-  return body.size() == 0;
+  return payload_size() == 0;
+}
+
+size_t
+rpc_letter::append_fragment(seastar::temporary_buffer<char> frag) {
+  LOG_THROW_IF(file_range, "The file range must be the last fragment");
+  const size_t offset = payload_size();
+  if (!frag.empty()) { fragments.push_back(std::move(frag)); }
+  return offset;
+}
+
+void
+rpc_letter::linearize() {
+  LOG_THROW_IF(file_range, "Cannot linearize a file backed payload");
+  if (fragments.empty()) { return; }
+  seastar::temporary_buffer<char> buf(payload_size());
+  char *out = buf.get_write();
+  std::memcpy(out, body.get(), body.size());
+  out += body.size();
+  for (auto &f : fragments) {
+    std::memcpy(out, f.get(), f.size());
+    out += f.size();
+  }
+  body = std::move(buf);
+  fragments.clear();
 }
 
 }  // namespace smf
@@ -0,0 +1,145 @@
+// Copyright 2019 SMF Authors
+//
+#include "smf/rpc_memory_admission.h"
+
+#include <seastar/core/metrics.hh>
+
+#include "smf/log.h"
+
+namespace smf {
+
+rpc_memory_admission::~rpc_memory_admission() {
+  auto fail = [](rpc_tenant_quota *t) {
+    for (auto &w : t->waiters_) {
+      w.pr.set_exception(seastar::broken_semaphore());
+    }
+    t->waiters_.clear();
+  };
+  for (auto &[id, t] : tenants_) { fail(t.get()); }
+  fail(default_.get());
+}
+
+seastar::lw_shared_ptr<rpc_tenant_quota>
+rpc_memory_admission::attach(const seastar::sstring &id, uint64_t max_memory) {
+  auto it = tenants_.find(id);
+  if (it == tenants_.end()) {
+    auto t = seastar::make_lw_shared<rpc_tenant_quota>(id, max_memory);
+    register_metrics(t.get());
+    it = tenants_.emplace(id, std::move(t)).first;
+  }
+  it->second->connections++;
+  return it->second;
+}
+
+seastar::lw_shared_ptr<rpc_tenant_quota>
+rpc_memory_admission::attach_default() {
+  default_->connections++;
+  return default_;
+}
+
+void
+rpc_memory_admission::detach(seastar::lw_shared_ptr<rpc_tenant_quota> t) {
+  DLOG_THROW_IF(t->connections == 0, "Tenant {} has no connections", t->id);
+  if (--t->connections > 0 || !t->waiters_.empty() || t->used_bytes > 0 ||
+      t == default_) {
+    return;
+  }
+  tenants_.erase(t->id);
+}
+
+seastar::lw_shared_ptr<rpc_tenant_quota>
+rpc_memory_admission::shared(rpc_tenant_quota *t) {
+  if (t == default_.get()) { return default_; }
+  return tenants_[t->id];
+}
+
+void
+rpc_memory_admission::register_metrics(rpc_tenant_quota *t) {
+  namespace sm = seastar::metrics;
+  auto tenant = sm::label("tenant");
+  t->metrics_.add_group(
+    "smf::rpc_server",
+    {
+      sm::make_gauge("tenant_waiting_bytes", [t] { return t->waiting_bytes; },
+                     sm::description("Request bytes waiting for memory"),
+                     {tenant(t->id)}),
+      sm::make_gauge("tenant_used_bytes", [t] { return t->used_bytes; },
+                     sm::description("Request bytes admitted & in flight"),
+                     {tenant(t->id)}),
+      sm::make_gauge("tenant_connections", [t] { return t->connections; },
+                     sm::description("Open connections of the tenant"),
+                     {tenant(t->id)}),
+    });
+}
+
+seastar::future<>
+rpc_memory_admission::wait(rpc_tenant_quota *t, uint64_t bytes) {
+  // fast path: nobody is queued, so there is nobody to be fair to
+  if (ready_.empty() && t->waiters_.empty() && t->fits(bytes) &&
+      shard_->try_wait(bytes)) {
+    t->used_bytes += bytes;
+    return seastar::make_ready_future<>();
+  }
+  t->waiters_.emplace_back(bytes);
+  t->waiting_bytes += bytes;
+  auto f = t->waiters_.back().pr.get_future();
+  if (!t->queued_) {
+    t->queued_ = true;
+    ready_.push_back(shared(t));
+  }
+  drain();
+  return f;
+}
+
+void
+rpc_memory_admission::signal(rpc_tenant_quota *t, uint64_t bytes) {
+  if (t != nullptr) {
+    DLOG_THROW_IF(t->used_bytes < bytes, "Tenant {} releasing {} of {}",
+                  t->id, bytes, t->used_bytes);
+    t->used_bytes -= bytes;
+    // it may have left the round robin, blocked on its own quota
+    if (!t->waiters_.empty() && !t->queued_) {
+      t->queued_ = true;
+      ready_.push_back(shared(t));
+    }
+  }
+  shard_->signal(bytes);
+  drain();
+  if (t != nullptr && t != default_.get() && t->connections == 0 &&
+      t->used_bytes == 0 && t->waiters_.empty()) {
+    tenants_.erase(t->id);
+  }
+}
+
+void
+rpc_memory_admission::drain() {
+  while (!ready_.empty()) {
+    auto t = ready_.front();
+    auto &w = lifo_ ? t->waiters_.back() : t->waiters_.front();
+    if (!t->fits(w.bytes)) {
+      // wakes up on its own signal()
+      ready_.pop_front();
+      t->queued_ = false;
+      continue;
+    }
+    // the head keeps its turn until the shard has room for it; letting
+    // smaller requests pass would starve large ones
+    if (!shard_->try_wait(w.bytes)) { return; }
+    t->used_bytes += w.bytes;
+    t->waiting_bytes -= w.bytes;
+    w.pr.set_value();
+    if (lifo_) {
+      t->waiters_.pop_back();
+    } else {
+      t->waiters_.pop_front();
+    }
+    ready_.pop_front();
+    if (t->waiters_.empty()) {
+      t->queued_ = false;
+    } else {
+      ready_.push_back(std::move(t));
+    }
+  }
+}
+
+}  // namespace smf
@@ -0,0 +1,28 @@
+// Copyright 2019 SMF Authors
+//
+#include "smf/rpc_priority.h"
+
+#include <seastar/core/do_with.hh>
+#include <seastar/core/future-util.hh>
+
+namespace smf {
+
+seastar::future<std::vector<rpc_priority_class>>
+rpc_create_priority_classes(
+  std::vector<std::pair<seastar::sstring, float>> shares) {
+  return seastar::do_with(
+    std::move(shares), std::vector<rpc_priority_class>{},
+    [](auto &shares, auto &classes) {
+      return seastar::do_for_each(
+               shares,
+               [&classes](auto &p) {
+                 return seastar::create_scheduling_group(p.first, p.second)
+                   .then([&classes, name = p.first](auto group) {
+                     classes.push_back(rpc_priority_class{name, group});
+                   });
+               })
+        .then([&classes] { return std::move(classes); });
+    });
+}
+
+}  // namespace smf
@@ -3,16 +3,21 @@
 #include "smf/rpc_recv_context.h"
 
 #include <chrono>
+#include <algorithm>
+#include <cstring>
 #include <optional>
 
+#include <seastar/core/align.hh>
 #include <seastar/core/timer.hh>
 // seastar BUG: when compiling w/ -O3
 // some headers are not included on timer.hh
 // which causes missed impl symbols. We should revisit
 // after upgrade our build system to upstream cmake
 #include <seastar/core/reactor.hh>
+#include <seastar/core/with_timeout.hh>
 #include <seastar/util/noncopyable_function.hh>
 
+#include "smf/compression.h"
 #include "smf/log.h"
 #include "smf/rpc_generated.h"
 #include "smf/rpc_header_ostream.h"
@@ -31,10 +36,31 @@ rpc_recv_context::rpc_recv_context(
 
 rpc_recv_context::rpc_recv_context(rpc_recv_context &&o) noexcept
   : rpc_server_limits(o.rpc_server_limits), remote_address(o.remote_address),
-    header(std::move(o.header)), payload(std::move(o.payload)) {}
+    header(std::move(o.header)), payload(std::move(o.payload)),
+    payload_memory(std::move(o.payload_memory)),
+    payload_alignment_(o.payload_alignment_), aligned_base_(o.aligned_base_) {
+}
 
 rpc_recv_context::~rpc_recv_context() {}
 
+bool
+rpc_recv_context::is_error_reply() const {
+  return rpc_is_error_reply(header);
+}
+
+std::optional<seastar::sstring>
+rpc_recv_context::error_reason() const {
+  if (!is_error_reply()) { return std::nullopt; }
+  auto ptr = reinterpret_cast<const uint8_t *>(payload.get());
+  flatbuffers::Verifier verifier(ptr, payload.size());
+  if (!verifier.VerifyBuffer<rpc::error_reply>(nullptr)) {
+    return std::nullopt;
+  }
+  auto err = flatbuffers::GetRoot<rpc::error_reply>(ptr);
+  if (err->reason() == nullptr) { return seastar::sstring(); }
+  return seastar::sstring(err->reason()->c_str(), err->reason()->size());
+}
+
 constexpr uint32_t
 max_flatbuffers_size() {
   // 2GB - 1 is the max a flatbuffers::vector<uint8_t> can hold
@@ -44,51 +70,187 @@ max_flatbuffers_size() {
   return static_cast<uint32_t>(FLATBUFFERS_MAX_BUFFER_SIZE);
 }
 
+void
+rpc_recv_context::reserve_payload_memory(uint64_t bytes) {
+  if (bytes > max_flatbuffers_size()) {
+    throw rpc_payload_too_large(fmt::format(
+      "Payload of {} exceeds the flatbuffers max size", human_bytes(bytes)));
+  }
+  // i.e.: benchmarks & tests without limits
+  if (!rpc_server_limits) { return; }
+  auto r = rpc_memory_reservation::try_reserve(rpc_server_limits, bytes);
+  if (!r) {
+    throw rpc_payload_too_large(fmt::format(
+      "Payload needs {} more, only {} left on core", human_bytes(bytes),
+      human_bytes(std::max<ssize_t>(
+        0, rpc_server_limits->resources_available.current()))));
+  }
+  payload_memory.merge(std::move(*r));
+}
+
+void
+rpc_recv_context::reserve_uncompressed(codec &c) {
+  auto sz = c.uncompressed_size(payload.get(), payload.size());
+  LOG_THROW_IF(!sz, "Cannot decompress. Frame does not declare its size");
+  if (*sz > payload.size()) { reserve_payload_memory(*sz - payload.size()); }
+}
+
+/// \brief `size` zero padded to a multiple of `alignment`, in a buffer aligned
+/// to it. Copies from the socket buffers once - what read_exactly() does
+/// anyway for payloads that span packets
+static seastar::temporary_buffer<char>
+make_aligned_buffer(size_t size, size_t alignment) {
+  const size_t padded = seastar::align_up(size, alignment);
+  auto buf = seastar::temporary_buffer<char>::aligned(alignment, padded);
+  std::memset(buf.get_write() + size, 0, padded - size);
+  return buf;
+}
+
+static seastar::future<seastar::temporary_buffer<char>>
+read_exactly_aligned(seastar::input_stream<char> &in, size_t size,
+                     size_t alignment) {
+  return seastar::do_with(
+    make_aligned_buffer(size, alignment), size_t(0),
+    [&in, size](seastar::temporary_buffer<char> &buf, size_t &pos) {
+      return seastar::repeat([&in, &buf, &pos, size] {
+               return in.read_up_to(size - pos).then(
+                 [&buf, &pos, size](seastar::temporary_buffer<char> chunk) {
+                   if (chunk.empty()) {
+                     // eof; reported as a short read
+                     return seastar::make_ready_future<
+                       seastar::stop_iteration>(seastar::stop_iteration::yes);
+                   }
+                   std::memcpy(buf.get_write() + pos, chunk.get(),
+                               chunk.size());
+                   pos += chunk.size();
+                   return seastar::make_ready_future<seastar::stop_iteration>(
+                     seastar::stop_iteration(pos == size));
+                 });
+             })
+        .then([&buf, &pos] {
+          buf.trim(pos);
+          return std::move(buf);
+        });
+    });
+}
+
+static bool
+valid_payload(rpc_connection *conn, const rpc::header &hdr,
+              const seastar::temporary_buffer<char> &body) {
+  if (hdr.size() != body.size()) {
+    LOG_ERROR("Read incorrect number of bytes `{}`, expected header: `{}`",
+              body.size(), hdr);
+    return false;
+  }
+  if (hdr.size() > max_flatbuffers_size()) {
+    LOG_ERROR("Bad payload. Body is >  FLATBUFFERS_MAX_BUFFER_SIZE");
+    return false;
+  }
+  if (hdr.bitflags() &
+      rpc::header_bit_flags::header_bit_flags_has_payload_headers) {
+    LOG_ERROR("Reading payload headers is not yet implemented");
+    return false;
+  }
+
+  const auto algo = rpc_checksum_type(hdr);
+  if (algo == checksum_type::none) {
+    if (!conn->allow_unchecked_payloads) {
+      LOG_ERROR("Payload without checksum on a non-TLS connection `{}`", hdr);
+      return false;
+    }
+  } else {
+    const uint32_t xx = rpc_checksum_payload(body.get(), body.size(), algo);
+    if (xx != hdr.checksum()) {
+      LOG_ERROR("Payload checksum `{}` does not match header checksum `{}`",
+                xx, hdr.checksum());
+      return false;
+    }
+  }
+
+  return true;
+}
+
 seastar::future<std::optional<rpc_recv_context>>
-rpc_recv_context::parse_payload(rpc_connection *conn, rpc::header hdr) {
+rpc_recv_context::parse_payload(rpc_connection *conn, rpc::header hdr,
+                                uint32_t alignment) {
   using ret_type = std::optional<rpc_recv_context>;
-  return conn->istream.read_exactly(hdr.size())
-    .then([conn, hdr](seastar::temporary_buffer<char> body) mutable {
-      if (hdr.size() != body.size()) {
-        LOG_ERROR("Read incorrect number of bytes `{}`, expected header: `{}`",
-                  body.size(), hdr);
-        return seastar::make_ready_future<ret_type>(std::nullopt);
-      }
-      if (hdr.size() > max_flatbuffers_size()) {
-        LOG_ERROR("Bad payload. Body is >  FLATBUFFERS_MAX_BUFFER_SIZE");
+  auto f = alignment == 0
+             ? conn->istream.read_exactly(hdr.size())
+             : read_exactly_aligned(conn->istream, hdr.size(), alignment);
+  return f.then(
+    [conn, hdr, alignment](seastar::temporary_buffer<char> body) mutable {
+      if (!valid_payload(conn, hdr, body)) {
         return seastar::make_ready_future<ret_type>(std::nullopt);
       }
-      if (hdr.bitflags() &
-          rpc::header_bit_flags::header_bit_flags_has_payload_headers) {
-        LOG_ERROR("Reading payload headers is not yet implemented");
-        return seastar::make_ready_future<ret_type>(std::nullopt);
-      }
-
-      const uint32_t xx = rpc_checksum_payload(body.get(), body.size());
-      if (xx != hdr.checksum()) {
-        LOG_ERROR("Payload checksum `{}` does not match header checksum `{}`",
-                  xx, hdr.checksum());
-        return seastar::make_ready_future<ret_type>(std::nullopt);
-      }
-
       rpc_recv_context ctx(conn->limits, conn->remote_address, hdr,
                            std::move(body));
+      if (alignment != 0) {
+        ctx.payload_alignment_ = alignment;
+        ctx.aligned_base_ = ctx.payload.get();
+      }
       return seastar::make_ready_future<ret_type>(
         std::optional<rpc_recv_context>(std::move(ctx)));
     });
 }
 
+size_t
+rpc_recv_context::aligned_payload_size() const {
+  if (payload_alignment_ == 0) { return 0; }
+  return seastar::align_up(payload.size(), size_t(payload_alignment_));
+}
+
+void
+rpc_recv_context::realign_payload() {
+  if (payload_alignment_ == 0 || payload.get() == aligned_base_) { return; }
+  auto buf = make_aligned_buffer(payload.size(), payload_alignment_);
+  std::memcpy(buf.get_write(), payload.get(), payload.size());
+  buf.trim(payload.size());
+  payload = std::move(buf);
+  aligned_base_ = payload.get();
+}
+
+static constexpr size_t kRPCHeaderSize = sizeof(rpc::header);
+
+/// \brief the header bytes, or fewer on eof. Throws seastar::timed_out_error
+/// if the header trickles in slower than max_header_parsing_duration
+static seastar::future<seastar::temporary_buffer<char>>
+read_header(rpc_connection *conn) {
+  using buf_t = seastar::temporary_buffer<char>;
+  const auto timeout = conn->limits
+                         ? conn->limits->max_header_parsing_duration
+                         : seastar::timer<>::duration::zero();
+  if (timeout == seastar::timer<>::duration::zero()) {
+    return conn->istream.read_exactly(kRPCHeaderSize);
+  }
+  // the clock starts with the first byte; idle connections are not slow
+  return conn->istream.read_up_to(kRPCHeaderSize)
+    .then([conn, timeout](buf_t first) {
+      if (first.empty() || first.size() == kRPCHeaderSize) {
+        return seastar::make_ready_future<buf_t>(std::move(first));
+      }
+      auto deadline = seastar::timer<>::clock::now() + timeout;
+      auto rest = conn->istream.read_exactly(kRPCHeaderSize - first.size());
+      return seastar::with_timeout(deadline, std::move(rest))
+        .then([first = std::move(first)](buf_t rest) {
+          buf_t hdr(first.size() + rest.size());
+          std::memcpy(hdr.get_write(), first.get(), first.size());
+          std::memcpy(hdr.get_write() + first.size(), rest.get(),
+                      rest.size());
+          return hdr;
+        });
+    });
+}
+
 seastar::future<std::optional<rpc::header>>
 rpc_recv_context::parse_header(rpc_connection *conn) {
   using ret_type = std::optional<rpc::header>;
 
-  static constexpr size_t kRPCHeaderSize = sizeof(rpc::header);
   DLOG_THROW_IF(
     conn->istream_active_parser != 0,
     "without this line you can have interleaved reads on the buffer");
 
   conn->istream_active_parser++;
-  return conn->istream.read_exactly(kRPCHeaderSize)
+  return read_header(conn)
     .then([conn](seastar::temporary_buffer<char> header) {
       if (kRPCHeaderSize != header.size()) {
         LOG_ERROR_IF(conn->is_valid(),
@@ -106,12 +268,17 @@ rpc_recv_context::parse_header(rpc_connection *conn) {
         LOG_ERROR("Compression out of range", hdr);
         return seastar::make_ready_future<ret_type>(std::nullopt);
       }
-      if (hdr.checksum() <= 0) {
-        LOG_ERROR("checksum is empty");
+      if (!rpc_checksum_flags_valid(hdr)) {
+        LOG_ERROR("More than one checksum flag set: {}", hdr);
         return seastar::make_ready_future<ret_type>(std::nullopt);
       }
-      if (hdr.meta() <= 0) {
-        LOG_ERROR("meta is empty");
+      if (!rpc_checksum_supported(rpc_checksum_type(hdr))) {
+        LOG_ERROR("xxh3 checksums need xxhash >= 0.8: {}", hdr);
+        return seastar::make_ready_future<ret_type>(std::nullopt);
+      }
+      if (hdr.checksum() <= 0 &&
+          rpc_checksum_type(hdr) != checksum_type::none) {
+        LOG_ERROR("checksum is empty");
         return seastar::make_ready_future<ret_type>(std::nullopt);
       }
       if (hdr.compression() ==
@@ -0,0 +1,76 @@
+// Copyright 2019 SMF Authors
+//
+#include "smf/rpc_request_batcher.h"
+
+#include <stdexcept>
+
+#include "smf/log.h"
+
+namespace smf {
+
+rpc_request_batcher::rpc_request_batcher(rpc_service_method_handle *h,
+                                         seastar::scheduling_group group)
+  : handle_(h), group_(group) {
+  LOG_THROW_IF(h->options.batch_size == 0, "Method is not batched");
+  requests_.reserve(h->options.batch_size);
+  replies_.reserve(h->options.batch_size);
+  timer_.set_callback([this] { flush(); });
+}
+
+rpc_request_batcher::~rpc_request_batcher() {
+  timer_.cancel();
+  for (auto &pr : replies_) { pr.set_exception(seastar::broken_promise()); }
+}
+
+seastar::future<rpc_envelope>
+rpc_request_batcher::enqueue(rpc_recv_context &&ctx) {
+  requests_.push_back(std::move(ctx));
+  replies_.emplace_back();
+  auto f = replies_.back().get_future();
+  if (requests_.size() >= handle_->options.batch_size) {
+    full_batches_++;
+    flush();
+  } else if (requests_.size() == 1) {
+    timer_.arm(handle_->options.batch_wait);
+  }
+  return f;
+}
+
+void
+rpc_request_batcher::flush() {
+  timer_.cancel();
+  if (requests_.empty()) { return; }
+  batches_++;
+  batched_requests_ += requests_.size();
+  auto requests = std::move(requests_);
+  auto replies = std::move(replies_);
+  requests_.clear();
+  replies_.clear();
+  requests_.reserve(handle_->options.batch_size);
+  replies_.reserve(handle_->options.batch_size);
+  // every request holds the reply gate until its promise is set; nothing
+  // to wait for here
+  (void)seastar::with_scheduling_group(
+          group_,
+          [h = handle_, requests = std::move(requests)]() mutable {
+            return h->options.batch(std::move(requests));
+          })
+    .then_wrapped([replies = std::move(replies)](auto f) mutable {
+      try {
+        auto out = f.get0();
+        if (out.size() != replies.size()) {
+          throw std::runtime_error(
+            fmt::format("Batch returned {} replies for {} requests",
+                        out.size(), replies.size()));
+        }
+        for (auto i = 0u; i < out.size(); ++i) {
+          replies[i].set_value(std::move(out[i]));
+        }
+      } catch (...) {
+        auto ep = std::current_exception();
+        for (auto &pr : replies) { pr.set_exception(ep); }
+      }
+    });
+}
+
+}  // namespace smf
@@ -0,0 +1,52 @@
+// Copyright 2019 SMF Authors
+//
+#include "smf/rpc_request_coalescer.h"
+
+#include <seastar/core/future.hh>
+
+namespace smf {
+
+rpc_request_coalescer::~rpc_request_coalescer() {
+  for (auto &[k, c] : inflight_) {
+    for (auto &w : c->waiters) {
+      w.pr.set_exception(seastar::broken_promise());
+    }
+    c->waiters.clear();
+  }
+}
+
+seastar::future<rpc_envelope>
+rpc_request_coalescer::run(rpc_recv_context &&ctx, handler_t fn) {
+  const auto k = rpc_request_key::make(ctx.header, ctx.payload);
+  auto it = inflight_.find(k);
+  if (it != inflight_.end()) {
+    auto &c = it->second;
+    if (!rpc_request_key::same_payload(c->request, ctx.payload)) {
+      return fn(std::move(ctx));
+    }
+    coalesced_++;
+    c->waiters.emplace_back(ctx.session());
+    return c->waiters.back().pr.get_future();
+  }
+  auto c = seastar::make_lw_shared<call>(
+    seastar::temporary_buffer<char>(ctx.payload.get(), ctx.payload.size()));
+  inflight_.emplace(k, c);
+  return fn(std::move(ctx)).then_wrapped(
+    [this, k, c](seastar::future<rpc_envelope> f) {
+      inflight_.erase(k);
+      if (f.failed()) {
+        auto ep = f.get_exception();
+        for (auto &w : c->waiters) { w.pr.set_exception(ep); }
+        return seastar::make_exception_future<rpc_envelope>(ep);
+      }
+      auto e = f.get0();
+      for (auto &w : c->waiters) {
+        auto reply = e.share();
+        reply.letter.header.mutate_session(w.session);
+        w.pr.set_value(std::move(reply));
+      }
+      return seastar::make_ready_future<rpc_envelope>(std::move(e));
+    });
+}
+
+}  // namespace smf
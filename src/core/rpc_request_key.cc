@@ -0,0 +1,32 @@
+// Copyright 2019 SMF Authors
+//
+#include "smf/rpc_request_key.h"
+
+namespace smf {
+
+rpc_request_key
+rpc_request_key::make(const rpc::header &hdr,
+                      const seastar::temporary_buffer<char> &payload) {
+  const auto algo = rpc_checksum_type(hdr);
+  const uint32_t checksum =
+    algo == checksum_type::none
+      ? rpc_checksum_payload(payload.get(), payload.size(),
+                             checksum_type::xxhash64)
+      : hdr.checksum();
+  return rpc_request_key{hdr.meta(), checksum,
+                         static_cast<uint32_t>(payload.size()), algo,
+                         static_cast<int8_t>(hdr.compression())};
+}
+
+size_t
+rpc_request_key::hash::operator()(const rpc_request_key &k) const {
+  uint64_t h = (uint64_t(k.request_id) << 32) | k.checksum;
+  h ^= (uint64_t(k.size) << 16) ^ (uint64_t(k.algorithm) << 8) ^
+       uint8_t(k.compression);
+  // finalizer of splitmix64
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+  return h ^ (h >> 31);
+}
+
+}  // namespace smf
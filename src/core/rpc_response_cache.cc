@@ -0,0 +1,50 @@
+// Copyright 2019 SMF Authors
+//
+#include "smf/rpc_response_cache.h"
+
+#include "smf/log.h"
+
+namespace smf {
+
+rpc_response_cache::rpc_response_cache(rpc_response_cache_args args)
+  : args_(args), cache_(args.max_bytes) {}
+
+std::optional<rpc_envelope>
+rpc_response_cache::get(const rpc_recv_context &req, clock::time_point now) {
+  const auto k = rpc_request_key::make(req.header, req.payload);
+  auto e = cache_.get(k);
+  if (e == nullptr) {
+    misses_++;
+    return std::nullopt;
+  }
+  if (e->expires <= now) {
+    cache_.erase(k);
+    misses_++;
+    return std::nullopt;
+  }
+  if (!rpc_request_key::same_payload(e->request, req.payload)) {
+    misses_++;
+    return std::nullopt;
+  }
+  hits_++;
+  return e->reply.share();
+}
+
+void
+rpc_response_cache::put(const rpc::header &req,
+                        seastar::temporary_buffer<char> request,
+                        rpc_envelope &reply, std::chrono::milliseconds ttl,
+                        clock::time_point now) {
+  // file backed replies are read at send time; the file may change
+  if (reply.letter.file_range) { return; }
+  // a transient failure must not be replayed for the whole ttl
+  const uint32_t status = reply.letter.header.meta();
+  if (status < 200 || status >= 300) { return; }
+  const uint64_t bytes =
+    sizeof(entry) + request.size() + reply.letter.in_memory_size();
+  if (bytes > args_.max_bytes / kMaxEntryFraction) { return; }
+  const auto k = rpc_request_key::make(req, request);
+  cache_.put(k, entry{std::move(request), reply.share(), now + ttl}, bytes);
+}
+
+}  // namespace smf
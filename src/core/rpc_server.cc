@@ -4,17 +4,26 @@
 
 // seastar
 #include <seastar/core/execution_stage.hh>
+#include <seastar/core/future-util.hh>
 #include <seastar/core/metrics.hh>
 #include <seastar/core/prometheus.hh>
+#include <seastar/core/sleep.hh>
 #include <seastar/core/with_timeout.hh>
+#include <seastar/http/function_handlers.hh>
 
 #include "smf/histogram_seastar_utils.h"
 #include "smf/log.h"
 #include "smf/rpc_connection_limits.h"
 #include "smf/rpc_envelope.h"
 #include "smf/rpc_header_ostream.h"
+#include "smf/rpc_header_utils.h"
+#include "smf/rpc_typed_envelope.h"
 
+#include <arpa/inet.h>
+
+#include <numeric>
 #include <optional>
+#include <vector>
 #include <seastar/net/tls.hh>
 
 namespace smf {
@@ -34,8 +43,16 @@ operator<<(std::ostream &o, const smf::rpc_server &s) {
 rpc_server::rpc_server(rpc_server_args args)
   : args_(args), limits_(seastar::make_lw_shared<rpc_connection_limits>(
                    args.memory_avail_per_core, args.recv_timeout)),
-    creds_(args_.credentials) {
+    codel_(args.codel), response_cache_(args.response_cache),
+    forward_requests_(seastar::smp::count),
+    forward_replies_(seastar::smp::count),
+    shard_loads_(seastar::smp::count), creds_(args_.credentials) {
+  const uint32_t alignment = args_.payload_alignment;
+  LOG_THROW_IF((alignment & (alignment - 1)) != 0,
+               "payload_alignment must be a power of 2, got: {}", alignment);
+  limits_->max_header_parsing_duration = args_.header_timeout;
   namespace sm = seastar::metrics;
+  auto reason = sm::label("reason");
   metrics_.add_group(
     "smf::rpc_server",
     {
@@ -63,6 +80,112 @@ rpc_server::rpc_server(rpc_server_args args)
       sm::make_histogram("handler_dispatch_latency",
                          sm::description("Server handler dispatch latency"),
                          [this] { return hist_->seastar_histogram_logform(); }),
+      sm::make_derive(
+        "error_replies", stats_->error_replies,
+        sm::description("Requests answered with an rpc::error_reply")),
+      sm::make_derive("verified_requests", stats_->verified_requests,
+                      sm::description("Requests verified before dispatch")),
+      sm::make_derive(
+        "failed_verification_requests", stats_->failed_verification_requests,
+        sm::description("Requests that failed flatbuffers verification")),
+      sm::make_histogram(
+        "payload_verification_latency",
+        sm::description("Request flatbuffers verification latency"),
+        [this] { return verify_hist_->seastar_histogram_logform(); }),
+      sm::make_derive(
+        "overloaded_requests", stats_->overloaded_requests,
+        sm::description("Requests rejected by queueing delay admission")),
+      sm::make_derive(
+        "response_cache_hits", [this] { return response_cache_.hits(); },
+        sm::description("Requests answered from the response cache")),
+      sm::make_derive(
+        "response_cache_misses", [this] { return response_cache_.misses(); },
+        sm::description("Cacheable requests that ran their handler")),
+      sm::make_gauge("response_cache_bytes",
+                     [this] { return response_cache_.bytes(); },
+                     sm::description("Requests & replies held in the cache")),
+      sm::make_derive(
+        "coalesced_requests", [this] { return coalescer_.coalesced(); },
+        sm::description("Requests that shared an identical one's reply")),
+      sm::make_gauge("coalescing_requests",
+                     [this] { return coalescer_.inflight(); },
+                     sm::description("Handler runs other requests may join")),
+      sm::make_derive(
+        "batches",
+        [this] { return batch_stat(&rpc_request_batcher::batches); },
+        sm::description("Calls of batched handlers")),
+      sm::make_derive(
+        "batched_requests",
+        [this] { return batch_stat(&rpc_request_batcher::batched_requests); },
+        sm::description("Requests run by batched handlers")),
+      sm::make_derive(
+        "full_batches",
+        [this] { return batch_stat(&rpc_request_batcher::full_batches); },
+        sm::description("Batches that ran full, before their wait was up")),
+      sm::make_gauge(
+        "offload_queued",
+        [this] { return offload_stat(&rpc_handler_offload::queued); },
+        sm::description("Requests waiting for a handler thread")),
+      sm::make_gauge(
+        "offload_running",
+        [this] { return offload_stat(&rpc_handler_offload::running); },
+        sm::description("Handlers running in their own thread")),
+      sm::make_histogram(
+        "offload_wait_latency",
+        sm::description("Time requests waited for a handler thread"),
+        [this] { return offload_wait_hist_->seastar_histogram_logform(); }),
+      sm::make_gauge("codel_overloaded",
+                     [this] { return codel_.overloaded() ? 1 : 0; },
+                     sm::description("1 while shedding load, 0 otherwise")),
+      sm::make_gauge(
+        "codel_min_sojourn_us",
+        [this] {
+          return std::chrono::duration_cast<std::chrono::microseconds>(
+                   codel_.last_min_sojourn())
+            .count();
+        },
+        sm::description("Minimum queueing delay of the last interval")),
+      sm::make_derive(
+        "forwarded_requests", stats_->forwarded_requests,
+        sm::description("Requests forwarded to the core owning their key")),
+      sm::make_derive(
+        "forwarded_batches", stats_->forwarded_batches,
+        sm::description("smp messages carrying forwarded requests")),
+      sm::make_derive(
+        "rebalanced_requests", stats_->rebalanced_requests,
+        sm::description("Requests moved off this core while overloaded")),
+      sm::make_derive(
+        "goaway_connections", stats_->goaway_connections,
+        sm::description("Connections sent a GOAWAY while draining")),
+      sm::make_derive("evicted_connections",
+                      stats_->idle_connections_evicted,
+                      sm::description("Connections closed by the server"),
+                      {reason("idle")}),
+      sm::make_derive("evicted_connections",
+                      stats_->slow_reader_connections_evicted,
+                      sm::description("Connections closed by the server"),
+                      {reason("slow_reader")}),
+      sm::make_derive(
+        "rejected_connections", stats_->rejected_connections,
+        sm::description("Connections closed on accept, over the limit")),
+      sm::make_derive("evicted_connections", stats_->slow_header_connections,
+                      sm::description("Connections closed by the server"),
+                      {reason("slow_header")}),
+      sm::make_derive("evicted_connections", stats_->slow_body_connections,
+                      sm::description("Connections closed by the server"),
+                      {reason("slow_body")}),
+      sm::make_gauge(
+        "shard_load",
+        [this] { return local_load().load; },
+        sm::description("Average handlers in flight, last interval")),
+      sm::make_gauge(
+        "shard_request_rate",
+        [this] { return local_load().request_rate; },
+        sm::description("Handlers started per second, last interval")),
+      sm::make_histogram(
+        "request_sojourn_latency",
+        sm::description("Time from header parse to dispatch"),
+        [this] { return sojourn_hist_->seastar_histogram_logform(); }),
     });
 }
 
@@ -87,6 +210,18 @@ rpc_server::start() {
     conf.metric_help = "smf rpc server statistics";
     conf.prefix = "smf";
     // start on background co-routine
+    admin_->_routes.put(
+      seastar::httpd::operation_type::GET, "/v1/shards",
+      new seastar::httpd::function_handler(
+        [this](std::unique_ptr<seastar::httpd::request> req,
+               std::unique_ptr<seastar::httpd::reply> rep) {
+          return collect_loads().then([this, rep = std::move(rep)]() mutable {
+            rep->_content = shard_loads_json();
+            return seastar::make_ready_future<
+              std::unique_ptr<seastar::httpd::reply>>(std::move(rep));
+          });
+        },
+        "json"));
     (void)seastar::prometheus::add_prometheus_routes(*admin_, conf)
       .then([http_port = args_.http_port, admin = admin_, ip = args_.ip]() {
         return admin
@@ -99,6 +234,22 @@ rpc_server::start() {
           });
       });
   }
+  last_sample_ = std::chrono::steady_clock::now();
+  if (args_.rebalance.enabled) {
+    load_timer_.set_callback([this] { publish_load(); });
+    load_timer_.arm_periodic(args_.rebalance.interval);
+  }
+  using duration_t = seastar::timer<>::duration;
+  duration_t reap_period = duration_t::max();
+  for (auto d : {args_.idle_timeout, args_.slow_reader_timeout}) {
+    if (d > duration_t::zero()) { reap_period = std::min(reap_period, d); }
+  }
+  if (reap_period != duration_t::max()) {
+    // evicts at most a quarter of a timeout late
+    reap_timer_.set_callback([this] { reap_connections(); });
+    reap_timer_.arm_periodic(std::max<duration_t>(
+      reap_period / 4, std::chrono::milliseconds(10)));
+  }
   LOG_INFO("Starting rpc server");
   seastar::listen_options lo;
   lo.reuse_address = true;
@@ -122,9 +273,31 @@ rpc_server::start() {
   (void)seastar::keep_doing([this] {
     return listener_->accept().then([this, stats = stats_, limits = limits_](
                                       seastar::accept_result result) mutable {
+      if (args_.max_connections_per_core > 0 &&
+          open_connections_.size() >= args_.max_connections_per_core) {
+        stats->rejected_connections++;
+        LOG_WARN("Rejecting connection from {}: {} connections open",
+                 result.remote_address, open_connections_.size());
+        try {
+          result.connection.shutdown_input();
+          result.connection.shutdown_output();
+        } catch (...) {}
+        return;
+      }
       auto conn = seastar::make_lw_shared<rpc_server_connection>(
         std::move(result.connection), limits, result.remote_address, stats,
         ++connection_idx_);
+      conn->conn.allow_unchecked_payloads = !!creds_;
+      if (args_.memory_avail_per_connection > 0) {
+        conn->memory.emplace(args_.memory_avail_per_connection);
+      }
+      // per ip tenants only when asked for; each one is a metric group
+      if (args_.tenant_id || args_.memory_avail_per_tenant > 0) {
+        conn->tenant = limits->admission.attach(
+          tenant_id(result.remote_address), args_.memory_avail_per_tenant);
+      } else {
+        conn->tenant = limits->admission.attach_default();
+      }
 
       open_connections_.insert({connection_idx_, conn});
 
@@ -152,6 +325,8 @@ rpc_server::start() {
 seastar::future<>
 rpc_server::stop() {
   LOG_INFO("Stopped seastar::accept() calls");
+  load_timer_.cancel();
+  reap_timer_.cancel();
   listener_->abort_accept();
   return stopped_.get_future().then([this] {
     std::for_each(
@@ -173,6 +348,70 @@ rpc_server::stop() {
   });
 }
 
+void
+rpc_server::reap_connections() {
+  using duration_t = seastar::timer<>::duration;
+  const auto now = seastar::lowres_clock::now();
+  std::vector<std::pair<seastar::lw_shared_ptr<rpc_server_connection>, bool>>
+    victims;
+  for (auto &[id, conn] : open_connections_) {
+    if (args_.slow_reader_timeout > duration_t::zero() &&
+        conn->pending_replies > 0 &&
+        now - conn->last_flush > args_.slow_reader_timeout) {
+      victims.emplace_back(conn, false);
+    } else if (args_.idle_timeout > duration_t::zero() &&
+               conn->inflight_requests == 0 && conn->pending_replies == 0 &&
+               now - conn->last_request > args_.idle_timeout) {
+      victims.emplace_back(conn, true);
+    }
+  }
+  for (auto &[conn, idle] : victims) {
+    if (idle) {
+      stats_->idle_connections_evicted++;
+      evict(conn, "Idle connection");
+    } else {
+      stats_->slow_reader_connections_evicted++;
+      evict(conn, "Client is not reading replies");
+    }
+  }
+}
+
+void
+rpc_server::evict(seastar::lw_shared_ptr<rpc_server_connection> conn,
+                  seastar::sstring reason) {
+  LOG_INFO("Evicting connection: remote:{}: {}", conn->conn.remote_address,
+           reason);
+  open_connections_.erase(conn->id);
+  // cleanup_dispatch_rpc() skips connections no longer open
+  conn->set_error(std::move(reason));
+  try {
+    conn->conn.disable();
+    conn->conn.socket.shutdown_input();
+    conn->conn.socket.shutdown_output();
+  } catch (...) {}
+}
+
+seastar::future<>
+rpc_server::drain(seastar::timer<>::duration grace) {
+  if (draining_) { return seastar::make_ready_future<>(); }
+  draining_ = true;
+  LOG_INFO("Draining {} connections", open_connections_.size());
+  listener_->abort_accept();
+  for (auto &p : open_connections_) {
+    stats_->goaway_connections++;
+    (void)seastar::with_gate(reply_gate_,
+                             [conn = p.second] { return send_goaway(conn); });
+  }
+  // connections leave open_connections_ once the client closes them
+  const auto deadline = seastar::timer<>::clock::now() + grace;
+  return seastar::do_until(
+    [this, deadline] {
+      return open_connections_.empty() ||
+             seastar::timer<>::clock::now() >= deadline;
+    },
+    [] { return seastar::sleep(std::chrono::milliseconds(10)); });
+}
+
 // NOTE!!
 // Before you refactor this method, please note that parsing the body *MUST*
 // come *right* after parsing the header in the same continuation chain.
@@ -182,31 +421,63 @@ seastar::future<>
 rpc_server::handle_one_client_session(
   seastar::lw_shared_ptr<rpc_server_connection> conn) {
   return rpc_recv_context::parse_header(&conn->conn)
+    .handle_exception_type([conn](seastar::timed_out_error &) {
+      conn->stats->slow_header_connections++;
+      conn->set_error("Request header arrived too slowly");
+      return std::optional<rpc::header>();
+    })
     .then([this, conn](std::optional<rpc::header> hdr) {
       if (!hdr) {
-        conn->set_error("Error parsing connection header");
+        if (!conn->has_error()) {
+          conn->set_error("Error parsing connection header");
+        }
         return seastar::make_ready_future<>();
       }
+      auto payload_size = hdr->size();
       auto timeout_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-                          conn->limits()->max_body_parsing_duration)
+                          body_timeout(payload_size))
                           .count();
-      auto payload_size = hdr->size();
-      return conn->limits()
-        ->resources_available.wait(payload_size)
-        .then([conn, h = hdr.value(), timeout_ms] {
+      const auto arrival = rpc_codel::clock::now();
+      conn->last_request = seastar::lowres_clock::now();
+      // the request id is in the header; pick the buffer before reading
+      uint32_t alignment = args_.payload_alignment;
+      auto handle = routes_.get_handle_for_request(hdr->meta());
+      if (handle != nullptr && handle->options.payload_alignment != 0) {
+        alignment = handle->options.payload_alignment;
+      }
+      return wait_for_memory(conn, payload_size)
+        .then([conn, h = hdr.value(), timeout_ms, alignment] {
           auto timeout = seastar::timer<>::clock::now() +
                          std::chrono::milliseconds(timeout_ms);
-          return seastar::with_timeout(timeout, rpc_recv_context::parse_payload(
-                                                  &conn->conn, std::move(h)));
+          return seastar::with_timeout(
+                   timeout, rpc_recv_context::parse_payload(
+                              &conn->conn, std::move(h), alignment))
+            .handle_exception_type([conn](seastar::timed_out_error &) {
+              // dispatch_rpc() releases the memory & closes the connection
+              conn->stats->slow_body_connections++;
+              return std::optional<rpc_recv_context>();
+            });
         })
-        .then([this, conn, payload_size](auto maybe_payload) {
+        .then([this, conn, payload_size, arrival](auto maybe_payload) {
           // Launch the actual processing on a background
-          (void)dispatch_rpc(payload_size, conn, std::move(maybe_payload));
+          (void)dispatch_rpc(payload_size, conn, arrival,
+                             std::move(maybe_payload));
           return seastar::make_ready_future<>();
         });
     });
 }
 
+seastar::timer<>::duration
+rpc_server::body_timeout(uint64_t payload_size) const {
+  auto timeout = limits_->max_body_parsing_duration;
+  if (args_.min_body_bytes_per_sec == 0) { return timeout; }
+  // slack for round trips & small payloads
+  auto at_min_rate = std::chrono::seconds(1) +
+                     std::chrono::microseconds(
+                       payload_size * 1000000 / args_.min_body_bytes_per_sec);
+  return std::min<seastar::timer<>::duration>(timeout, at_min_rate);
+}
+
 seastar::future<>
 rpc_server::handle_client_connection(
   seastar::lw_shared_ptr<rpc_server_connection> conn) {
@@ -224,42 +495,65 @@ rpc_server::handle_client_connection(
 seastar::future<>
 rpc_server::dispatch_rpc(int32_t payload_size,
                          seastar::lw_shared_ptr<rpc_server_connection> conn,
+                         rpc_codel::clock::time_point arrival,
                          std::optional<rpc_recv_context> ctx) {
   if (!ctx) {
-    conn->limits()->resources_available.signal(payload_size);
+    release_memory(conn, payload_size);
     conn->set_error("Could not parse payload");
     return seastar::make_ready_future<>();
   }
 
+  conn->inflight_requests++;
+  // filters, handler & reply all run in the method's scheduling group
+  auto group =
+    scheduling_group_for(routes_.get_handle_for_request(ctx->request_id()));
   return seastar::with_gate(
     reply_gate_,
-    [this, conn, context = std::move(ctx.value()), payload_size]() mutable {
-      return do_dispatch_rpc(conn, std::move(context))
+    [this, conn, context = std::move(ctx.value()), payload_size, arrival,
+     group]() mutable {
+      return seastar::with_scheduling_group(
+               group,
+               [this, conn, arrival, context = std::move(context)]() mutable {
+                 return do_dispatch_rpc(conn, arrival, std::move(context));
+               })
         .then([this, conn] { return cleanup_dispatch_rpc(conn); })
-        .finally(
-          [m = hist_->auto_measure(), limits = conn->limits(), payload_size] {
-            // these limits are acquired *BEFORE* the call to dispatch_rpc()
-            // happens. Critical to understand memory ownership since it happens
-            // accross multiple futures.
-            limits->resources_available.signal(payload_size);
-          });
+        .finally([this, m = hist_->auto_measure(), conn, payload_size] {
+          // these limits are acquired *BEFORE* the call to dispatch_rpc()
+          // happens. Critical to understand memory ownership since it happens
+          // accross multiple futures.
+          release_memory(conn, payload_size);
+          conn->inflight_requests--;
+        });
     });
 }
 
 seastar::future<>
 rpc_server::do_dispatch_rpc(seastar::lw_shared_ptr<rpc_server_connection> conn,
+                            rpc_codel::clock::time_point arrival,
                             rpc_recv_context &&ctx) {
+  // request scoped failures get an rpc::error_reply; the framing is intact
+  // so the other requests on this connection are unaffected
   if (ctx.request_id() == 0) {
-    conn->set_error("Missing request_id. Invalid request");
-    return seastar::make_ready_future<>();
+    return reply_error(conn, ctx.header, 400,
+                       "Missing request_id. Invalid request");
   }
   auto method_dispatch = routes_.get_handle_for_request(ctx.request_id());
   if (method_dispatch == nullptr) {
     conn->stats->no_route_requests++;
-    conn->set_error("Can't find route for request. Invalid");
-    return seastar::make_ready_future<>();
+    return reply_error(
+      conn, ctx.header, 404,
+      fmt::format("Can't find route for request: {}", ctx.request_id()));
+  }
+  // before the filters: decompressing a request we then drop is wasted work
+  if (shed_request(arrival)) {
+    conn->stats->overloaded_requests++;
+    return reply_error(conn, ctx.header, rpc_codel::kOverloadedStatus,
+                       "Server overloaded. Retry later");
   }
   conn->stats->in_bytes += ctx.header.size() + ctx.payload.size();
+  // reply with the same checksum algorithm the client chose
+  const auto checksum = rpc_checksum_type(ctx.header);
+  const rpc::header request_header = ctx.header;
 
   /// the request follow [filters] -> handle -> [filters]
   /// the only way for the handle not to receive the information is if
@@ -267,39 +561,549 @@ rpc_server::do_dispatch_rpc(seastar::lw_shared_ptr<rpc_server_connection> conn,
   /// to it, or they throw an exception if they wish to interrupt the entire
   /// connection
   return stage_apply_incoming_filters(std::move(ctx))
-    .then([this, conn, method_dispatch](auto ctx) {
+    .then([this, conn, method_dispatch, checksum](auto ctx) {
       if (ctx.header.compression() !=
           rpc::compression_flags::compression_flags_none) {
-        conn->set_error(fmt::format("There was no decompression filter for "
-                                    "compression enum: {}",
-                                    ctx.header.compression()));
-        return seastar::make_ready_future<>();
+        return reply_error(conn, ctx.header, 415,
+                           fmt::format("There was no decompression filter for "
+                                       "compression enum: {}",
+                                       ctx.header.compression()));
+      }
+      // i.e.: decompression replaced the aligned payload
+      ctx.realign_payload();
+      // after the filters, so that i.e.: authentication still runs
+      seastar::temporary_buffer<char> cache_key;
+      const auto &opts = method_dispatch->options;
+      if (response_cache_.enabled() && opts.cache_ttl.count()) {
+        auto hit = response_cache_.get(ctx, rpc_response_cache::clock::now());
+        if (hit) {
+          hit->letter.header.mutate_session(ctx.session());
+          return send_reply(conn, std::move(*hit));
+        }
+        cache_key = seastar::temporary_buffer<char>(ctx.payload.get(),
+                                                    ctx.payload.size());
+      }
+      if (!verify_request(method_dispatch, ctx)) {
+        return reply_error(conn, ctx.header, 400,
+                           "Request failed flatbuffers verification");
       }
-      return method_dispatch->apply(std::move(ctx))
+      const rpc::header cache_header = ctx.header;
+      auto core = seastar::engine().cpu_id();
+      if (opts.shard_key != nullptr && seastar::smp::count > 1) {
+        auto key = opts.shard_key(ctx.payload.get(), ctx.payload.size());
+        if (!key) {
+          return reply_error(conn, ctx.header, 400,
+                             "Request shard key failed verification");
+        }
+        core = rpc_shard_for(*key);
+      } else if (args_.rebalance.enabled) {
+        core = rebalance_target();
+      }
+      auto execute = [this, method_dispatch, core](rpc_recv_context &&ctx) {
+        return core == seastar::engine().cpu_id()
+                 ? run_handler(method_dispatch, std::move(ctx))
+                 : forward_request(core, std::move(ctx));
+      };
+      auto reply = opts.coalesce
+                     ? coalescer_.run(std::move(ctx), std::move(execute))
+                     : execute(std::move(ctx));
+      return std::move(reply)
         .then([this](rpc_envelope e) {
           return stage_apply_outgoing_filters(std::move(e));
         })
-        .then([conn](rpc_envelope e) {
-          if (!conn->is_valid()) {
-            DLOG_INFO(
-              "Invalid client connection remote={} server_id={} Skipping "
-              "reply from server",
-              conn->conn.remote_address, conn->id);
-            return seastar::make_ready_future<>();
+        .then([this, conn, checksum, cache_header, method_dispatch,
+               cache_key = std::move(cache_key)](rpc_envelope e) mutable {
+          // generated handlers already serialize with it; this only
+          // costs a re-hash for raw handlers that did not
+          e.set_checksum_type(checksum);
+          if (cache_key.size() > 0) {
+            response_cache_.put(cache_header, std::move(cache_key), e,
+                                method_dispatch->options.cache_ttl,
+                                rpc_response_cache::clock::now());
           }
-          conn->stats->out_bytes += e.letter.size();
-          return seastar::with_semaphore(
-            conn->serialize_writes, 1, [conn, ee = std::move(e)]() mutable {
-              return smf::rpc_envelope::send(&conn->conn.ostream,
-                                             std::move(ee));
-            });
+          return send_reply(conn, std::move(e));
         });
     })
-    .then([conn] {
-      if (conn->is_valid()) { return conn->conn.ostream.flush(); }
-      return seastar::make_ready_future<>();
+    .handle_exception([this, conn, request_header](std::exception_ptr ep) {
+      try {
+        std::rethrow_exception(ep);
+      } catch (const rpc_payload_too_large &e) {
+        conn->stats->too_large_requests++;
+        return reply_error(conn, request_header, 413, e.what());
+      } catch (const std::exception &e) {
+        // i.e.: the handler, a filter or a forwarded call failed
+        return reply_error(conn, request_header, 500, e.what());
+      } catch (...) {}
+      return reply_error(conn, request_header, 500, "Unknown error");
+    });
+}
+
+seastar::future<>
+rpc_server::send_reply(seastar::lw_shared_ptr<rpc_server_connection> conn,
+                       rpc_envelope e) {
+  if (!conn->is_valid()) {
+    DLOG_INFO("Invalid client connection remote={} server_id={} Skipping "
+              "reply from server",
+              conn->conn.remote_address, conn->id);
+    return seastar::make_ready_future<>();
+  }
+  conn->stats->out_bytes += e.letter.size();
+  // replies count against the core budget until they are flushed. Never
+  // waits - the reply is already in memory - so new requests wait instead
+  auto reserved =
+    rpc_memory_reservation::consume(conn->limits(), e.letter.in_memory_size());
+  if (conn->pending_replies++ == 0) {
+    conn->last_flush = seastar::lowres_clock::now();
+  }
+  return seastar::with_semaphore(
+           conn->serialize_writes, 1,
+           [conn, ee = std::move(e)]() mutable {
+             return smf::rpc_envelope::send(&conn->conn.ostream, std::move(ee),
+                                            conn->limits().get());
+           })
+    .then([conn] { return flush_replies(conn); })
+    .finally([conn, reserved = std::move(reserved)] {
+      conn->pending_replies--;
+      conn->last_flush = seastar::lowres_clock::now();
+    });
+}
+
+seastar::future<>
+rpc_server::flush_replies(seastar::lw_shared_ptr<rpc_server_connection> conn) {
+  if (conn->is_valid()) { return conn->conn.ostream.flush(); }
+  return seastar::make_ready_future<>();
+}
+
+seastar::future<>
+rpc_server::reply_error(seastar::lw_shared_ptr<rpc_server_connection> conn,
+                        const rpc::header &req, uint32_t status,
+                        seastar::sstring reason) {
+  LOG_INFO("Replying {} to remote:{}: {}", status, conn->conn.remote_address,
+           reason);
+  conn->stats->error_replies++;
+  rpc_typed_envelope<rpc::error_reply> err;
+  err.data->reason = std::move(reason);
+  err.envelope.set_checksum_type(rpc_checksum_type(req));
+  err.envelope.set_status(status);
+  rpc_envelope e = err.serialize_data();
+  e.letter.header.mutate_session(req.session());
+  rpc_set_error_reply(e.letter.header);
+  return send_reply(conn, std::move(e));
+}
+seastar::future<>
+rpc_server::send_goaway(seastar::lw_shared_ptr<rpc_server_connection> conn) {
+  rpc_typed_envelope<rpc::error_reply> err;
+  err.data->reason = "Server is draining. Reconnect";
+  err.envelope.set_status(503);
+  rpc_envelope e = err.serialize_data();
+  rpc_set_goaway(e.letter.header);
+  return send_reply(conn, std::move(e));
+}
+
+seastar::future<>
+rpc_server::wait_for_memory(seastar::lw_shared_ptr<rpc_server_connection> conn,
+                            uint64_t bytes) {
+  auto admit = [conn, bytes] {
+    return conn->limits()->admission.wait(conn->tenant.get(), bytes);
+  };
+  if (!conn->memory) { return admit(); }
+  // a payload larger than the connection limit still goes through, alone
+  const uint64_t units =
+    std::min<uint64_t>(bytes, args_.memory_avail_per_connection);
+  return conn->memory->wait(units).then(std::move(admit));
+}
+
+void
+rpc_server::release_memory(seastar::lw_shared_ptr<rpc_server_connection> conn,
+                           uint64_t bytes) {
+  if (conn->memory) {
+    conn->memory->signal(
+      std::min<uint64_t>(bytes, args_.memory_avail_per_connection));
+  }
+  conn->limits()->admission.signal(conn->tenant.get(), bytes);
+}
+
+seastar::sstring
+rpc_server::tenant_id(const seastar::socket_address &addr) const {
+  if (args_.tenant_id) { return args_.tenant_id(addr); }
+  char buf[INET_ADDRSTRLEN];
+  if (::inet_ntop(AF_INET, &addr.u.in.sin_addr, buf, sizeof(buf)) ==
+      nullptr) {
+    return "unknown";
+  }
+  return seastar::sstring(buf);
+}
+
+bool
+rpc_server::verify_request(const rpc_service_method_handle *h,
+                           const rpc_recv_context &ctx) {
+  auto policy = h->options.verification;
+  if (policy == rpc_verification_policy::inherit) {
+    policy = args_.verification;
+  }
+  if (policy == rpc_verification_policy::none ||
+      h->options.verify == nullptr) {
+    return true;
+  }
+  auto m = verify_hist_->auto_measure();
+  stats_->verified_requests++;
+  if (!h->options.verify(ctx.payload.get(), ctx.payload.size(), policy,
+                         args_.verification_limits)) {
+    stats_->failed_verification_requests++;
+    LOG_ERROR("Request `{}` failed flatbuffers verification from: {}",
+              ctx.request_id(), ctx.remote_address);
+    return false;
+  }
+  return true;
+}
+
+seastar::future<rpc_envelope>
+rpc_server::run_handler(rpc_service_method_handle *h, rpc_recv_context &&ctx) {
+  ++interval_requests_;
+  const auto begin = std::chrono::steady_clock::now();
+  auto f = [this, h, &ctx] {
+    if (h->options.batch_size > 0) {
+      return batcher_for(h).enqueue(std::move(ctx));
+    }
+    if (h->options.offload_concurrency > 0) {
+      return offload_for(h).run(std::move(ctx));
+    }
+    return h->apply(std::move(ctx));
+  }();
+  // every path counts towards the load, or rebalancing favors cores busy
+  // with batched & offloaded methods
+  return std::move(f).finally([this, begin] {
+    interval_busy_ += std::chrono::steady_clock::now() - begin;
+  });
+}
+
+rpc_request_batcher &
+rpc_server::batcher_for(rpc_service_method_handle *h) {
+  auto it = batchers_.find(h);
+  if (it == batchers_.end()) {
+    it = batchers_
+           .emplace(h, std::make_unique<rpc_request_batcher>(
+                         h, scheduling_group_for(h)))
+           .first;
+  }
+  return *it->second;
+}
+
+rpc_handler_offload &
+rpc_server::offload_for(rpc_service_method_handle *h) {
+  auto it = offloads_.find(h);
+  if (it == offloads_.end()) {
+    it = offloads_
+           .emplace(h, std::make_unique<rpc_handler_offload>(
+                         h, scheduling_group_for(h), offload_wait_hist_))
+           .first;
+  }
+  return *it->second;
+}
+
+uint64_t
+rpc_server::offload_stat(uint64_t (rpc_handler_offload::*stat)() const) const {
+  uint64_t ret = 0;
+  for (const auto &[h, o] : offloads_) { ret += ((*o).*stat)(); }
+  return ret;
+}
+
+uint64_t
+rpc_server::batch_stat(uint64_t (rpc_request_batcher::*stat)() const) const {
+  uint64_t ret = 0;
+  for (const auto &[h, b] : batchers_) { ret += ((*b).*stat)(); }
+  return ret;
+}
+
+uint32_t
+rpc_server::rebalance_target() {
+  const uint32_t self = seastar::engine().cpu_id();
+  uint32_t target = self;
+  for (uint32_t i = 0; i < shard_loads_.size(); ++i) {
+    if (shard_loads_[i].load < shard_loads_[target].load) { target = i; }
+  }
+  if (shard_loads_[self].load <=
+      args_.rebalance.imbalance * (shard_loads_[target].load + 1)) {
+    return self;
+  }
+  // until the target publishes again, so that every overloaded core does
+  // not pile onto the same one
+  shard_loads_[target].load += 1;
+  shard_loads_[self].load = std::max(0.0, shard_loads_[self].load - 1);
+  stats_->rebalanced_requests++;
+  return target;
+}
+
+rpc_shard_load
+rpc_server::sample_load() {
+  using namespace std::chrono;  // NOLINT
+  const auto now = steady_clock::now();
+  const double secs =
+    duration_cast<duration<double>>(now - last_sample_).count();
+  const double busy = duration_cast<duration<double>>(interval_busy_).count();
+  const uint32_t self = seastar::engine().cpu_id();
+  auto &l = shard_loads_[self];
+  l.connections = stats_->active_connections;
+  if (secs > 0) {
+    l.request_rate = interval_requests_ / secs;
+    // smoothed, a single interval is noisy
+    l.load = (l.load + busy / secs) / 2;
+  }
+  interval_requests_ = 0;
+  interval_busy_ = steady_clock::duration(0);
+  last_sample_ = now;
+  return l;
+}
+
+const rpc_shard_load &
+rpc_server::local_load() {
+  // without rebalancing nothing samples in the background
+  if (!args_.rebalance.enabled &&
+      std::chrono::steady_clock::now() - last_sample_ >= kMinLoadSample) {
+    sample_load();
+  }
+  return shard_loads_[seastar::engine().cpu_id()];
+}
+
+seastar::future<>
+rpc_server::collect_loads() {
+  // the timer keeps every core's copy up to date
+  if (args_.rebalance.enabled) { return seastar::make_ready_future<>(); }
+  std::vector<uint32_t> cores(seastar::smp::count);
+  std::iota(cores.begin(), cores.end(), 0);
+  return seastar::do_with(std::move(cores), [this](auto &cores) {
+    return seastar::parallel_for_each(cores, [this](uint32_t core) {
+      return container()
+        .invoke_on(core, [](rpc_server &s) { return s.local_load(); })
+        .then([this, core](rpc_shard_load l) { shard_loads_[core] = l; });
+    });
+  });
+}
+
+void
+rpc_server::publish_load() {
+  const uint32_t self = seastar::engine().cpu_id();
+  const rpc_shard_load l = sample_load();
+  if (reply_gate_.is_closed()) { return; }
+  (void)seastar::with_gate(reply_gate_, [this, self, l] {
+    return container().invoke_on_all(
+      [self, l](rpc_server &s) { s.shard_loads_[self] = l; });
+  });
+}
+
+seastar::sstring
+rpc_server::shard_loads_json() const {
+  fmt::memory_buffer out;
+  fmt::format_to(out, "[");
+  for (uint32_t i = 0; i < shard_loads_.size(); ++i) {
+    const auto &l = shard_loads_[i];
+    fmt::format_to(out,
+                   "{}{{\"shard\":{},\"connections\":{},"
+                   "\"request_rate\":{:.2f},\"load\":{:.2f}}}",
+                   i == 0 ? "" : ",", i, l.connections, l.request_rate,
+                   l.load);
+  }
+  fmt::format_to(out, "]");
+  return seastar::sstring(out.data(), out.size());
+}
+
+seastar::future<rpc_envelope>
+rpc_server::forward_request(uint32_t core, rpc_recv_context &&ctx) {
+  const uint64_t id = ++forward_seq_;
+  auto &batch = forward_requests_[core];
+  // i.e.: decompression resized the payload
+  ctx.header.mutate_size(ctx.payload.size());
+  batch.push_back(rpc_forwarded_request{
+    id, ctx.header,
+    seastar::make_foreign(std::make_unique<seastar::temporary_buffer<char>>(
+      std::move(ctx.payload))),
+    ctx.remote_address});
+  if (batch.size() == 1) {
+    if (reply_gate_.is_closed()) {
+      (void)flush_forwarded_requests(core);
+    } else {
+      // everything dispatched until the next poll shares one smp message
+      (void)seastar::with_gate(reply_gate_, [this, core] {
+        return seastar::later().then(
+          [this, core] { return flush_forwarded_requests(core); });
+      });
+    }
+  }
+  auto it = forwarded_
+              .emplace(std::piecewise_construct, std::forward_as_tuple(id),
+                       std::forward_as_tuple(std::move(ctx)))
+              .first;
+  stats_->forwarded_requests++;
+  return it->second.pr.get_future();
+}
+
+seastar::future<>
+rpc_server::flush_forwarded_requests(uint32_t core) {
+  auto &batch = forward_requests_[core];
+  if (batch.empty()) { return seastar::make_ready_future<>(); }
+  stats_->forwarded_batches++;
+  std::vector<uint64_t> ids;
+  ids.reserve(batch.size());
+  for (auto &r : batch) { ids.push_back(r.id); }
+  auto f = container().invoke_on(
+    core, [origin = seastar::engine().cpu_id(),
+           b = std::move(batch)](rpc_server &s) mutable {
+      s.run_forwarded(origin, std::move(b));
+    });
+  batch.clear();
+  return f.handle_exception([this, ids = std::move(ids)](auto ep) {
+    LOG_ERROR("Could not forward requests: {}", ep);
+    fail_forwarded(ids, ep);
+  });
+}
+
+void
+rpc_server::fail_forwarded(const std::vector<uint64_t> &ids,
+                           std::exception_ptr ep) {
+  for (auto id : ids) {
+    auto it = forwarded_.find(id);
+    if (it == forwarded_.end()) { continue; }
+    auto pr = std::move(it->second.pr);
+    forwarded_.erase(it);
+    pr.set_exception(ep);
+  }
+}
+
+void
+rpc_server::run_forwarded(uint32_t origin,
+                          std::vector<rpc_forwarded_request> batch) {
+  for (auto &r : batch) {
+    auto h = routes_.get_handle_for_request(r.header.meta());
+    // a view; dropping it frees the payload on the origin core
+    char *data = r.payload->get_write();
+    const size_t size = r.payload->size();
+    auto view = seastar::temporary_buffer<char>(
+      data, size, seastar::make_object_deleter(std::move(r.payload)));
+    rpc_recv_context ctx(limits_, r.remote_address, r.header,
+                         std::move(view));
+    const uint64_t id = r.id;
+    if (reply_gate_.is_closed()) {
+      (void)reply_forwarded(origin, id,
+                            seastar::make_exception_future<rpc_envelope>(
+                              std::runtime_error("Server is stopping")));
+      continue;
+    }
+    // held until the reply batch is sent; the origin is still waiting
+    (void)seastar::with_gate(
+      reply_gate_, [this, h, origin, id, ctx = std::move(ctx)]() mutable {
+        if (h == nullptr) {
+          return reply_forwarded(
+            origin, id,
+            seastar::make_exception_future<rpc_envelope>(std::runtime_error(
+              fmt::format("No route for forwarded request: {}",
+                          ctx.request_id()))));
+        }
+        return seastar::with_scheduling_group(
+                 scheduling_group_for(h),
+                 [this, h, ctx = std::move(ctx)]() mutable {
+                   return run_handler(h, std::move(ctx));
+                 })
+          .then_wrapped([this, origin, id](auto f) {
+            return reply_forwarded(origin, id, std::move(f));
+          });
+      });
+  }
+}
+
+seastar::future<>
+rpc_server::reply_forwarded(uint32_t origin, uint64_t id,
+                            seastar::future<rpc_envelope> f) {
+  rpc_forwarded_reply r{id, {}, {}, nullptr};
+  try {
+    auto e = f.get0();
+    if (!e.letter.fragments.empty()) {
+      // fragments are checksummed at send time; the body is not
+      e.letter.linearize();
+      e.update_checksum();
+    }
+    // a plain copy, so the origin core can free it
+    r.header = e.letter.header;
+    r.body = seastar::temporary_buffer<char>(e.letter.body.size());
+    std::copy_n(e.letter.body.get(), e.letter.body.size(),
+                r.body.get_write());
+  } catch (...) { r.error = std::current_exception(); }
+  auto &batch = forward_replies_[origin];
+  batch.push_back(std::move(r));
+  if (batch.size() > 1) { return seastar::make_ready_future<>(); }
+  if (reply_gate_.is_closed()) { return flush_forwarded_replies(origin); }
+  return seastar::later().then(
+    [this, origin] { return flush_forwarded_replies(origin); });
+}
+
+seastar::future<>
+rpc_server::flush_forwarded_replies(uint32_t core) {
+  auto &batch = forward_replies_[core];
+  if (batch.empty()) { return seastar::make_ready_future<>(); }
+  std::vector<uint64_t> ids;
+  ids.reserve(batch.size());
+  for (auto &r : batch) { ids.push_back(r.id); }
+  auto f = container().invoke_on(
+    core, [b = std::move(batch)](rpc_server &s) mutable {
+      s.complete_forwarded(std::move(b));
     });
+  batch.clear();
+  return f.handle_exception([this, core, ids = std::move(ids)](auto ep) {
+    LOG_ERROR("Could not return forwarded replies: {}", ep);
+    // the origin is still waiting on them; without a message they never
+    // complete and stop() waits forever
+    return container()
+      .invoke_on(core,
+                 [ids = std::move(ids), ep](rpc_server &s) {
+                   s.fail_forwarded(ids, ep);
+                 })
+      .handle_exception([](auto ep) {
+        LOG_ERROR("Could not fail forwarded requests: {}", ep);
+      });
+  });
+}
+
+void
+rpc_server::complete_forwarded(std::vector<rpc_forwarded_reply> batch) {
+  for (auto &r : batch) {
+    auto it = forwarded_.find(r.id);
+    if (it == forwarded_.end()) { continue; }
+    auto pr = std::move(it->second.pr);
+    forwarded_.erase(it);
+    if (r.error) {
+      pr.set_exception(r.error);
+      continue;
+    }
+    rpc_envelope e;
+    e.letter.header = r.header;
+    e.letter.body = std::move(r.body);
+    pr.set_value(std::move(e));
+  }
 }
+
+seastar::scheduling_group
+rpc_server::scheduling_group_for(const rpc_service_method_handle *h) const {
+  if (h == nullptr || h->options.priority == nullptr) {
+    return default_group_;
+  }
+  for (const auto &c : args_.priority_classes) {
+    if (c.name == h->options.priority) { return c.group; }
+  }
+  return default_group_;
+}
+
+bool
+rpc_server::shed_request(rpc_codel::clock::time_point arrival) {
+  const auto now = rpc_codel::clock::now();
+  const auto sojourn = now - arrival;
+  sojourn_hist_->record(
+    std::chrono::duration_cast<std::chrono::microseconds>(sojourn).count());
+  const bool reject = codel_.should_reject(sojourn, now);
+  // serve the freshest requests first while there is a standing queue
+  limits_->admission.set_lifo(args_.codel.lifo_when_overloaded &&
+                              codel_.overloaded());
+  return reject;
+}
+
 seastar::future<>
 rpc_server::cleanup_dispatch_rpc(
   seastar::lw_shared_ptr<rpc_server_connection> conn) {
@@ -344,10 +1148,25 @@ rpc_server::apply_outgoing_filters(rpc_envelope e) {
 
 seastar::future<rpc_recv_context>
 rpc_server::stage_apply_incoming_filters(rpc_recv_context ctx) {
+  // no point in a SEDA hop through an empty stage
+  if (in_filters_.empty()) {
+    return seastar::make_ready_future<rpc_recv_context>(std::move(ctx));
+  }
+  // the stage runs its batches in the group it was created in; prioritized
+  // requests apply the filters inline to stay in their own group
+  if (seastar::current_scheduling_group() != default_group_) {
+    return apply_incoming_filters(std::move(ctx));
+  }
   return incoming_stage(this, std::move(ctx));
 }
 seastar::future<rpc_envelope>
 rpc_server::stage_apply_outgoing_filters(rpc_envelope e) {
+  if (out_filters_.empty()) {
+    return seastar::make_ready_future<rpc_envelope>(std::move(e));
+  }
+  if (seastar::current_scheduling_group() != default_group_) {
+    return apply_outgoing_filters(std::move(e));
+  }
   return outgoing_stage(this, std::move(e));
 }
 }  // namespace smf
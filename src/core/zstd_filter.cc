@@ -20,10 +20,16 @@ zstd_compression_filter::operator()(rpc_envelope &&e) {
       rpc::compression_flags::compression_flags_none) {
     return seastar::make_ready_future<rpc_envelope>(std::move(e));
   }
-  if (e.letter.body.size() <= min_compression_size) {
+  if (e.letter.payload_size() <= min_compression_size) {
+    return seastar::make_ready_future<rpc_envelope>(std::move(e));
+  }
+  // file backed payloads are streamed from disk as is
+  if (e.letter.file_range) {
     return seastar::make_ready_future<rpc_envelope>(std::move(e));
   }
 
+  // codecs need the payload contiguous
+  e.letter.linearize();
   e.letter.body = compressor->compress(e.letter.body);
   e.letter.header.mutate_compression(
     rpc::compression_flags::compression_flags_zstd);
@@ -36,6 +42,7 @@ seastar::future<rpc_recv_context>
 zstd_decompression_filter::operator()(rpc_recv_context &&ctx) {
   if (ctx.header.compression() ==
       rpc::compression_flags::compression_flags_zstd) {
+    ctx.reserve_uncompressed(*compressor);
     ctx.payload = compressor->uncompress(ctx.payload);
     ctx.header.mutate_compression(
       rpc::compression_flags::compression_flags_none);
@@ -0,0 +1,245 @@
+// Copyright 2019 SMF Authors
+//
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+#include "smf/macros.h"
+
+namespace smf {
+
+/// \brief byte bounded CLOCK-Pro cache: Jiang, Chen & Zhang, "CLOCK-Pro: an
+/// effective improvement of the CLOCK replacement", USENIX ATC 2005.
+///
+/// Entries sit on a single clock. Resident entries are hot or cold; cold
+/// entries that get evicted stay on the clock for a while as `test` entries,
+/// without their value. A cold entry that is referenced again while still
+/// resident, or put again while in its test period, becomes hot. Entries
+/// that are only ever seen once - a scan - stay cold and leave first, so
+/// they cannot flush the hot set like they would an LRU.
+///
+/// The share of the capacity for cold entries adapts, starting at a
+/// quarter: it grows on every test period hit and shrinks whenever a test
+/// entry expires.
+///
+/// Not thread safe; one per shard
+///
+template <typename Key, typename Value, typename Hash = std::hash<Key>,
+          typename KeyEqual = std::equal_to<Key>>
+class clock_pro_cache {
+ public:
+  explicit clock_pro_cache(uint64_t max_bytes)
+    : max_bytes_(max_bytes), cold_target_(max_bytes / 4) {}
+  SMF_DISALLOW_COPY_AND_ASSIGN(clock_pro_cache);
+
+  /// \brief nullptr unless resident. Marks the entry referenced
+  Value *
+  get(const Key &k) {
+    auto it = index_.find(k);
+    if (it == index_.end() || !it->second->value) { return nullptr; }
+    it->second->ref = true;
+    return &*it->second->value;
+  }
+
+  /// \brief inserts or replaces. `bytes` is what the entry is charged;
+  /// entries larger than the whole cache are dropped
+  void
+  put(const Key &k, Value v, uint64_t bytes) {
+    if (bytes > max_bytes_) {
+      erase(k);
+      return;
+    }
+    auto it = index_.find(k);
+    if (it == index_.end()) {
+      add(entry(k, std::move(v), bytes, state::cold));
+      return;
+    }
+    auto e = it->second;
+    if (e->value) {
+      charge(e->st) -= e->bytes;
+      charge(e->st) += bytes;
+      e->value = std::move(v);
+      e->bytes = bytes;
+      e->ref = true;
+      make_room(0);
+      return;
+    }
+    // test period hit: the cold share was too small to keep it
+    cold_target_ = std::min(max_bytes_, cold_target_ + bytes);
+    test_bytes_ -= e->bytes;
+    meta_del(e);
+    add(entry(k, std::move(v), bytes, state::hot));
+  }
+
+  void
+  erase(const Key &k) {
+    auto it = index_.find(k);
+    if (it == index_.end()) { return; }
+    auto e = it->second;
+    if (e->value) {
+      charge(e->st) -= e->bytes;
+    } else {
+      test_bytes_ -= e->bytes;
+    }
+    meta_del(e);
+  }
+
+  /// \brief charged bytes of the resident entries
+  uint64_t
+  bytes() const {
+    return hot_bytes_ + cold_bytes_;
+  }
+  uint64_t
+  hot_bytes() const {
+    return hot_bytes_;
+  }
+  uint64_t
+  max_bytes() const {
+    return max_bytes_;
+  }
+  /// \brief resident entries plus test entries
+  size_t
+  tracked() const {
+    return ring_.size();
+  }
+
+ private:
+  enum class state : uint8_t { hot, cold, test };
+  struct entry {
+    entry(const Key &k, Value v, uint64_t b, state s)
+      : key(k), value(std::move(v)), bytes(b), st(s) {}
+    Key key;
+    std::optional<Value> value;
+    uint64_t bytes;
+    state st;
+    bool ref{false};
+  };
+  using ring_t = std::list<entry>;
+  using iterator = typename ring_t::iterator;
+
+  uint64_t &
+  charge(state s) {
+    return s == state::hot ? hot_bytes_ : cold_bytes_;
+  }
+  iterator
+  next(iterator it) {
+    return ++it == ring_.end() ? ring_.begin() : it;
+  }
+  iterator
+  prev(iterator it) {
+    return it == ring_.begin() ? std::prev(ring_.end()) : std::prev(it);
+  }
+
+  /// \brief evicts to make room & links the entry in behind the hot hand,
+  /// the most recent position on the clock
+  void
+  add(entry &&e) {
+    make_room(e.bytes);
+    charge(e.st) += e.bytes;
+    const bool first = ring_.empty();
+    auto it = ring_.insert(first ? ring_.end() : hand_hot_, std::move(e));
+    index_[it->key] = it;
+    if (first) { hand_hot_ = hand_cold_ = hand_test_ = it; }
+    if (hand_cold_ == hand_hot_) { hand_cold_ = prev(hand_cold_); }
+  }
+  void
+  make_room(uint64_t bytes) {
+    while (hot_bytes_ + cold_bytes_ + bytes > max_bytes_) {
+      // the cold share shrank to nothing; only demotions free room
+      if (cold_bytes_ == 0) {
+        run_hand_hot();
+      } else {
+        run_hand_cold();
+      }
+    }
+  }
+  /// \brief unlinks the entry; hands on it move back one
+  void
+  meta_del(iterator it) {
+    index_.erase(it->key);
+    if (ring_.size() == 1) {
+      ring_.erase(it);
+      hand_hot_ = hand_cold_ = hand_test_ = ring_.end();
+      return;
+    }
+    auto p = prev(it);
+    if (hand_hot_ == it) { hand_hot_ = p; }
+    if (hand_cold_ == it) { hand_cold_ = p; }
+    if (hand_test_ == it) { hand_test_ = p; }
+    ring_.erase(it);
+  }
+
+  /// \brief referenced cold entries become hot, the others are evicted
+  /// and start their test period
+  void
+  run_hand_cold() {
+    auto e = hand_cold_;
+    if (e->st == state::cold) {
+      cold_bytes_ -= e->bytes;
+      if (e->ref) {
+        e->st = state::hot;
+        e->ref = false;
+        hot_bytes_ += e->bytes;
+      } else {
+        e->st = state::test;
+        e->value.reset();
+        test_bytes_ += e->bytes;
+        while (test_bytes_ > max_bytes_) { run_hand_test(); }
+      }
+    }
+    if (ring_.empty()) { return; }
+    hand_cold_ = next(hand_cold_);
+    while (max_bytes_ - cold_target_ < hot_bytes_) { run_hand_hot(); }
+  }
+  /// \brief unreferenced hot entries become cold
+  void
+  run_hand_hot() {
+    if (hand_hot_ == hand_test_) { run_hand_test(); }
+    auto e = hand_hot_;
+    if (e->st == state::hot) {
+      if (e->ref) {
+        e->ref = false;
+      } else {
+        e->st = state::cold;
+        hot_bytes_ -= e->bytes;
+        cold_bytes_ += e->bytes;
+      }
+    }
+    hand_hot_ = next(hand_hot_);
+  }
+  /// \brief test periods end; each one that does shrinks the cold share
+  void
+  run_hand_test() {
+    if (hand_test_ == hand_cold_) { run_hand_cold(); }
+    auto e = hand_test_;
+    if (e->st == state::test) {
+      const uint64_t b = e->bytes;
+      test_bytes_ -= b;
+      // moves hand_test_ back one
+      meta_del(e);
+      cold_target_ = cold_target_ > b ? cold_target_ - b : 0;
+      if (ring_.empty()) { return; }
+    }
+    hand_test_ = next(hand_test_);
+  }
+
+  const uint64_t max_bytes_;
+  /// \brief bytes the cold entries may take before hot ones are demoted
+  uint64_t cold_target_;
+  uint64_t hot_bytes_{0};
+  uint64_t cold_bytes_{0};
+  uint64_t test_bytes_{0};
+  ring_t ring_;
+  std::unordered_map<Key, iterator, Hash, KeyEqual> index_;
+  iterator hand_hot_ = ring_.end();
+  iterator hand_cold_ = ring_.end();
+  iterator hand_test_ = ring_.end();
+};
+
+}  // namespace smf
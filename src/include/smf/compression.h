@@ -4,6 +4,7 @@
 #pragma once
 
 #include <memory>
+#include <optional>
 
 #include <seastar/core/shared_ptr.hh>
 #include <seastar/core/temporary_buffer.hh>
@@ -13,6 +14,8 @@
 namespace smf {
 
 enum class codec_type { lz4, zstd };
+/// \brief `fastest` is what the rpc filters use. `best` trades cpu for
+/// ratio: zstd level 19 and lz4 HC at LZ4HC_CLEVEL_MAX
 enum class compression_level { fastest, best };
 
 /**
@@ -42,6 +45,11 @@ class codec {
   virtual seastar::temporary_buffer<char> uncompress(const char *data,
                                                      std::size_t sz) = 0;
 
+  /// \brief size `data` declares it decompresses to, read from the frame
+  /// without decompressing it. nullopt if the frame does not declare one
+  virtual std::optional<std::size_t> uncompressed_size(const char *data,
+                                                       std::size_t sz) = 0;
+
   static std::unique_ptr<codec> make_unique(codec_type type,
                                             compression_level level);
 
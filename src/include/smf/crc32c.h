@@ -0,0 +1,26 @@
+// Copyright 2019 SMF Authors
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace smf {
+
+/// \brief CRC-32C (Castagnoli). Uses the SSE4.2 `crc32` instruction when the
+/// cpu supports it - detected once at startup - and a table driven software
+/// implementation otherwise. Both produce the same value.
+uint32_t crc32c(const char *buf, std::size_t len);
+
+/// \brief continues a crc32c over more bytes, for data in several fragments.
+/// crc32c_extend(crc32c(a, n), b, m) == crc32c(a ++ b, n + m) and
+/// crc32c_extend(0, buf, len) == crc32c(buf, len)
+uint32_t crc32c_extend(uint32_t crc, const char *buf, std::size_t len);
+
+/// \brief crc32c of a ++ b, given crc32c(a), crc32c(b) and the length of b.
+/// Lets a checksum stored next to immutable data be reused when that data
+/// is sent after other bytes. O(log(len_b)), no data is touched
+uint32_t crc32c_combine(uint32_t crc_a, uint32_t crc_b, uint64_t len_b);
+
+}  // namespace smf
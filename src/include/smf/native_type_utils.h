@@ -3,32 +3,150 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <vector>
+
 #include <flatbuffers/flatbuffers.h>
 #include <seastar/core/print.hh>
 #include <seastar/core/temporary_buffer.hh>
 
 #include "smf/log.h"
+#include "smf/macros.h"
 
 namespace smf {
+
+/// \brief flatbuffers allocator on top of the shard's allocator - inside a
+/// seastar app ::operator new is the per-shard seastar allocator.
+/// It is stateless, so a flatbuffers::DetachedBuffer made with it can outlive
+/// the builder that produced it.
+///
+class fbs_allocator final : public flatbuffers::Allocator {
+ public:
+  uint8_t *
+  allocate(size_t size) final {
+    return static_cast<uint8_t *>(::operator new(size));
+  }
+  void
+  deallocate(uint8_t *p, size_t) final {
+    ::operator delete(p);
+  }
+  static fbs_allocator *
+  instance() {
+    static fbs_allocator a;
+    return &a;
+  }
+};
+
+/// \brief exposes the reserved size of the builder so the pool can decide
+/// between copying out and handing the memory off
+class fbs_pooled_builder final : public flatbuffers::FlatBufferBuilder {
+ public:
+  explicit fbs_pooled_builder(size_t initial_size)
+    : flatbuffers::FlatBufferBuilder(initial_size, fbs_allocator::instance()) {
+  }
+  size_t
+  capacity() const {
+    return buf_.capacity();
+  }
+};
+
+/// \brief per-shard pool of flatbuffers builders.
+///
+/// Small messages are copied out of a pooled builder, which keeps its memory
+/// for the next message (see fbs_alloc benchmark). Large messages are built
+/// in a builder pre-sized from the previous message of the same type and its
+/// memory is handed off to the temporary_buffer without a copy.
+///
+class fbs_builder_pool {
+ public:
+  using builder_t = std::unique_ptr<fbs_pooled_builder>;
+  /// \brief below this, a memcpy is cheaper than a new allocation
+  static constexpr size_t kCopyThreshold = 2048;
+  static constexpr size_t kMaxPooledBuilders = 4;
+  /// \brief never keep more than this per pooled builder
+  static constexpr size_t kMaxRetainedBytes = 1 << 16;
+
+  static fbs_builder_pool &
+  local() {
+    static thread_local fbs_builder_pool pool;
+    return pool;
+  }
+
+  builder_t
+  acquire(size_t size_hint) {
+    if (size_hint <= kCopyThreshold && !free_.empty()) {
+      auto b = std::move(free_.back());
+      free_.pop_back();
+      b->Clear();
+      return b;
+    }
+    return std::make_unique<fbs_pooled_builder>(
+      std::max<size_t>(size_hint, 1024));
+  }
+
+  void
+  release(builder_t b) {
+    if (free_.size() < kMaxPooledBuilders &&
+        b->capacity() <= kMaxRetainedBytes) {
+      free_.push_back(std::move(b));
+    }
+  }
+
+  /// \brief turns a Finish()'ed builder into a buffer. Small buffers are
+  /// copied and the builder goes back to the pool. Large buffers are zero
+  /// copy, as long as the builder did not over-reserve by more than 2x;
+  /// otherwise they are copied into an exactly sized buffer too.
+  seastar::temporary_buffer<char>
+  to_buffer(builder_t bdr) {
+    const size_t sz = bdr->GetSize();
+    if (sz <= kCopyThreshold || bdr->capacity() > 2 * sz) {
+      seastar::temporary_buffer<char> ret(sz);
+      std::memcpy(ret.get_write(), bdr->GetBufferPointer(), sz);
+      release(std::move(bdr));
+      return ret;
+    }
+    auto mem = bdr->Release();
+    auto ptr = reinterpret_cast<char *>(mem.data());
+    return seastar::temporary_buffer<char>(
+      ptr, sz, seastar::make_object_deleter(std::move(mem)));
+  }
+
+  /// \brief per type, since the size of a type is fairly stable
+  template <typename RootType>
+  static size_t &
+  size_hint() {
+    static thread_local size_t hint = 0;
+    return hint;
+  }
+  /// \brief 12.5% slack so the next one rarely has to grow
+  template <typename RootType>
+  static void
+  update_size_hint(size_t sz) {
+    size_hint<RootType>() = sz + sz / 8;
+  }
+
+ private:
+  std::vector<builder_t> free_;
+};
+
 /// \brief converts a flatbuffers::NativeTableType into a buffer.
 /// See full benchmarks/comparisons here:
 /// https://github.com/smfrpc/smf/pull/259
 ///
-/// Makes 2 copies in the worst case. See PR #259
-/// If the buffer that we encode is large, we generate a new fbs::builder
-/// to keep memory usage predicatable.
-///
+/// Packs into a builder from the per-shard fbs_builder_pool, see
+/// fbs_builder_pool::to_buffer() for when the result is copied
 ///
 template <typename RootType>
 seastar::temporary_buffer<char>
 native_table_as_buffer(const typename RootType::NativeTableType &t) {
-  flatbuffers::FlatBufferBuilder bdr;
-  bdr.Finish(RootType::Pack(bdr, &t, nullptr));
-  auto mem = bdr.Release();
-  auto ptr = reinterpret_cast<char *>(mem.data());
-  auto sz = mem.size();
-  return seastar::temporary_buffer<char>(
-    ptr, sz, seastar::make_object_deleter(std::move(mem)));
+  auto &pool = fbs_builder_pool::local();
+  auto bdr = pool.acquire(fbs_builder_pool::size_hint<RootType>());
+  bdr->Finish(RootType::Pack(*bdr, &t, nullptr));
+  fbs_builder_pool::update_size_hint<RootType>(bdr->GetSize());
+  return pool.to_buffer(std::move(bdr));
 }
 
 }  // namespace smf
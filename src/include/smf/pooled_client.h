@@ -0,0 +1,207 @@
+// Copyright 2019 SMF Authors
+//
+
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <type_traits>
+#include <vector>
+
+#include <seastar/core/future-util.hh>
+#include <seastar/core/gate.hh>
+#include <seastar/core/lowres_clock.hh>
+#include <seastar/core/shared_ptr.hh>
+#include <seastar/core/timer.hh>
+
+#include <smf/log.h>
+#include <smf/reconnect_client.h>
+#include <smf/rpc_client.h>
+
+namespace smf {
+
+struct pooled_client_opts {
+  /// \brief every connection of the pool is opened with these
+  rpc_client_opts client{};
+  /// \brief connections kept open, idle or not
+  uint32_t min_connections = 1;
+  uint32_t max_connections = 8;
+  /// \brief a connection is added once the least busy one has this many
+  /// calls outstanding
+  uint32_t grow_outstanding = 32;
+  /// \brief connections above min_connections without a call for this long
+  /// are closed
+  typename seastar::timer<>::duration idle_timeout = std::chrono::seconds(30);
+  /// \brief how often idle connections are closed & broken ones reconnected
+  typename seastar::timer<>::duration maintenance_interval =
+    std::chrono::seconds(1);
+};
+
+template <typename T>
+/// keeps several connections to one server - one pool per shard - and sends
+/// each call on the one with the fewest calls outstanding. Any
+/// smf::rpc_client works; the generated ones keep their method surface:
+///
+/// \code{.cpp}
+///    smf::pooled_client<smf_gen::demo::SmfStorageClient> pool(opts);
+///    pool.connect().then([&pool] { return pool->Get(std::move(req)); });
+/// \endcode
+///
+/// Connections are added while all of them are busy, up to max_connections,
+/// and closed again once idle, down to min_connections. Broken ones are
+/// reconnected in the background with the backoff of reconnect_client
+///
+class pooled_client {
+ public:
+  using type = std::enable_if_t<std::is_base_of<smf::rpc_client, T>::value, T>;
+  SMF_DISALLOW_COPY_AND_ASSIGN(pooled_client);
+  explicit pooled_client(pooled_client_opts o) : opts_(std::move(o)) {
+    LOG_THROW_IF(opts_.min_connections == 0 ||
+                   opts_.min_connections > opts_.max_connections,
+                 "Invalid pool size, min: {}, max: {}", opts_.min_connections,
+                 opts_.max_connections);
+    timer_.set_callback([this] { maintain(); });
+  }
+
+  /// \brief opens min_connections & starts the maintenance
+  seastar::future<> connect();
+  seastar::future<> stop();
+
+  /// \brief the connected client with the fewest calls outstanding; grows
+  /// the pool when even that one is busy
+  seastar::shared_ptr<T> get();
+  /// \brief i.e.: `pool->Get(std::move(req))`
+  T *
+  operator->() {
+    return get().get();
+  }
+
+  /// \brief connections, including the ones being opened
+  size_t
+  size() const {
+    return members_.size();
+  }
+  /// \brief calls waiting for their reply, on every connection
+  size_t
+  outstanding() const {
+    size_t ret = 0;
+    for (auto &m : members_) { ret += m->rc.get()->outstanding(); }
+    return ret;
+  }
+
+ private:
+  struct member {
+    explicit member(rpc_client_opts o) : rc(std::move(o)) {}
+    reconnect_client<T> rc;
+    seastar::lowres_clock::time_point last_used = seastar::lowres_clock::now();
+    /// \brief while the first connect() of the member is in flight
+    bool connecting{false};
+  };
+  using member_ptr = seastar::lw_shared_ptr<member>;
+
+  void add_member();
+  /// \brief in the background; reconnect_client retries with backoff
+  void connect_member(member_ptr m);
+  /// \brief closes idle members & reconnects broken ones
+  void maintain();
+
+  const pooled_client_opts opts_;
+  std::vector<member_ptr> members_;
+  seastar::timer<> timer_;
+  seastar::gate gate_;
+};
+
+template <typename T>
+seastar::future<>
+pooled_client<T>::connect() {
+  std::vector<seastar::future<>> fs;
+  while (members_.size() < opts_.min_connections) {
+    members_.push_back(seastar::make_lw_shared<member>(opts_.client));
+    fs.push_back(members_.back()->rc.connect());
+  }
+  return seastar::when_all(fs.begin(), fs.end()).discard_result().then([this] {
+    if (!gate_.is_closed()) { timer_.arm_periodic(opts_.maintenance_interval); }
+  });
+}
+
+template <typename T>
+seastar::future<>
+pooled_client<T>::stop() {
+  timer_.cancel();
+  return gate_.close().then([this] {
+    return seastar::parallel_for_each(
+      members_, [](member_ptr m) { return m->rc.stop().finally([m] {}); });
+  });
+}
+
+template <typename T>
+seastar::shared_ptr<T>
+pooled_client<T>::get() {
+  LOG_THROW_IF(members_.empty(), "Pool not connected: {}",
+               opts_.client.server_addr);
+  member_ptr best = nullptr;
+  bool connecting = false;
+  for (auto &m : members_) {
+    connecting |= m->connecting;
+    if (!m->rc.get()->is_conn_valid()) { continue; }
+    if (!best ||
+        m->rc.get()->outstanding() < best->rc.get()->outstanding()) {
+      best = m;
+    }
+  }
+  if (!best) {
+    // every call fails until one reconnects, the same as a single client
+    best = members_.front();
+  } else if (best->rc.get()->outstanding() >= opts_.grow_outstanding &&
+             !connecting && members_.size() < opts_.max_connections) {
+    add_member();
+  }
+  best->last_used = seastar::lowres_clock::now();
+  return best->rc.get();
+}
+
+template <typename T>
+void
+pooled_client<T>::add_member() {
+  if (gate_.is_closed()) { return; }
+  members_.push_back(seastar::make_lw_shared<member>(opts_.client));
+  DLOG_TRACE("Growing pool to {} connections to {}", members_.size(),
+             opts_.client.server_addr);
+  connect_member(members_.back());
+}
+
+template <typename T>
+void
+pooled_client<T>::connect_member(member_ptr m) {
+  if (gate_.is_closed() || m->connecting) { return; }
+  m->connecting = true;
+  (void)seastar::with_gate(gate_, [m] {
+    return m->rc.connect().finally([m] { m->connecting = false; });
+  });
+}
+
+template <typename T>
+void
+pooled_client<T>::maintain() {
+  const auto now = seastar::lowres_clock::now();
+  for (auto it = members_.begin(); it != members_.end();) {
+    auto m = *it;
+    auto c = m->rc.get();
+    if (members_.size() > opts_.min_connections && !m->connecting &&
+        c->outstanding() == 0 && now - m->last_used > opts_.idle_timeout) {
+      it = members_.erase(it);
+      DLOG_TRACE("Shrinking pool to {} connections to {}", members_.size(),
+                 opts_.client.server_addr);
+      (void)seastar::with_gate(
+        gate_, [m] { return m->rc.stop().finally([m] {}); });
+      continue;
+    }
+    // a backoff means reconnect_client is already retrying
+    if (!c->is_conn_valid() && !c->is_migrating() &&
+        m->rc.backoff() == reconnect_backoff::none) {
+      connect_member(m);
+    }
+    ++it;
+  }
+}
+
+}  // namespace smf
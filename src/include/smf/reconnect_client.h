@@ -43,7 +43,8 @@ class reconnect_client {
     : client_(std::move(o.client_)), bo_(o.bo_), rand_(std::move(o.rand_)),
       reconnect_gate_(std::move(o.reconnect_gate_)) {}
 
-  /// \brief main method
+  /// \brief main method. A GOAWAY from the server is handled by the client
+  /// itself - see rpc_client::is_migrating() - and does not bump the backoff
   seastar::future<> connect();
   seastar::future<>
   stop() {
@@ -95,6 +96,7 @@ template <typename T>
 seastar::future<>
 reconnect_client<T>::connect() {
   if (client_->is_conn_valid()) { return seastar::make_ready_future<>(); }
+  if (client_->is_migrating()) { return seastar::make_ready_future<>(); }
   if (reconnect_gate_.is_closed()) { return seastar::make_ready_future<>(); }
   return seastar::with_gate(reconnect_gate_, [this] {
     return client_->reconnect()
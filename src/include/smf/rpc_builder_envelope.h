@@ -0,0 +1,121 @@
+// Copyright 2019 SMF Authors
+//
+#pragma once
+
+#include <memory>
+#include <optional>
+
+#include <flatbuffers/flatbuffers.h>
+
+#include "smf/log.h"
+#include "smf/macros.h"
+#include "smf/native_type_utils.h"
+#include "smf/rpc_envelope.h"
+#include "smf/rpc_header_utils.h"
+#include "smf/rpc_typed_envelope.h"
+
+namespace smf {
+/// \brief response envelope for handlers that build the reply directly with
+/// the flatbuffers builder API instead of filling in the object API type.
+/// Skips the NativeTableType and the Pack() copy of every string & vector.
+///
+/// Usage:
+///
+///   auto name = out.builder().CreateString(rec->name()->c_str());
+///   out.finish(CreateResponse(out.builder(), name));
+///   out.envelope.set_status(200);
+///
+/// The builder comes from the per-shard smf::fbs_builder_pool and the
+/// finished buffer is adopted by the envelope without a copy, see
+/// fbs_builder_pool::to_buffer()
+///
+template <typename RootType>
+class rpc_builder_envelope {
+ public:
+  using type = RootType;
+  using native_type = typename RootType::NativeTableType;
+
+  rpc_builder_envelope() {}
+  /// \brief wraps an object API reply, inline - no allocation. Packing is
+  /// deferred to serialize_data() so the checksum is only computed once
+  explicit rpc_builder_envelope(rpc_typed_envelope<RootType> &&te)
+    : typed_(std::in_place, std::move(te)) {}
+  rpc_builder_envelope(rpc_builder_envelope<RootType> &&o) noexcept
+    : envelope(std::move(o.envelope)), builder_(std::move(o.builder_)),
+      typed_(std::move(o.typed_)), finished_(o.finished_) {
+    o.typed_.reset();
+  }
+  rpc_builder_envelope &
+  operator=(rpc_builder_envelope<RootType> &&o) noexcept {
+    if (this == &o) { return *this; }
+    // back to the pool, like the dtor does
+    if (builder_) { fbs_builder_pool::local().release(std::move(builder_)); }
+    envelope = std::move(o.envelope);
+    builder_ = std::move(o.builder_);
+    typed_ = std::move(o.typed_);
+    o.typed_.reset();
+    finished_ = o.finished_;
+    return *this;
+  }
+  ~rpc_builder_envelope() {
+    if (builder_) { fbs_builder_pool::local().release(std::move(builder_)); }
+  }
+
+  rpc_envelope envelope;
+
+  /// \brief lazily acquired from the per-shard pool, pre-sized from the
+  /// last reply of this type
+  flatbuffers::FlatBufferBuilder &
+  builder() {
+    if (!builder_) {
+      builder_ = fbs_builder_pool::local().acquire(
+        fbs_builder_pool::size_hint<RootType>());
+    }
+    return *builder_;
+  }
+
+  /// \brief finishes the reply. Call exactly once, after all the children
+  /// of the root table have been created
+  void
+  finish(flatbuffers::Offset<RootType> root) {
+    LOG_THROW_IF(finished_, "rpc_builder_envelope finished twice");
+    builder().Finish(root);
+    finished_ = true;
+  }
+
+  bool
+  finished() const {
+    return finished_;
+  }
+
+  /// \brief adopts the finished buffer as the body of this->envelope and
+  /// returns a *moved* copy of the envelope. If nothing was built, the reply
+  /// is an empty RootType so that the client can always parse it
+  rpc_envelope &&
+  serialize_data() {
+    if (typed_) {
+      typed_->envelope.set_checksum_type(
+        rpc_checksum_type(envelope.letter.header));
+      envelope = typed_->serialize_data();
+      typed_.reset();
+      return std::move(envelope);
+    }
+    if (!finished_) {
+      native_type empty;
+      finish(RootType::Pack(builder(), &empty, nullptr));
+    }
+    fbs_builder_pool::update_size_hint<RootType>(builder_->GetSize());
+    envelope.letter.body = fbs_builder_pool::local().to_buffer(
+      std::move(builder_));
+    envelope.update_checksum();
+    return std::move(envelope);
+  }
+
+  SMF_DISALLOW_COPY_AND_ASSIGN(rpc_builder_envelope);
+
+ private:
+  fbs_builder_pool::builder_t builder_{nullptr};
+  std::optional<rpc_typed_envelope<RootType>> typed_;
+  bool finished_{false};
+};
+}  // namespace smf
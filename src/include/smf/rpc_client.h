@@ -9,6 +9,7 @@
 #include <map>
 
 #include <seastar/core/gate.hh>
+#include <seastar/core/shared_future.hh>
 #include <seastar/net/tls.hh>
 #include <seastar/core/shared_ptr.hh>
 #include "smf/histogram.h"
@@ -16,6 +17,7 @@
 #include "smf/rpc_connection.h"
 #include "smf/rpc_envelope.h"
 #include "smf/rpc_filter.h"
+#include "smf/rpc_header_utils.h"
 #include "smf/rpc_recv_typed_context.h"
 
 namespace smf {
@@ -33,6 +35,10 @@ struct rpc_client_opts {
   /// \brief 1GB. After this limit, each connection
   /// will block until there are enough bytes free in memory to continue
   uint64_t memory_avail_for_client = uint64_t(1) << 30 /*1GB*/;
+  /// \brief payload checksum for every request on this connection. The
+  /// server replies with the same algorithm. checksum_type::none is only
+  /// allowed together with tls `credentials`
+  checksum_type checksum = checksum_type::xxhash64;
 };
 
 /// \brief class intented for communicating with a remote host
@@ -72,6 +78,8 @@ class rpc_client {
 
     promise_t pr;
     uint16_t session{0};
+    /// \brief the connection the request went out on
+    seastar::lw_shared_ptr<rpc_connection> conn;
   };
 
   using in_filter_t =
@@ -104,8 +112,8 @@ class rpc_client {
   virtual seastar::future<> connect() final;
   /// \brief if connection is open, it will
   /// 1. conn->disable()
-  /// 2. fulfill all futures with exceptions
-  /// 3. stop() the connection
+  /// 2. fulfill its futures with exceptions
+  /// 3. wait for connections draining after a GOAWAY to finish their calls
   /// 4. connect()
   virtual seastar::future<> reconnect() final;
   virtual seastar::future<> stop() final;
@@ -145,6 +153,21 @@ class rpc_client {
   is_conn_valid() const final {
     return conn_ && conn_->is_valid();
   }
+  /// \brief the server sent a GOAWAY & a new connection is being opened.
+  /// Calls made meanwhile go out on the new connection
+  SMF_ALWAYS_INLINE virtual bool
+  is_migrating() const final {
+    return !!migration_;
+  }
+  /// \brief calls waiting for their reply, on every connection
+  SMF_ALWAYS_INLINE virtual size_t
+  outstanding() const final {
+    return rpc_slots_.size();
+  }
+  SMF_ALWAYS_INLINE virtual checksum_type
+  payload_checksum() const final {
+    return checksum_;
+  }
 
   SMF_DISALLOW_COPY_AND_ASSIGN(rpc_client);
 
@@ -157,10 +180,21 @@ class rpc_client {
 
  private:
   seastar::future<std::optional<rpc_recv_context>> raw_send(rpc_envelope e);
-  seastar::future<> do_reads();
-  seastar::future<> dispatch_write(rpc_envelope e);
-  seastar::future<> process_one_request();
+  seastar::future<seastar::lw_shared_ptr<rpc_connection>> open_connection();
+  void start_reads(seastar::lw_shared_ptr<rpc_connection> conn);
+  seastar::future<> do_reads(seastar::lw_shared_ptr<rpc_connection> conn);
+  seastar::future<> dispatch_write(seastar::lw_shared_ptr<rpc_connection> conn,
+                                   rpc_envelope e);
+  seastar::future<>
+  process_one_request(seastar::lw_shared_ptr<rpc_connection> conn);
+  /// \brief fails the calls of every connection
   void fail_outstanding_futures();
+  /// \brief fails the calls made on `conn` & closes it
+  void fail_connection(seastar::lw_shared_ptr<rpc_connection> conn);
+  /// \brief moves new calls to a new connection; see rpc::header_bit_flags
+  void handle_goaway(seastar::lw_shared_ptr<rpc_connection> conn);
+  /// \brief closes a connection left by a GOAWAY once its calls are done
+  void close_if_drained(seastar::lw_shared_ptr<rpc_connection> conn);
   // stage pipeline applications
   seastar::future<rpc_recv_context> stage_incoming_filters(rpc_recv_context);
   seastar::future<rpc_envelope> stage_outgoing_filters(rpc_envelope);
@@ -180,6 +214,8 @@ class rpc_client {
   seastar::semaphore serialize_writes_{1};
   seastar::lw_shared_ptr<histogram> hist_ = nullptr;
   uint16_t session_idx_{0};
+  checksum_type checksum_{checksum_type::xxhash64};
+  std::optional<seastar::shared_future<>> migration_;
 };
 
 }  // namespace smf
@@ -0,0 +1,65 @@
+// Copyright 2019 SMF Authors
+//
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+namespace smf {
+
+/// \brief see rpc_server_args::codel
+struct rpc_codel_args {
+  /// \brief off by default; the server queues until memory runs out
+  bool enabled = false;
+  /// \brief acceptable standing queueing delay
+  std::chrono::microseconds target = std::chrono::milliseconds(5);
+  /// \brief window over which the minimum delay is taken
+  std::chrono::microseconds interval = std::chrono::milliseconds(100);
+  /// \brief while overloaded, admit the newest waiting requests first; the
+  /// oldest are the likeliest to have timed out on the client already
+  bool lifo_when_overloaded = false;
+};
+
+/// \brief CoDel, as used for server admission - see folly::Codel.
+///
+/// The sojourn time of a request is the time from parsing its header to
+/// starting its handler. If the *minimum* sojourn over a whole interval is
+/// above target, the queue is not draining: the server is overloaded and
+/// requests that waited more than 2x target are rejected until an interval
+/// goes by with a minimum under target again.
+///
+class rpc_codel {
+ public:
+  using clock = std::chrono::steady_clock;
+  /// \brief status of the error reply for rejected requests
+  static constexpr uint32_t kOverloadedStatus = 503;
+
+  explicit rpc_codel(rpc_codel_args args);
+
+  /// \brief records the sojourn of a request about to start its handler
+  /// \return true if the request should be rejected
+  bool should_reject(clock::duration sojourn, clock::time_point now);
+
+  bool
+  overloaded() const {
+    return overloaded_;
+  }
+  /// \brief minimum sojourn of the last complete interval
+  clock::duration
+  last_min_sojourn() const {
+    return last_min_sojourn_;
+  }
+  const rpc_codel_args &
+  args() const {
+    return args_;
+  }
+
+ private:
+  const rpc_codel_args args_;
+  clock::time_point interval_end_;
+  clock::duration min_sojourn_{0};
+  clock::duration last_min_sojourn_{0};
+  bool overloaded_{false};
+};
+
+}  // namespace smf
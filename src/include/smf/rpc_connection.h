@@ -37,6 +37,9 @@ class rpc_connection final {
   seastar::output_stream<char> ostream;
   seastar::lw_shared_ptr<rpc_connection_limits> limits;
   uint32_t istream_active_parser{0};
+  /// \brief set for TLS connections; accept frames with
+  /// `checksum_none` - the transport already authenticates the bytes
+  bool allow_unchecked_payloads{false};
 
   inline void
   disable() {
@@ -2,12 +2,19 @@
 //
 #pragma once
 #include <chrono>
+#include <optional>
 #include <ostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
 
 #include <seastar/core/semaphore.hh>
+#include <seastar/core/shared_ptr.hh>
 #include <seastar/core/timer.hh>
 
 #include <smf/human_bytes.h>
+#include <smf/macros.h>
+#include <smf/rpc_memory_admission.h>
 
 namespace smf {
 /// Currently, it contains the limit to prase the body of the connection to be
@@ -27,9 +34,90 @@ struct rpc_connection_limits {
 
   const uint64_t max_memory;
   const timer_duration_t max_body_parsing_duration;
+  /// \brief time from the first byte of a header to the last. A connection
+  /// may wait for its next request as long as it likes. 0 means no limit
+  timer_duration_t max_header_parsing_duration{0};
 
   seastar::semaphore resources_available;
+  /// \brief fair, per tenant, admission to resources_available. Memory taken
+  /// from resources_available directly must be returned via
+  /// admission.signal(nullptr, bytes)
+  rpc_memory_admission admission{&resources_available};
 };
+/// \brief a request needs more memory than the core has left, i.e.: the
+/// declared decompressed size of a frame. Answered with a 413 error reply
+///
+struct rpc_payload_too_large final : std::runtime_error {
+  explicit rpc_payload_too_large(const std::string &what)
+    : std::runtime_error(what) {}
+};
+
+/// \brief bytes charged to rpc_connection_limits::resources_available for
+/// as long as this object lives. Released through the fair admission so
+/// that waiting requests wake up
+///
+class rpc_memory_reservation {
+ public:
+  rpc_memory_reservation() = default;
+  rpc_memory_reservation(rpc_memory_reservation &&o) noexcept
+    : limits_(std::move(o.limits_)), bytes_(std::exchange(o.bytes_, 0)) {}
+  rpc_memory_reservation &
+  operator=(rpc_memory_reservation &&o) noexcept {
+    if (this != &o) {
+      release();
+      limits_ = std::move(o.limits_);
+      bytes_ = std::exchange(o.bytes_, 0);
+    }
+    return *this;
+  }
+  ~rpc_memory_reservation() { release(); }
+
+  /// \brief never waits. For memory that is already spoken for, i.e.: a
+  /// reply the handler produced; new requests wait instead
+  static rpc_memory_reservation
+  consume(seastar::lw_shared_ptr<rpc_connection_limits> l, uint64_t bytes) {
+    l->resources_available.consume(bytes);
+    return rpc_memory_reservation(std::move(l), bytes);
+  }
+  /// \brief nullopt if the core does not have `bytes` left
+  static std::optional<rpc_memory_reservation>
+  try_reserve(seastar::lw_shared_ptr<rpc_connection_limits> l,
+              uint64_t bytes) {
+    if (!l->resources_available.try_wait(bytes)) { return std::nullopt; }
+    return rpc_memory_reservation(std::move(l), bytes);
+  }
+
+  /// \brief takes over the bytes of `o`, charged to the same limits
+  void
+  merge(rpc_memory_reservation &&o) {
+    if (!limits_) { limits_ = std::move(o.limits_); }
+    bytes_ += std::exchange(o.bytes_, 0);
+    o.limits_ = nullptr;
+  }
+
+  void
+  release() {
+    if (bytes_ > 0 && limits_) {
+      limits_->admission.signal(nullptr, std::exchange(bytes_, 0));
+    }
+    limits_ = nullptr;
+  }
+  uint64_t
+  bytes() const {
+    return bytes_;
+  }
+
+  SMF_DISALLOW_COPY_AND_ASSIGN(rpc_memory_reservation);
+
+ private:
+  rpc_memory_reservation(seastar::lw_shared_ptr<rpc_connection_limits> l,
+                         uint64_t bytes)
+    : limits_(std::move(l)), bytes_(bytes) {}
+
+  seastar::lw_shared_ptr<rpc_connection_limits> limits_;
+  uint64_t bytes_{0};
+};
+
 inline std::ostream &
 operator<<(std::ostream &o, const ::smf::rpc_connection_limits &l) {
   o << "rpc_connection_limits{max_mem:" << ::smf::human_bytes(l.max_memory)
@@ -37,6 +125,10 @@ operator<<(std::ostream &o, const ::smf::rpc_connection_limits &l) {
     << std::chrono::duration_cast<std::chrono::milliseconds>(
          l.max_body_parsing_duration)
          .count()
+    << "ms, max_header_parsing_duration: "
+    << std::chrono::duration_cast<std::chrono::milliseconds>(
+         l.max_header_parsing_duration)
+         .count()
     << "ms, res_avail:" << ::smf::human_bytes(l.resources_available.current())
     << " (" << l.resources_available.current() << ")}";
   return o;
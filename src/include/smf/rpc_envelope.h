@@ -6,6 +6,8 @@
 #include <seastar/core/iostream.hh>
 // smf
 #include "smf/macros.h"
+#include "smf/rpc_connection_limits.h"
+#include "smf/rpc_header_utils.h"
 #include "smf/rpc_letter.h"
 
 namespace smf {
@@ -16,8 +18,12 @@ namespace smf {
 ///
 struct rpc_envelope {
   constexpr static size_t kHeaderSize = sizeof(rpc::header);
+  /// \brief max bytes of a file range in memory at once, per reply
+  constexpr static size_t kFileChunkSize = 128 * 1024;
+  /// \brief `limits`, if set, accounts the chunks of file backed payloads
   static seastar::future<> send(seastar::output_stream<char> *out,
-                                rpc_envelope req);
+                                rpc_envelope req,
+                                rpc_connection_limits *limits = nullptr);
 
   rpc_envelope();
   ~rpc_envelope();
@@ -53,6 +59,30 @@ struct rpc_envelope {
     return letter.size();
   }
 
+  /// \brief selects the payload checksum algorithm carried in the header
+  /// bitflags. If the payload is already set, it is re-checksummed
+  void set_checksum_type(checksum_type t);
+
+  /// \brief sets the header size & checksum over the body. With fragments,
+  /// the checksum is computed once, by send()
+  void update_checksum();
+
+  /// \brief appends a payload fragment after the (already serialized) body,
+  /// without copying it. The payload checksum is computed once, at send
+  /// time, over all the fragments. The receiver gets one contiguous
+  /// payload; see rpc_recv_context::payload_slice()
+  ///
+  /// Fragments can also be added to `letter` *before* the body is
+  /// serialized by rpc_typed_envelope or rpc_builder_envelope; they stay
+  /// at the end of the payload
+  /// \return offset of the fragment in the payload
+  size_t append_fragment(seastar::temporary_buffer<char> frag);
+
+  /// \brief sends a file range as the tail of the payload, after the body
+  /// and fragments. It is read in kFileChunkSize chunks while sending; the
+  /// payload checksum is computed at send time, see rpc_file_range::checksum
+  void set_file_range(rpc_file_range range);
+
   /// \brief, sometimes you know/understand the lifecycle and want a read
   /// only copy of this rpc_envelope - note that headers are 'copied', the
   /// payload, however is 'shared()'
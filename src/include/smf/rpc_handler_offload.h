@@ -0,0 +1,64 @@
+// Copyright 2019 SMF Authors
+//
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#include <seastar/core/future.hh>
+#include <seastar/core/scheduling.hh>
+#include <seastar/core/semaphore.hh>
+#include <seastar/core/shared_ptr.hh>
+
+#include "smf/histogram.h"
+#include "smf/macros.h"
+#include "smf/rpc_envelope.h"
+#include "smf/rpc_recv_context.h"
+#include "smf/rpc_service.h"
+
+namespace smf {
+
+/// \brief runs the handler of a CPU heavy method - see
+/// rpc_method_options::offload_concurrency - in a seastar::thread.
+///
+/// The handler is called from the thread, so a long synchronous body can
+/// call seastar::thread::maybe_yield() to let the other connections of the
+/// core run, or wait on futures with get(). The request and its reply are
+/// moved in & out, never copied. At most offload_concurrency handlers run at
+/// once per core; the others queue in arrival order.
+///
+/// Not thread safe; one per method & shard
+///
+class rpc_handler_offload {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  /// \brief `wait_hist` records the microseconds requests queued for
+  rpc_handler_offload(rpc_service_method_handle *h,
+                      seastar::scheduling_group group,
+                      seastar::lw_shared_ptr<histogram> wait_hist);
+  SMF_DISALLOW_COPY_AND_ASSIGN(rpc_handler_offload);
+
+  seastar::future<rpc_envelope> run(rpc_recv_context &&ctx);
+
+  /// \brief requests waiting for a free thread
+  uint64_t
+  queued() const {
+    return queued_;
+  }
+  uint64_t
+  running() const {
+    return running_;
+  }
+
+ private:
+  rpc_service_method_handle *handle_;
+  /// \brief of the method; the thread keeps it across yields
+  seastar::scheduling_group group_;
+  seastar::lw_shared_ptr<histogram> wait_hist_;
+  seastar::semaphore slots_;
+  uint64_t queued_{0};
+  uint64_t running_{0};
+};
+
+}  // namespace smf
@@ -2,21 +2,218 @@
 //
 
 #pragma once
+#include <limits>
+#include <stdexcept>
+
 #include <xxhash.h>
 
+#include "smf/crc32c.h"
+#include "smf/macros.h"
 #include "smf/rpc_generated.h"
 
 namespace smf {
 
+/// \brief payload checksum algorithm, carried in the rpc::header bitflags
+/// so it can be chosen per connection or per frame
+enum class checksum_type : uint8_t {
+  /// \brief (xxhash64 & UINT32_MAX) - the wire default, no flag set
+  xxhash64,
+  /// \brief (xxh3_64 & UINT32_MAX). Needs xxhash >= 0.8, where xxh3 is
+  /// stable; see rpc_checksum_supported()
+  xxh3,
+  /// \brief CRC-32C, SSE4.2 accelerated when available
+  crc32c,
+  /// \brief no checksum; only valid over TLS
+  none
+};
+
+#if defined(XXH_VERSION_NUMBER) && XXH_VERSION_NUMBER >= 800
+#define SMF_HAS_XXH3 1
+#else
+#define SMF_HAS_XXH3 0
+#endif
+
+/// \brief false for xxh3 when built against xxhash < 0.8. Computing
+/// something else under the xxh3 flag would fail every frame on the peer
+constexpr bool
+rpc_checksum_supported(checksum_type t) {
+  return t != checksum_type::xxh3 || SMF_HAS_XXH3;
+}
+
+constexpr uint8_t kChecksumBitFlagsMask =
+  static_cast<uint8_t>(rpc::header_bit_flags::header_bit_flags_checksum_xxh3) |
+  static_cast<uint8_t>(
+    rpc::header_bit_flags::header_bit_flags_checksum_crc32c) |
+  static_cast<uint8_t>(rpc::header_bit_flags::header_bit_flags_checksum_none);
+
+/// \brief true if at most one checksum_* flag is set
+template <typename T>
+SMF_ALWAYS_INLINE bool
+rpc_checksum_flags_valid(const T &hdr) {
+  const uint8_t bits =
+    static_cast<uint8_t>(hdr.bitflags()) & kChecksumBitFlagsMask;
+  return (bits & (bits - 1)) == 0;
+}
+
+template <typename T>
+SMF_ALWAYS_INLINE checksum_type
+rpc_checksum_type(const T &hdr) {
+  const uint8_t bits = static_cast<uint8_t>(hdr.bitflags());
+  if (bits & rpc::header_bit_flags::header_bit_flags_checksum_none) {
+    return checksum_type::none;
+  }
+  if (bits & rpc::header_bit_flags::header_bit_flags_checksum_crc32c) {
+    return checksum_type::crc32c;
+  }
+  if (bits & rpc::header_bit_flags::header_bit_flags_checksum_xxh3) {
+    return checksum_type::xxh3;
+  }
+  return checksum_type::xxhash64;
+}
+
+template <typename T>
+SMF_ALWAYS_INLINE void
+rpc_set_checksum_type(T &hdr, checksum_type t) {
+  uint8_t bits = static_cast<uint8_t>(hdr.bitflags()) & ~kChecksumBitFlagsMask;
+  switch (t) {
+  case checksum_type::xxh3:
+    bits |= rpc::header_bit_flags::header_bit_flags_checksum_xxh3;
+    break;
+  case checksum_type::crc32c:
+    bits |= rpc::header_bit_flags::header_bit_flags_checksum_crc32c;
+    break;
+  case checksum_type::none:
+    bits |= rpc::header_bit_flags::header_bit_flags_checksum_none;
+    break;
+  default:
+    break;
+  }
+  hdr.mutate_bitflags(static_cast<rpc::header_bit_flags>(bits));
+}
+
+/// \brief see rpc::error_reply
+template <typename T>
+SMF_ALWAYS_INLINE bool
+rpc_is_error_reply(const T &hdr) {
+  return static_cast<uint8_t>(hdr.bitflags()) &
+         rpc::header_bit_flags::header_bit_flags_error_reply;
+}
+
+template <typename T>
+SMF_ALWAYS_INLINE void
+rpc_set_error_reply(T &hdr) {
+  const uint8_t bits = static_cast<uint8_t>(hdr.bitflags()) |
+                       rpc::header_bit_flags::header_bit_flags_error_reply;
+  hdr.mutate_bitflags(static_cast<rpc::header_bit_flags>(bits));
+}
+
+/// \brief see rpc::header_bit_flags::goaway
+template <typename T>
+SMF_ALWAYS_INLINE bool
+rpc_is_goaway(const T &hdr) {
+  return static_cast<uint8_t>(hdr.bitflags()) &
+         rpc::header_bit_flags::header_bit_flags_goaway;
+}
+
+template <typename T>
+SMF_ALWAYS_INLINE void
+rpc_set_goaway(T &hdr) {
+  const uint8_t bits = static_cast<uint8_t>(hdr.bitflags()) |
+                       rpc::header_bit_flags::header_bit_flags_goaway;
+  hdr.mutate_bitflags(static_cast<rpc::header_bit_flags>(bits));
+}
+
 SMF_ALWAYS_INLINE static uint32_t
-rpc_checksum_payload(const char *payload, uint32_t size) {
-  return std::numeric_limits<uint32_t>::max() & XXH64(payload, size, 0);
+rpc_checksum_payload(const char *payload, uint32_t size,
+                     checksum_type t = checksum_type::xxhash64) {
+  switch (t) {
+  case checksum_type::xxh3:
+#if SMF_HAS_XXH3
+    return std::numeric_limits<uint32_t>::max() & XXH3_64bits(payload, size);
+#else
+    throw std::invalid_argument("xxh3 checksums need xxhash >= 0.8");
+#endif
+  case checksum_type::crc32c:
+    return crc32c(payload, size);
+  case checksum_type::none:
+    return 0;
+  default:
+    return std::numeric_limits<uint32_t>::max() & XXH64(payload, size, 0);
+  }
 }
 
+/// \brief rpc_checksum_payload over a payload split in several fragments.
+/// Gives the same value as rpc_checksum_payload over the concatenation
+class rpc_payload_hasher {
+ public:
+  explicit rpc_payload_hasher(checksum_type t) : type_(t) {
+    // XXH_PRIVATE_API exposes the state types; no heap allocation
+    switch (type_) {
+    case checksum_type::crc32c:
+    case checksum_type::none:
+      break;
+    case checksum_type::xxh3:
+#if SMF_HAS_XXH3
+      XXH3_64bits_reset(&xxh3_);
+      break;
+#else
+      throw std::invalid_argument("xxh3 checksums need xxhash >= 0.8");
+#endif
+    default:
+      type_ = checksum_type::xxhash64;
+      XXH64_reset(&xxh64_, 0);
+      break;
+    }
+  }
+  void
+  update(const char *data, uint32_t size) {
+    switch (type_) {
+    case checksum_type::xxhash64:
+      XXH64_update(&xxh64_, data, size);
+      break;
+#if SMF_HAS_XXH3
+    case checksum_type::xxh3:
+      XXH3_64bits_update(&xxh3_, data, size);
+      break;
+#endif
+    case checksum_type::crc32c:
+      crc_ = crc32c_extend(crc_, data, size);
+      break;
+    default:
+      break;
+    }
+  }
+  uint32_t
+  digest() const {
+    switch (type_) {
+    case checksum_type::xxhash64:
+      return std::numeric_limits<uint32_t>::max() & XXH64_digest(&xxh64_);
+#if SMF_HAS_XXH3
+    case checksum_type::xxh3:
+      return std::numeric_limits<uint32_t>::max() & XXH3_64bits_digest(&xxh3_);
+#endif
+    default:
+      return crc_;
+    }
+  }
+
+ private:
+  checksum_type type_;
+  XXH64_state_t xxh64_;
+#if SMF_HAS_XXH3
+  XXH3_state_t xxh3_;
+#endif
+  uint32_t crc_{0};
+};
+};
+
+/// \brief checksums the payload with the algorithm selected in the header
+/// bitflags and sets the header size
 template <typename T>
 SMF_ALWAYS_INLINE void
 checksum_rpc(T &hdr, const char *payload, uint32_t size) {
-  hdr.mutate_checksum(rpc_checksum_payload(payload, size));
+  hdr.mutate_checksum(
+    rpc_checksum_payload(payload, size, rpc_checksum_type(hdr)));
   hdr.mutate_size(size);
 }
 
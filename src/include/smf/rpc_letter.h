@@ -2,14 +2,32 @@
 //
 #pragma once
 
+#include <optional>
+#include <vector>
+
+#include <seastar/core/file.hh>
 #include <seastar/core/sstring.hh>
 #include <seastar/core/temporary_buffer.hh>
 
 #include "smf/macros.h"
 #include "smf/rpc_generated.h"
+#include "smf/rpc_header_utils.h"
 
 namespace smf {
 
+/// \brief a range of a file, sent at the end of the payload. It is read in
+/// bounded chunks while sending, so memory does not grow with the range
+struct rpc_file_range {
+  seastar::file file;
+  uint64_t offset{0};
+  uint64_t size{0};
+  /// \brief rpc_checksum_payload() of the range, i.e.: stored next to an
+  /// immutable segment. Used when `checksum_algorithm` matches the
+  /// envelope; otherwise the range is read one extra time to checksum it
+  std::optional<uint32_t> checksum;
+  checksum_type checksum_algorithm{checksum_type::xxhash64};
+};
+
 struct rpc_letter {
   rpc_letter();
   rpc_letter(rpc::header,
@@ -27,12 +45,33 @@ struct rpc_letter {
   rpc_letter share();
   /// \brief size including headers
   size_t size() const;
+  /// \brief body, fragments and file range; what goes on the wire after
+  /// the header
+  size_t payload_size() const;
+  /// \brief size() minus the file range, which is streamed from disk
+  size_t in_memory_size() const;
   /// \brief does it have a valid body
   bool empty() const;
 
+  /// \brief appends a buffer to the payload, after the body and the
+  /// previous fragments. It is sent with a vectored write and never copied,
+  /// so a large value can be `share()`'d straight from where it lives.
+  /// Does *not* update the header; see rpc_envelope::append_fragment()
+  /// \return offset of the fragment in the payload the receiver sees
+  size_t append_fragment(seastar::temporary_buffer<char> frag);
+
+  /// \brief copies the fragments into a single body, for the few consumers
+  /// that need the payload contiguous, i.e.: compression.
+  /// Throws for file backed letters
+  void linearize();
+
   rpc::header header;
   std::unordered_map<seastar::sstring, seastar::sstring> dynamic_headers;
   seastar::temporary_buffer<char> body;
+  /// \brief optional extra payload after `body`, see append_fragment()
+  std::vector<seastar::temporary_buffer<char>> fragments;
+  /// \brief optional file backed tail of the payload, after the fragments
+  std::optional<rpc_file_range> file_range;
 };
 
 }  // namespace smf
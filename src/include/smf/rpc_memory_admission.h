@@ -0,0 +1,106 @@
+// Copyright 2019 SMF Authors
+//
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+
+#include <seastar/core/future.hh>
+#include <seastar/core/metrics_registration.hh>
+#include <seastar/core/semaphore.hh>
+#include <seastar/core/shared_ptr.hh>
+#include <seastar/core/sstring.hh>
+
+#include "smf/macros.h"
+
+namespace smf {
+
+/// \brief memory a tenant - a group of connections - may hold on one shard.
+/// Created by rpc_memory_admission::attach()
+///
+struct rpc_tenant_quota {
+  rpc_tenant_quota(seastar::sstring tenant_id, uint64_t max_mem)
+    : id(std::move(tenant_id)), max_memory(max_mem) {}
+
+  const seastar::sstring id;
+  /// \brief 0 means bounded only by the shard budget
+  const uint64_t max_memory;
+  uint64_t used_bytes{0};
+  uint64_t waiting_bytes{0};
+  uint32_t connections{0};
+
+  SMF_DISALLOW_COPY_AND_ASSIGN(rpc_tenant_quota);
+
+ private:
+  friend class rpc_memory_admission;
+  struct waiter {
+    explicit waiter(uint64_t b) : bytes(b) {}
+    uint64_t bytes;
+    seastar::promise<> pr;
+  };
+  bool
+  fits(uint64_t bytes) const {
+    // an idle tenant always gets one request in, however large
+    return max_memory == 0 || used_bytes == 0 ||
+           used_bytes + bytes <= max_memory;
+  }
+
+  std::deque<waiter> waiters_;
+  bool queued_{false};
+  seastar::metrics::metric_groups metrics_;
+};
+
+/// \brief hands out the shard memory budget (rpc_connection_limits::
+/// resources_available) to tenants in round robin order, so that one tenant
+/// uploading large payloads cannot starve the others. Within a tenant,
+/// requests are admitted in FIFO order, or LIFO - see set_lifo().
+///
+/// Memory taken straight from the shard semaphore - i.e.: file backed reply
+/// chunks - must be returned with signal(nullptr, bytes) so waiters wake up
+///
+class rpc_memory_admission {
+ public:
+  explicit rpc_memory_admission(seastar::semaphore *shard_budget)
+    : shard_(shard_budget),
+      default_(seastar::make_lw_shared<rpc_tenant_quota>("", 0)) {}
+  ~rpc_memory_admission();
+
+  /// \brief finds or creates the tenant & counts one more connection to it
+  seastar::lw_shared_ptr<rpc_tenant_quota> attach(const seastar::sstring &id,
+                                                  uint64_t max_memory);
+  /// \brief the quota shared by connections that are not grouped into
+  /// tenants. Unbounded, and without per tenant metrics
+  seastar::lw_shared_ptr<rpc_tenant_quota> attach_default();
+  /// \brief a connection of the tenant went away
+  void detach(seastar::lw_shared_ptr<rpc_tenant_quota> t);
+
+  seastar::future<> wait(rpc_tenant_quota *t, uint64_t bytes);
+  void signal(rpc_tenant_quota *t, uint64_t bytes);
+
+  /// \brief admit the newest request of each tenant first. Tenants are
+  /// still served round robin
+  void
+  set_lifo(bool lifo) {
+    lifo_ = lifo;
+  }
+
+  SMF_DISALLOW_COPY_AND_ASSIGN(rpc_memory_admission);
+
+ private:
+  void register_metrics(rpc_tenant_quota *t);
+  /// \brief the owning pointer of an attached tenant
+  seastar::lw_shared_ptr<rpc_tenant_quota> shared(rpc_tenant_quota *t);
+  /// \brief admits waiters while memory lasts
+  void drain();
+
+  seastar::semaphore *shard_;
+  std::unordered_map<seastar::sstring, seastar::lw_shared_ptr<rpc_tenant_quota>>
+    tenants_;
+  seastar::lw_shared_ptr<rpc_tenant_quota> default_;
+  /// \brief tenants with waiters, in round robin order
+  std::deque<seastar::lw_shared_ptr<rpc_tenant_quota>> ready_;
+  bool lifo_{false};
+};
+
+}  // namespace smf
@@ -0,0 +1,30 @@
+// Copyright 2019 SMF Authors
+//
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include <seastar/core/future.hh>
+#include <seastar/core/scheduling.hh>
+#include <seastar/core/sstring.hh>
+
+namespace smf {
+
+/// \brief a named seastar::scheduling_group. Methods pick one with the smfc
+/// method attribute `(priority: "name")`, see rpc_server_args::priority_classes
+///
+struct rpc_priority_class {
+  seastar::sstring name;
+  seastar::scheduling_group group;
+};
+
+/// \brief creates one scheduling group per {name, shares} pair.
+/// Scheduling groups are global to all cores: call it once, i.e.: before
+/// seastar::distributed<rpc_server>::start(), and pass the result to every
+/// server through rpc_server_args::priority_classes
+///
+seastar::future<std::vector<rpc_priority_class>> rpc_create_priority_classes(
+  std::vector<std::pair<seastar::sstring, float>> shares);
+
+}  // namespace smf
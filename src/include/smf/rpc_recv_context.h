@@ -5,6 +5,7 @@
 #include <optional>
 // seastar
 #include <seastar/core/iostream.hh>
+#include <seastar/core/sstring.hh>
 #include <seastar/net/api.hh>
 // smf
 #include "smf/macros.h"
@@ -13,6 +14,8 @@
 #include "smf/rpc_generated.h"
 
 namespace smf {
+class codec;
+
 struct rpc_recv_context {
   /// \brief determines if we've correctly parsed the request
   /// \return  optional fully parsed request, iff the request is supported
@@ -22,10 +25,18 @@ struct rpc_recv_context {
   /// size of the header, so we parse sizeof(Header). We with this information
   /// we parse the body of the request
   ///
+  /// Fails with seastar::timed_out_error if the header trickles in slower
+  /// than rpc_connection_limits::max_header_parsing_duration
+  ///
   static seastar::future<std::optional<rpc::header>>
   parse_header(rpc_connection *conn);
+  ///
+  /// A non zero `alignment` reads the payload into a buffer aligned to it,
+  /// zero padded to a multiple of it; see aligned_payload_size()
+  ///
   static seastar::future<std::optional<rpc_recv_context>>
-  parse_payload(rpc_connection *conn, rpc::header hdr);
+  parse_payload(rpc_connection *conn, rpc::header hdr,
+                uint32_t alignment = 0);
 
   explicit rpc_recv_context(
     seastar::lw_shared_ptr<rpc_connection_limits> server_instance_limits,
@@ -52,10 +63,64 @@ struct rpc_recv_context {
     return header.session();
   }
 
+  /// \brief the server answered with an rpc::error_reply instead of calling
+  /// the handler; status() has the code
+  bool is_error_reply() const;
+
+  /// \brief reason of an error reply. nullopt if this is not one, or if it
+  /// does not verify
+  std::optional<seastar::sstring> error_reason() const;
+
+  /// \brief zero copy view of [offset, offset + size) of the payload, i.e.:
+  /// a fragment the sender added with rpc_envelope::append_fragment().
+  /// Payloads arrive contiguous, so the offsets (or sizes) of the fragments
+  /// are usually carried in the flatbuffer at the front of the payload
+  /// \return nullopt if the range is out of bounds
+  std::optional<seastar::temporary_buffer<char>>
+  payload_slice(size_t offset, size_t size) {
+    if (offset > payload.size() || size > payload.size() - offset) {
+      return std::nullopt;
+    }
+    return payload.share(offset, size);
+  }
+
+  /// \brief payload.size() rounded up to the receive alignment. The padding
+  /// is owned by the payload and zeroed, so the range
+  /// [payload.get(), payload.get() + aligned_payload_size()) can be handed
+  /// straight to seastar::file::dma_write(). 0 if not received aligned
+  size_t aligned_payload_size() const;
+
+  /// \brief restores the receive alignment after a filter replaced the
+  /// payload, i.e.: decompression. No-op otherwise
+  void realign_payload();
+
+  uint32_t
+  payload_alignment() const {
+    return payload_alignment_;
+  }
+
+  /// \brief charges `bytes` the payload is about to grow by - i.e.: the
+  /// declared size of a compressed frame - to the core memory budget, before
+  /// they are allocated. Held until the context is destroyed
+  /// throws rpc_payload_too_large if the core does not have them
+  void reserve_payload_memory(uint64_t bytes);
+  /// \brief reserve_payload_memory() for the size the compressed payload
+  /// declares, so a small frame that declares a huge size is rejected
+  /// instead of running the core out of memory
+  /// throws if the frame does not declare its size
+  void reserve_uncompressed(codec &c);
+
   seastar::lw_shared_ptr<rpc_connection_limits> rpc_server_limits;
   const seastar::socket_address remote_address;
   rpc::header header;
   seastar::temporary_buffer<char> payload;
+  /// \brief see reserve_payload_memory()
+  rpc_memory_reservation payload_memory;
   SMF_DISALLOW_COPY_AND_ASSIGN(rpc_recv_context);
+
+ private:
+  uint32_t payload_alignment_{0};
+  /// \brief the aligned & padded buffer we allocated
+  const char *aligned_base_{nullptr};
 };
 }  // namespace smf
@@ -20,7 +20,8 @@ class rpc_recv_typed_context {
   rpc_recv_typed_context() : ctx(std::nullopt) {}
 
   explicit rpc_recv_typed_context(opt_recv_ctx_t t) : ctx(std::move(t)) {
-    if (SMF_LIKELY(!!ctx)) {
+    // error replies carry an rpc::error_reply, not a T
+    if (SMF_LIKELY(!!ctx) && !ctx->is_error_reply()) {
       auto ptr = ctx.value().payload.get_write();
       cache_ = flatbuffers::GetMutableRoot<T>(ptr);
     }
@@ -64,8 +65,9 @@ class rpc_recv_typed_context {
   /// \code
   ///     if(obj){}
   /// \endcode
-  /// simply forward the bool operator to the option
-  inline operator bool() const { return ctx.operator bool(); }
+  /// false for error replies too, which carry no T; their status & reason
+  /// are still in ctx, see rpc_recv_context::is_error_reply()
+  inline operator bool() const { return ctx && cache_ != nullptr; }
   opt_recv_ctx_t ctx;
   SMF_DISALLOW_COPY_AND_ASSIGN(rpc_recv_typed_context);
 
@@ -0,0 +1,67 @@
+// Copyright 2019 SMF Authors
+//
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <seastar/core/future.hh>
+#include <seastar/core/scheduling.hh>
+#include <seastar/core/timer.hh>
+
+#include "smf/macros.h"
+#include "smf/rpc_envelope.h"
+#include "smf/rpc_recv_context.h"
+#include "smf/rpc_service.h"
+
+namespace smf {
+
+/// \brief collects the requests of a batched method - see
+/// rpc_method_options::batch_size - and runs them with one call of
+/// its `batch` function.
+///
+/// A batch runs once it has batch_size requests, or batch_wait after its
+/// first one arrived, whichever is first. Each request gets its own reply
+/// back; if the batch fails, or returns a different number of replies, all
+/// of its requests fail.
+///
+/// Not thread safe; one per method & shard
+///
+class rpc_request_batcher {
+ public:
+  rpc_request_batcher(rpc_service_method_handle *h,
+                      seastar::scheduling_group group);
+  ~rpc_request_batcher();
+  SMF_DISALLOW_COPY_AND_ASSIGN(rpc_request_batcher);
+
+  seastar::future<rpc_envelope> enqueue(rpc_recv_context &&ctx);
+
+  uint64_t
+  batches() const {
+    return batches_;
+  }
+  uint64_t
+  batched_requests() const {
+    return batched_requests_;
+  }
+  /// \brief batches that ran because they were full, not on the timer
+  uint64_t
+  full_batches() const {
+    return full_batches_;
+  }
+
+ private:
+  void flush();
+
+  rpc_service_method_handle *handle_;
+  /// \brief of the method, whether the batch runs on the timer or not
+  seastar::scheduling_group group_;
+  seastar::timer<> timer_;
+  std::vector<rpc_recv_context> requests_;
+  std::vector<seastar::promise<rpc_envelope>> replies_;
+  uint64_t batches_{0};
+  uint64_t batched_requests_{0};
+  uint64_t full_batches_{0};
+};
+
+}  // namespace smf
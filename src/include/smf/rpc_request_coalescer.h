@@ -0,0 +1,74 @@
+// Copyright 2019 SMF Authors
+//
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <seastar/core/future.hh>
+#include <seastar/core/shared_ptr.hh>
+#include <seastar/core/temporary_buffer.hh>
+#include <seastar/util/noncopyable_function.hh>
+
+#include "smf/macros.h"
+#include "smf/rpc_envelope.h"
+#include "smf/rpc_recv_context.h"
+#include "smf/rpc_request_key.h"
+
+namespace smf {
+
+/// \brief runs identical concurrent requests of a method - see
+/// rpc_method_options::coalesce - once.
+///
+/// The first request of a key runs the handler. Requests with the same key
+/// and payload bytes that arrive while it runs wait for it instead, and each
+/// gets a share() of its reply with their own session. Failures are shared
+/// the same way. Keys that collide with different bytes run on their own.
+///
+/// Not thread safe; one per shard
+///
+class rpc_request_coalescer {
+ public:
+  using handler_t = seastar::noncopyable_function<seastar::future<rpc_envelope>(
+    rpc_recv_context &&)>;
+
+  rpc_request_coalescer() = default;
+  ~rpc_request_coalescer();
+  SMF_DISALLOW_COPY_AND_ASSIGN(rpc_request_coalescer);
+
+  /// \brief `fn(ctx)`, or the reply of an identical request already in
+  /// flight
+  seastar::future<rpc_envelope> run(rpc_recv_context &&ctx, handler_t fn);
+
+  /// \brief requests that did not run the handler
+  uint64_t
+  coalesced() const {
+    return coalesced_;
+  }
+  /// \brief handler executions other requests may join
+  size_t
+  inflight() const {
+    return inflight_.size();
+  }
+
+ private:
+  struct waiter {
+    explicit waiter(uint16_t s) : session(s) {}
+    uint16_t session;
+    seastar::promise<rpc_envelope> pr;
+  };
+  struct call {
+    explicit call(seastar::temporary_buffer<char> r) : request(std::move(r)) {}
+    /// \brief copy of the leader's payload; the handler may mutate its own
+    seastar::temporary_buffer<char> request;
+    std::vector<waiter> waiters;
+  };
+
+  std::unordered_map<rpc_request_key, seastar::lw_shared_ptr<call>,
+                     rpc_request_key::hash>
+    inflight_;
+  uint64_t coalesced_{0};
+};
+
+}  // namespace smf
@@ -0,0 +1,51 @@
+// Copyright 2019 SMF Authors
+//
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include <seastar/core/temporary_buffer.hh>
+
+#include "smf/rpc_generated.h"
+#include "smf/rpc_header_utils.h"
+
+namespace smf {
+
+/// \brief identifies a request by method & payload, for the server side
+/// deduplication of rpc_response_cache and rpc_request_coalescer.
+///
+/// Only a first level key: equal keys may still be different payloads, so
+/// users compare the bytes too, see same_payload()
+///
+struct rpc_request_key {
+  uint32_t request_id;
+  uint32_t checksum;
+  uint32_t size;
+  checksum_type algorithm;
+  int8_t compression;
+
+  /// \brief hashes unchecked payloads - see checksum_type::none - itself.
+  /// Filters may have replaced the payload; the header is not updated
+  static rpc_request_key make(const rpc::header &hdr,
+                              const seastar::temporary_buffer<char> &payload);
+
+  static bool
+  same_payload(const seastar::temporary_buffer<char> &a,
+               const seastar::temporary_buffer<char> &b) {
+    return a.size() == b.size() && std::memcmp(a.get(), b.get(), a.size()) == 0;
+  }
+
+  bool
+  operator==(const rpc_request_key &o) const {
+    return request_id == o.request_id && checksum == o.checksum &&
+           size == o.size && algorithm == o.algorithm &&
+           compression == o.compression;
+  }
+
+  struct hash {
+    size_t operator()(const rpc_request_key &k) const;
+  };
+};
+
+}  // namespace smf
@@ -0,0 +1,80 @@
+// Copyright 2019 SMF Authors
+//
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+#include <seastar/core/temporary_buffer.hh>
+
+#include "smf/clock_pro_cache.h"
+#include "smf/rpc_envelope.h"
+#include "smf/rpc_recv_context.h"
+#include "smf/rpc_request_key.h"
+
+namespace smf {
+
+/// \brief see rpc_server_args::response_cache
+struct rpc_response_cache_args {
+  /// \brief cached requests and replies per core. 0 disables the cache
+  uint64_t max_bytes = 0;
+};
+
+/// \brief replies of idempotent methods - see
+/// rpc_method_options::cache_ttl - by request id and payload.
+///
+/// Looked up after the incoming filters, so they still run for every
+/// request. The payload checksum of the request header is the first level
+/// key; a hit also compares the payload bytes, so a collision is a miss.
+/// Replies are share()'d, never copied, and evicted by CLOCK-Pro, so a scan
+/// of one-off requests does not flush the popular ones
+///
+class rpc_response_cache {
+ public:
+  using clock = std::chrono::steady_clock;
+  /// \brief largest entry, as a fraction of max_bytes
+  static constexpr uint64_t kMaxEntryFraction = 16;
+
+  explicit rpc_response_cache(rpc_response_cache_args args);
+
+  /// \brief share() of the cached reply; the caller sets the session
+  std::optional<rpc_envelope> get(const rpc_recv_context &req,
+                                  clock::time_point now);
+  /// \brief `request` is a copy of the request payload, as the handler got
+  /// it, and `req` its header. Only 2xx replies are cached
+  void put(const rpc::header &req, seastar::temporary_buffer<char> request,
+           rpc_envelope &reply, std::chrono::milliseconds ttl,
+           clock::time_point now);
+
+  bool
+  enabled() const {
+    return args_.max_bytes > 0;
+  }
+  uint64_t
+  bytes() const {
+    return cache_.bytes();
+  }
+  uint64_t
+  hits() const {
+    return hits_;
+  }
+  uint64_t
+  misses() const {
+    return misses_;
+  }
+
+ private:
+  struct entry {
+    seastar::temporary_buffer<char> request;
+    rpc_envelope reply;
+    clock::time_point expires;
+  };
+
+  const rpc_response_cache_args args_;
+  clock_pro_cache<rpc_request_key, entry, rpc_request_key::hash> cache_;
+  uint64_t hits_{0};
+  uint64_t misses_{0};
+};
+
+}  // namespace smf
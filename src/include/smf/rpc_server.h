@@ -3,30 +3,39 @@
 #pragma once
 
 #include <algorithm>
+#include <memory>
 #include <type_traits>
 #include <unordered_map>
 #include <optional>
+#include <vector>
 
 #include <seastar/core/distributed.hh>
 #include <seastar/core/gate.hh>
 #include <seastar/core/metrics_registration.hh>
+#include <seastar/core/scheduling.hh>
+#include <seastar/core/sharded.hh>
 #include <seastar/core/timer.hh>
 #include <seastar/http/httpd.hh>
 #include <seastar/net/tls.hh>
 
 #include "smf/histogram.h"
 #include "smf/macros.h"
+#include "smf/rpc_codel.h"
 #include "smf/rpc_connection_limits.h"
 #include "smf/rpc_filter.h"
 #include "smf/rpc_handle_router.h"
+#include "smf/rpc_handler_offload.h"
+#include "smf/rpc_request_batcher.h"
+#include "smf/rpc_request_coalescer.h"
 #include "smf/rpc_server_args.h"
 #include "smf/rpc_server_connection.h"
 #include "smf/rpc_server_stats.h"
+#include "smf/rpc_shard_routing.h"
 #include "smf/zstd_filter.h"
 
 namespace smf {
 
-class rpc_server {
+class rpc_server : public seastar::peering_sharded_service<rpc_server> {
 
   /// \brief filter type to process data *before* it hits main handle
   using in_filter_t =
@@ -44,6 +53,17 @@ class rpc_server {
 
   seastar::future<> stop();
 
+  /// \brief graceful shutdown. Stops accepting, sends a GOAWAY frame on
+  /// every connection so clients move new calls elsewhere, and resolves
+  /// once the clients closed their connections - after the replies to
+  /// their calls in flight - or after `grace`. Call stop() after it to
+  /// close what is left:
+  ///
+  ///   rpc.invoke_on_all([](auto &s) { return s.drain(30s); })
+  ///     .then([&rpc] { return rpc.stop(); });
+  ///
+  seastar::future<> drain(seastar::timer<>::duration grace);
+
   /// \brief copy histogram. Cannot be made const due to seastar::map_reduce
   /// const-ness bugs
   seastar::future<std::unique_ptr<smf::histogram>> copy_histogram();
@@ -83,17 +103,103 @@ class rpc_server {
   seastar::future<>
   dispatch_rpc(int32_t payload_size,
                seastar::lw_shared_ptr<rpc_server_connection> conn,
+               rpc_codel::clock::time_point arrival,
                std::optional<rpc_recv_context> ctx);
 
   /// \brief main difference between dispatch_rpc and do_dispatch_rpc
   /// is that the former just wraps the calls in a safe seastar::gate
   seastar::future<>
   do_dispatch_rpc(seastar::lw_shared_ptr<rpc_server_connection> conn,
-                  rpc_recv_context &&ctx);
+                  rpc_codel::clock::time_point arrival, rpc_recv_context &&ctx);
 
   seastar::future<>
   cleanup_dispatch_rpc(seastar::lw_shared_ptr<rpc_server_connection> conn);
 
+  static seastar::future<>
+  send_reply(seastar::lw_shared_ptr<rpc_server_connection> conn,
+             rpc_envelope e);
+  /// \brief see rpc::header_bit_flags::goaway
+  static seastar::future<>
+  send_goaway(seastar::lw_shared_ptr<rpc_server_connection> conn);
+  static seastar::future<>
+  flush_replies(seastar::lw_shared_ptr<rpc_server_connection> conn);
+  /// \brief answers a request scoped failure with an rpc::error_reply.
+  /// Unlike rpc_server_connection::set_error() the connection stays open
+  seastar::future<>
+  reply_error(seastar::lw_shared_ptr<rpc_server_connection> conn,
+              const rpc::header &req, uint32_t status, seastar::sstring reason);
+
+  /// \brief recv_timeout, tightened by min_body_bytes_per_sec
+  seastar::timer<>::duration body_timeout(uint64_t payload_size) const;
+  /// \brief connection, then tenant & shard memory for a request payload
+  seastar::future<>
+  wait_for_memory(seastar::lw_shared_ptr<rpc_server_connection> conn,
+                  uint64_t bytes);
+  void release_memory(seastar::lw_shared_ptr<rpc_server_connection> conn,
+                      uint64_t bytes);
+  seastar::sstring tenant_id(const seastar::socket_address &addr) const;
+
+  /// \brief flatbuffers verification with the method or server policy
+  bool verify_request(const rpc_service_method_handle *h,
+                      const rpc_recv_context &ctx);
+
+  /// \brief counts the handler towards this core's load
+  seastar::future<rpc_envelope> run_handler(rpc_service_method_handle *h,
+                                            rpc_recv_context &&ctx);
+  /// \brief core a request without a shard key should run on; this one
+  /// unless it is overloaded. See rpc_rebalance_args
+  uint32_t rebalance_target();
+  /// \brief this core's load since the last sample
+  rpc_shard_load sample_load();
+  /// \brief this core's load, sampled on demand unless rebalancing does it
+  const rpc_shard_load &local_load();
+  /// \brief sends this core's load to every core, with rebalancing
+  void publish_load();
+  /// \brief fetches the load of every core, without rebalancing
+  seastar::future<> collect_loads();
+  /// \brief json for the admin endpoint, /v1/shards
+  seastar::sstring shard_loads_json() const;
+  /// \brief closes idle connections & the ones of clients not reading
+  void reap_connections();
+  /// \brief closes the connection; its read loop & replies see it invalid
+  void evict(seastar::lw_shared_ptr<rpc_server_connection> conn,
+             seastar::sstring reason);
+
+  /// \brief runs the request on `core` - the owner of its shard key - and
+  /// resolves with its reply on this core
+  seastar::future<rpc_envelope> forward_request(uint32_t core,
+                                                rpc_recv_context &&ctx);
+  /// \brief one smp message per core for all the requests (replies)
+  /// forwarded to it since the last poll
+  seastar::future<> flush_forwarded_requests(uint32_t core);
+  seastar::future<> flush_forwarded_replies(uint32_t core);
+  /// \brief on the owning core
+  void run_forwarded(uint32_t origin, std::vector<rpc_forwarded_request> b);
+  seastar::future<> reply_forwarded(uint32_t origin, uint64_t id,
+                                    seastar::future<rpc_envelope> f);
+  /// \brief back on the origin core
+  void complete_forwarded(std::vector<rpc_forwarded_reply> b);
+  /// \brief completes forwarded requests whose smp message was lost
+  void fail_forwarded(const std::vector<uint64_t> &ids, std::exception_ptr ep);
+
+  /// \brief of a method with a batch_size, created on its first request
+  rpc_request_batcher &batcher_for(rpc_service_method_handle *h);
+  /// \brief of a method with an offload_concurrency, created on its first
+  /// request
+  rpc_handler_offload &offload_for(rpc_service_method_handle *h);
+  /// \brief sum over the methods
+  uint64_t offload_stat(uint64_t (rpc_handler_offload::*stat)() const) const;
+  /// \brief sum over the methods
+  uint64_t batch_stat(uint64_t (rpc_request_batcher::*stat)() const) const;
+
+  /// \brief scheduling group of the method's priority class
+  seastar::scheduling_group
+  scheduling_group_for(const rpc_service_method_handle *h) const;
+
+  /// \brief feeds the queueing delay of a request to the load shedder
+  /// \return true if the request must be rejected
+  bool shed_request(rpc_codel::clock::time_point arrival);
+
   // SEDA piplines
   seastar::future<rpc_recv_context>
     stage_apply_incoming_filters(rpc_recv_context);
@@ -117,12 +223,55 @@ class rpc_server {
 
   /// \brief keeps latency measurements per request flow
   seastar::lw_shared_ptr<histogram> hist_ = histogram::make_lw_shared();
+  /// \brief time spent verifying request flatbuffers
+  seastar::lw_shared_ptr<histogram> verify_hist_ = histogram::make_lw_shared();
+  /// \brief time requests of offloaded methods wait for a thread
+  seastar::lw_shared_ptr<histogram> offload_wait_hist_ =
+    histogram::make_lw_shared();
+  /// \brief time from header parse to dispatch, in microseconds
+  seastar::lw_shared_ptr<histogram> sojourn_hist_ = histogram::make_lw_shared();
+  /// \brief queueing delay based admission
+  rpc_codel codel_;
+  rpc_response_cache response_cache_;
+  rpc_request_coalescer coalescer_;
+  std::unordered_map<const rpc_service_method_handle *,
+                     std::unique_ptr<rpc_request_batcher>>
+    batchers_;
+  std::unordered_map<const rpc_service_method_handle *,
+                     std::unique_ptr<rpc_handler_offload>>
+    offloads_;
+  // -- load of every core, see publish_load()
+  std::vector<rpc_shard_load> shard_loads_;
+  seastar::timer<> load_timer_;
+  uint64_t interval_requests_{0};
+  std::chrono::steady_clock::duration interval_busy_{0};
+  std::chrono::steady_clock::time_point last_sample_;
+  /// \brief on demand samples closer together than this are reused
+  static constexpr std::chrono::milliseconds kMinLoadSample{100};
+
+  /// \brief requests this core forwarded, until their reply is back
+  struct forwarded_request {
+    explicit forwarded_request(rpc_recv_context &&c) : ctx(std::move(c)) {}
+    rpc_recv_context ctx;
+    seastar::promise<rpc_envelope> pr;
+  };
+  uint64_t forward_seq_{0};
+  std::unordered_map<uint64_t, forwarded_request> forwarded_;
+  /// \brief pending smp batches, indexed by destination core
+  std::vector<std::vector<rpc_forwarded_request>> forward_requests_;
+  std::vector<std::vector<rpc_forwarded_reply>> forward_replies_;
+  /// \brief group the server was created in; runs unprioritized requests
+  const seastar::scheduling_group default_group_ =
+    seastar::current_scheduling_group();
 
   // this is needed for shutdown procedures
   uint64_t connection_idx_{0};
   std::unordered_map<uint64_t, seastar::lw_shared_ptr<rpc_server_connection>>
     open_connections_;
 
+  /// \brief see reap_connections()
+  seastar::timer<> reap_timer_;
+  bool draining_{false};
   /// \brief set once keep_listening has exited
   seastar::promise<> stopped_;
   /// \brief keeps server alive until all continuations have finished
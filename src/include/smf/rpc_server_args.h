@@ -4,11 +4,20 @@
 #pragma once
 
 #include <cstdint>
+#include <functional>
+#include <vector>
 
 #include <seastar/core/sstring.hh>
 #include <seastar/core/timer.hh>
+#include <seastar/net/socket_defs.hh>
 #include <seastar/net/tls.hh>
 
+#include "smf/rpc_codel.h"
+#include "smf/rpc_priority.h"
+#include "smf/rpc_response_cache.h"
+#include "smf/rpc_shard_routing.h"
+#include "smf/rpc_verification.h"
+
 namespace smf {
 enum rpc_server_flags : uint32_t { rpc_server_flags_disable_http_server = 1 };
 
@@ -27,11 +36,76 @@ struct rpc_server_args {
   /// receive some bytes or expire the connection.
   ///
   typename seastar::timer<>::duration recv_timeout = std::chrono::minutes(1);
+  /// \brief slowloris protection: the body of a request must arrive at
+  /// this many bytes per second on average, after one second of slack, or
+  /// the connection is closed. Tightens recv_timeout. 0 disables it
+  ///
+  uint64_t min_body_bytes_per_sec = 0;
+  /// \brief slowloris protection: the rest of a request header must arrive
+  /// within this time of its first byte. 0 disables it
+  ///
+  typename seastar::timer<>::duration header_timeout = std::chrono::seconds(0);
   /// \brief 4GB usually. After this limit, each connection to this
   /// server-core will block until there are enough bytes free in memory to
   /// continue
   ///
   uint64_t memory_avail_per_core = uint64_t(1) << 31 /*2GB per core*/;
+  /// \brief most request bytes a single connection may hold in memory.
+  /// Reads from a connection at its limit stop until its requests finish,
+  /// so one uploader cannot take the whole core budget. 0 means no limit
+  ///
+  uint64_t memory_avail_per_connection = 0;
+  /// \brief same as memory_avail_per_connection, for all the connections
+  /// of a tenant on a core. 0 means no limit
+  ///
+  uint64_t memory_avail_per_tenant = 0;
+  /// \brief groups connections into tenants. Waiting requests are admitted
+  /// round robin across tenants. Defaults to the remote ip address when
+  /// memory_avail_per_tenant is set; otherwise, if unset, all connections
+  /// share one quota and no per tenant metrics are exported
+  ///
+  std::function<seastar::sstring(const seastar::socket_address &)> tenant_id;
+  /// \brief receive every request payload aligned to this & zero padded to
+  /// a multiple of it, i.e.: 4096 to dma_write() payloads with O_DIRECT.
+  /// 0 means no alignment, otherwise a power of 2. Methods can override it,
+  /// see rpc_method_options::payload_alignment
+  ///
+  uint32_t payload_alignment = 0;
+  /// \brief flatbuffers verification of requests before dispatch. Methods
+  /// can override it, see rpc_method_options::verification
+  ///
+  rpc_verification_policy verification = rpc_verification_policy::none;
+  /// \brief bounds the cost of rpc_verification_policy::full
+  ///
+  rpc_verification_limits verification_limits{};
+  /// \brief sheds load once requests queue for too long; rejected requests
+  /// get a 503 rpc::error_reply. See rpc_codel
+  ///
+  rpc_codel_args codel{};
+  /// \brief scheduling groups methods can run in - filters, handler and
+  /// reply - by name. Create them with rpc_create_priority_classes()
+  ///
+  std::vector<rpc_priority_class> priority_classes;
+  /// \brief per core load tracking & request rebalancing. See
+  /// rpc_rebalance_args
+  ///
+  rpc_rebalance_args rebalance{};
+  /// \brief replies of methods with a cache_ttl, see rpc_response_cache
+  ///
+  rpc_response_cache_args response_cache{};
+  /// \brief connections with nothing in flight & no request for this long
+  /// are closed. 0 disables it
+  ///
+  typename seastar::timer<>::duration idle_timeout = std::chrono::seconds(0);
+  /// \brief connections whose replies made no progress for this long - the
+  /// client stopped reading - are closed. 0 disables it
+  ///
+  typename seastar::timer<>::duration slow_reader_timeout =
+    std::chrono::seconds(0);
+  /// \brief open connections per core. Connections accepted over it are
+  /// closed right away. 0 means no limit
+  ///
+  uint32_t max_connections_per_core = 0;
 };
 
 }  // namespace smf
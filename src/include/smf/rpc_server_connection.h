@@ -3,7 +3,9 @@
 #pragma once
 // std
 #include <chrono>
+#include <optional>
 // seastar
+#include <seastar/core/lowres_clock.hh>
 #include <seastar/net/api.hh>
 // smf
 #include "smf/log.h"
@@ -80,7 +82,10 @@ class rpc_server_connection final {
     stats->total_connections++;
   }
 
-  ~rpc_server_connection() { stats->active_connections--; }
+  ~rpc_server_connection() {
+    stats->active_connections--;
+    if (tenant) { conn.limits->admission.detach(std::move(tenant)); }
+  }
 
   SMF_ALWAYS_INLINE void
   set_error(seastar::sstring e) {
@@ -108,6 +113,17 @@ class rpc_server_connection final {
   const uint64_t id;
   seastar::lw_shared_ptr<rpc_server_stats> stats;
   seastar::semaphore serialize_writes{1};
+  /// \brief set if rpc_server_args::memory_avail_per_connection is
+  std::optional<seastar::semaphore> memory;
+  seastar::lw_shared_ptr<rpc_tenant_quota> tenant;
+  // -- eviction, see rpc_server_args::idle_timeout & slow_reader_timeout
+  uint32_t inflight_requests{0};
+  /// \brief replies written to the ostream & not yet flushed
+  uint32_t pending_replies{0};
+  /// \brief last request header read
+  seastar::lowres_clock::time_point last_request{seastar::lowres_clock::now()};
+  /// \brief last reply flushed, or the first one queued after it
+  seastar::lowres_clock::time_point last_flush{seastar::lowres_clock::now()};
 
   SMF_DISALLOW_COPY_AND_ASSIGN(rpc_server_connection);
 
@@ -16,6 +16,19 @@ struct rpc_server_stats {
   uint64_t no_route_requests{};
   uint64_t completed_requests{};
   uint64_t too_large_requests{};
+  uint64_t verified_requests{};
+  uint64_t failed_verification_requests{};
+  uint64_t error_replies{};
+  uint64_t overloaded_requests{};
+  uint64_t forwarded_requests{};
+  uint64_t forwarded_batches{};
+  uint64_t rebalanced_requests{};
+  uint64_t goaway_connections{};
+  uint64_t idle_connections_evicted{};
+  uint64_t slow_reader_connections_evicted{};
+  uint64_t rejected_connections{};
+  uint64_t slow_header_connections{};
+  uint64_t slow_body_connections{};
 };
 
 }  // namespace smf
@@ -2,12 +2,67 @@
 //
 #pragma once
 
+#include <chrono>
+#include <vector>
+
 #include <seastar/util/noncopyable_function.hh>
 
 #include "smf/rpc_envelope.h"
 #include "smf/rpc_recv_context.h"
+#include "smf/rpc_shard_routing.h"
+#include "smf/rpc_verification.h"
 
 namespace smf {
+/// \brief per method settings of a rpc_service_method_handle. smfc fills
+/// them in from the method attributes of the schema
+struct rpc_method_options {
+  /// \brief one reply per request, in the same order
+  using batch_fn_t = seastar::noncopyable_function<
+    seastar::future<std::vector<rpc_envelope>>(std::vector<rpc_recv_context>
+                                                 &&recv)>;
+
+  /// \brief receive the request payload aligned to this, i.e.: 4096 for
+  /// handlers that dma_write() it. 0 uses rpc_server_args::payload_alignment
+  /// Set with the smfc method attribute `(payload_alignment: "4096")`
+  uint32_t payload_alignment{0};
+  /// \brief verifies the request type; nullptr for untyped handles
+  rpc_verify_fn verify{nullptr};
+  /// \brief inherit uses rpc_server_args::verification
+  /// Set with the smfc method attribute `(verification: "full")`
+  rpc_verification_policy verification{rpc_verification_policy::inherit};
+  /// \brief name of the rpc_server_args::priority_classes entry the request
+  /// runs in. nullptr, or a name the server does not know, runs it in the
+  /// default scheduling group
+  /// Set with the smfc method attribute `(priority: "control")`
+  const char *priority{nullptr};
+  /// \brief requests run on the core that owns their key, rpc_shard_for().
+  /// nullptr runs them on the core that received them
+  /// Set with the smfc method attribute `(shard_key: "name")`
+  rpc_shard_key_fn shard_key{nullptr};
+  /// \brief replies are served from rpc_server_args::response_cache for
+  /// this long; the method must be idempotent. 0 never caches them
+  /// Set with the smfc method attribute `(cache_ttl_ms: "1000")`
+  std::chrono::milliseconds cache_ttl{0};
+  /// \brief identical requests that arrive while one of them runs share its
+  /// reply, see rpc_request_coalescer; the method must be idempotent
+  /// Set with the smfc method attribute `(coalesce: "true")`
+  bool coalesce{false};
+  /// \brief runs the handler in a seastar::thread, at most this many at a
+  /// time per core, see rpc_handler_offload. For CPU heavy methods; the
+  /// handler can then seastar::thread::maybe_yield(). 0 runs it inline
+  /// Set with the smfc method attribute `(offload_concurrency: "2")`
+  uint32_t offload_concurrency{0};
+  /// \brief runs the requests collected by rpc_request_batcher at once, in
+  /// place of rpc_service_method_handle::apply. Unset unless batch_size > 0
+  batch_fn_t batch;
+  /// \brief requests per `batch` call, at most. 0 runs them one at a time
+  /// Set with the smfc method attribute `(batch_size: "64")`
+  uint32_t batch_size{0};
+  /// \brief how long the first request of a batch waits for the others
+  /// Set with the smfc method attribute `(batch_wait_us: "200")`
+  std::chrono::microseconds batch_wait{0};
+};
+
 // https://github.com/grpc/grpc/blob/d0fbba52d6e379b76a69016bc264b96a2318315f/include/grpc%2B%2B/impl/codegen/rpc_method.h
 struct rpc_service_method_handle {
   // TODO(agallego) - expose through generator
@@ -22,10 +77,12 @@ struct rpc_service_method_handle {
   using fn_t = seastar::noncopyable_function<seastar::future<rpc_envelope>(
     rpc_recv_context &&recv)>;
 
-  rpc_service_method_handle(fn_t &&f) : apply(std::move(f)) {}
+  explicit rpc_service_method_handle(fn_t &&f, rpc_method_options &&o = {})
+    : apply(std::move(f)), options(std::move(o)) {}
   ~rpc_service_method_handle() = default;
 
   fn_t apply;
+  rpc_method_options options;
 };
 
 struct rpc_service {
@@ -0,0 +1,107 @@
+// Copyright 2019 SMF Authors
+//
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <type_traits>
+
+#include <memory>
+
+#include <flatbuffers/flatbuffers.h>
+#include <seastar/core/sharded.hh>
+#include <seastar/core/smp.hh>
+#include <seastar/core/temporary_buffer.hh>
+#include <seastar/net/socket_defs.hh>
+#include <xxhash.h>
+
+#include "smf/rpc_generated.h"
+
+namespace smf {
+
+/// \brief type erased shard key extractor, generated per method by smfc
+/// from the method attribute `(shard_key: "field")`
+/// \return nullopt if the field does not verify
+using rpc_shard_key_fn = std::optional<uint64_t> (*)(const char *buf,
+                                                     uint32_t len);
+
+/// \brief core that owns `key`
+inline uint32_t
+rpc_shard_for(uint64_t key) {
+  return key % seastar::smp::count;
+}
+
+/// \brief xxhash64 of the field `Field` - a string or an integer - of the
+/// root table. Only the root table and the field are verified, whatever the
+/// verification policy of the method. A missing field hashes as its default
+template <typename T, flatbuffers::voffset_t Field>
+std::optional<uint64_t>
+rpc_shard_key(const char *buf, uint32_t len) {
+  using flatbuffers::uoffset_t;
+  auto ptr = reinterpret_cast<const uint8_t *>(buf);
+  if (len < sizeof(uoffset_t)) { return std::nullopt; }
+  const uoffset_t root = flatbuffers::ReadScalar<uoffset_t>(ptr);
+  if (root > len - sizeof(flatbuffers::soffset_t)) { return std::nullopt; }
+  auto table = reinterpret_cast<const flatbuffers::Table *>(ptr + root);
+  flatbuffers::Verifier verifier(ptr, len);
+  if (!table->VerifyTableStart(verifier)) { return std::nullopt; }
+  if constexpr (std::is_same<T, flatbuffers::String>::value) {
+    if (!table->VerifyOffset(verifier, Field)) { return std::nullopt; }
+    auto s = table->GetPointer<const flatbuffers::String *>(Field);
+    if (s == nullptr) { return XXH64("", 0, 0); }
+    if (!verifier.VerifyString(s)) { return std::nullopt; }
+    return XXH64(s->data(), s->size(), 0);
+  } else {
+    static_assert(std::is_integral<T>::value, "shard keys are strings or ints");
+    if (!table->VerifyField<T>(verifier, Field)) { return std::nullopt; }
+    const T v = table->GetField<T>(Field, 0);
+    return XXH64(&v, sizeof(v), 0);
+  }
+}
+
+/// \brief see rpc_server_args::rebalance
+struct rpc_rebalance_args {
+  /// \brief forward requests of methods without a shard key from an
+  /// overloaded core to the least loaded one. Handlers of such methods must
+  /// not depend on core local state
+  bool enabled = false;
+  /// \brief how often cores publish their load to each other
+  std::chrono::milliseconds interval = std::chrono::milliseconds(250);
+  /// \brief a core is overloaded once its load is above
+  /// `imbalance * (least load + 1)`
+  double imbalance = 2.0;
+};
+
+/// \brief load of one core, as of its last publication
+struct rpc_shard_load {
+  uint64_t connections{0};
+  /// \brief handlers started per second
+  double request_rate{0};
+  /// \brief average handlers in flight - handler time per second
+  double load{0};
+};
+
+/// \brief a request handed to the core that owns it. The payload is not
+/// copied; it is freed on the origin core when the owning core drops it
+///
+struct rpc_forwarded_request {
+  uint64_t id;
+  rpc::header header;
+  seastar::foreign_ptr<std::unique_ptr<seastar::temporary_buffer<char>>>
+    payload;
+  seastar::socket_address remote_address;
+};
+
+/// \brief the reply of a rpc_forwarded_request. The body is a plain copy of
+/// the reply payload, so the origin core can free it
+///
+struct rpc_forwarded_reply {
+  uint64_t id;
+  rpc::header header;
+  seastar::temporary_buffer<char> body;
+  std::exception_ptr error;
+};
+
+}  // namespace smf
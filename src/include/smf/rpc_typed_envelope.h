@@ -29,15 +29,14 @@ struct rpc_typed_envelope {
   rpc_typed_envelope(rpc_typed_envelope<RootType> &&te) noexcept {
     *this = std::move(te);
   }
-  /// \brief this copies this->data into this->envelope
-  /// and retuns a *moved* copy of the envelope. That is
+  /// \brief this packs this->data into this->envelope using the per-shard
+  /// smf::fbs_builder_pool and retuns a *moved* copy of the envelope. That is
   /// the envelope will be invalid after this method call
   rpc_envelope &&
   serialize_data() {
     envelope.letter.body =
-      std::move(smf::native_table_as_buffer<RootType>(*(data.get())));
-    smf::checksum_rpc(envelope.letter.header, envelope.letter.body.get(),
-                      envelope.letter.body.size());
+      smf::native_table_as_buffer<RootType>(*(data.get()));
+    envelope.update_checksum();
     data = nullptr;
     return std::move(envelope);
   }
@@ -0,0 +1,61 @@
+// Copyright 2019 SMF Authors
+//
+#pragma once
+
+#include <cstdint>
+
+#include <flatbuffers/flatbuffers.h>
+
+namespace smf {
+
+/// \brief how much of a request flatbuffer the server verifies before
+/// dispatching it to the handler
+enum class rpc_verification_policy : uint8_t {
+  /// \brief use the server default, rpc_server_args::verification
+  inherit,
+  /// \brief trust the payload, i.e.: internal traffic
+  none,
+  /// \brief root offset & root table vtable are in bounds. Constant cost
+  root_only,
+  /// \brief flatbuffers::Verifier over the whole type tree, bounded by
+  /// rpc_verification_limits
+  full
+};
+
+struct rpc_verification_limits {
+  /// \brief flatbuffers::Verifier max_depth; nesting of tables
+  uint32_t max_depth = 64;
+  /// \brief flatbuffers::Verifier max_tables; tables in one payload
+  uint32_t max_tables = 1000000;
+};
+
+/// \brief type erased verifier, generated per method by smfc
+using rpc_verify_fn = bool (*)(const char *buf, uint32_t len,
+                               rpc_verification_policy policy,
+                               const rpc_verification_limits &limits);
+
+template <typename T>
+bool
+rpc_verify_payload(const char *buf, uint32_t len,
+                   rpc_verification_policy policy,
+                   const rpc_verification_limits &limits) {
+  using flatbuffers::uoffset_t;
+  if (policy == rpc_verification_policy::none ||
+      policy == rpc_verification_policy::inherit) {
+    return true;
+  }
+  auto ptr = reinterpret_cast<const uint8_t *>(buf);
+  flatbuffers::Verifier verifier(ptr, len, limits.max_depth,
+                                 limits.max_tables);
+  if (policy == rpc_verification_policy::full) {
+    return verifier.VerifyBuffer<T>(nullptr);
+  }
+  // root_only
+  if (len < sizeof(uoffset_t)) { return false; }
+  const uoffset_t root = flatbuffers::ReadScalar<uoffset_t>(ptr);
+  if (root > len - sizeof(flatbuffers::soffset_t)) { return false; }
+  auto table = reinterpret_cast<const flatbuffers::Table *>(ptr + root);
+  return table->VerifyTableStart(verifier);
+}
+
+}  // namespace smf
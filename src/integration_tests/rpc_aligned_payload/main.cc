@@ -0,0 +1,150 @@
+// Copyright 2019 SMF Authors
+//
+// std
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+// seastar
+#include <seastar/core/app-template.hh>
+#include <seastar/core/distributed.hh>
+#include <seastar/core/file.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/net/api.hh>
+// smf
+#include "integration_tests/non_root_port.h"
+#include "smf/log.h"
+#include "smf/lz4_filter.h"
+#include "smf/random.h"
+#include "smf/rpc_generated.h"
+#include "smf/rpc_server.h"
+
+// generated-templates
+#include "integration_tests/demo_service.smf.fb.h"
+
+// Put is annotated with (payload_alignment: "4096") in demo_service.fbs and
+// the server default alignment is 512, which applies to Get. The handlers
+// check the alignment & padding and write the payload with O_DIRECT without
+// copying it.
+//
+constexpr const uint32_t kServerAlignment = 512;
+constexpr const uint32_t kPutAlignment = 4096;
+static const char *kIngestFile = "rpc_aligned_payload.data";
+
+static void
+check_aligned(const smf::rpc_recv_context &ctx, uint32_t alignment) {
+  auto ptr = reinterpret_cast<uintptr_t>(ctx.payload.get());
+  LOG_THROW_IF(ptr % alignment != 0, "Payload {} not aligned to {}",
+               ctx.payload.get(), alignment);
+  LOG_THROW_IF(ctx.payload_alignment() != alignment, "Bad alignment: {}",
+               ctx.payload_alignment());
+  LOG_THROW_IF(ctx.aligned_payload_size() % alignment != 0 ||
+                 ctx.aligned_payload_size() < ctx.payload.size(),
+               "Bad aligned payload size: {}", ctx.aligned_payload_size());
+  for (auto i = ctx.payload.size(); i < ctx.aligned_payload_size(); ++i) {
+    LOG_THROW_IF(ctx.payload.get()[i] != 0, "Padding is not zeroed");
+  }
+}
+
+class storage_service final : public smf_gen::demo::SmfStorage {
+  using env_t = smf::rpc_typed_envelope<smf_gen::demo::Response>;
+
+  virtual seastar::future<env_t>
+  Get(smf::rpc_recv_typed_context<smf_gen::demo::Request> &&rec) final {
+    LOG_THROW_IF(!rec, "Bad request");
+    check_aligned(rec.ctx.value(), kServerAlignment);
+    env_t data;
+    data.envelope.set_status(200);
+    return seastar::make_ready_future<env_t>(std::move(data));
+  }
+
+  virtual seastar::future<env_t>
+  Put(smf::rpc_recv_typed_context<smf_gen::demo::Request> &&rec) final {
+    LOG_THROW_IF(!rec, "Bad request");
+    check_aligned(rec.ctx.value(), kPutAlignment);
+    auto flags = seastar::open_flags::rw | seastar::open_flags::create |
+                 seastar::open_flags::truncate;
+    auto r = rec.move_to_lw_shared();
+    return seastar::open_file_dma(kIngestFile, flags).then([r](auto f) {
+      auto &ctx = r->ctx.value();
+      // straight from the receive buffer, no copy
+      return f.dma_write(0, ctx.payload.get(), ctx.aligned_payload_size())
+        .then([r, f](size_t written) mutable {
+          LOG_THROW_IF(written != r->ctx->aligned_payload_size(),
+                       "Short dma_write: {}", written);
+          return f.close();
+        })
+        .then([] {
+          env_t data;
+          data.envelope.set_status(200);
+          return seastar::make_ready_future<env_t>(std::move(data));
+        });
+    });
+  }
+};
+
+static seastar::future<>
+round_trip(uint16_t port) {
+  smf::rpc_client_opts opts{};
+  opts.server_addr = seastar::ipv4_addr{"127.0.0.1", port};
+  auto client =
+    seastar::make_shared<smf_gen::demo::SmfStorageClient>(std::move(opts));
+  // compressible; the server must realign after decompression
+  client->outgoing_filters().push_back(smf::lz4_compression_filter(1024));
+  return client->connect()
+    .then([client] {
+      smf::rpc_typed_envelope<smf_gen::demo::Request> req;
+      req.data->name = "get";
+      return client->Get(req.serialize_data()).then([](auto ret) {
+        LOG_THROW_IF(!ret || ret.ctx->status() != 200, "Get failed");
+      });
+    })
+    .then([client] {
+      smf::rpc_typed_envelope<smf_gen::demo::Request> req;
+      req.data->name = seastar::sstring(10000, 'x');
+      return client->Put(req.serialize_data()).then([](auto ret) {
+        LOG_THROW_IF(!ret || ret.ctx->status() != 200, "Put failed");
+      });
+    })
+    .then([client] {
+      smf::random r;
+      smf::rpc_typed_envelope<smf_gen::demo::Request> req;
+      req.data->name = r.next_str(3 * kPutAlignment + 1);
+      return client->Put(req.serialize_data()).then([](auto ret) {
+        LOG_THROW_IF(!ret || ret.ctx->status() != 200, "Put failed");
+      });
+    })
+    .finally([client] { return client->stop().finally([client] {}); });
+}
+
+int
+main(int args, char **argv, char **env) {
+  seastar::distributed<smf::rpc_server> rpc;
+  seastar::app_template app;
+  smf::random rand;
+  uint16_t random_port =
+    smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+  return app.run(args, argv, [&]() -> seastar::future<int> {
+    seastar::engine().at_exit([&] { return rpc.stop(); });
+    smf::rpc_server_args sargs;
+    sargs.ip = "127.0.0.1";
+    sargs.rpc_port = random_port;
+    sargs.http_port =
+      smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+    sargs.flags |= smf::rpc_server_flags::rpc_server_flags_disable_http_server;
+    sargs.payload_alignment = kServerAlignment;
+
+    return rpc.start(sargs)
+      .then([&rpc] {
+        return rpc.invoke_on_all(
+          &smf::rpc_server::register_service<storage_service>);
+      })
+      .then([&rpc] {
+        return rpc.invoke_on_all(&smf::rpc_server::register_incoming_filter<
+                                 smf::lz4_decompression_filter>);
+      })
+      .then([&rpc] { return rpc.invoke_on_all(&smf::rpc_server::start); })
+      .then([&] { return round_trip(random_port); })
+      .then([] { return seastar::make_ready_future<int>(0); });
+  });
+}
@@ -0,0 +1,145 @@
+// Copyright 2019 SMF Authors
+//
+// std
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+// seastar
+#include <seastar/core/app-template.hh>
+#include <seastar/core/distributed.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/core/when_all.hh>
+#include <seastar/net/api.hh>
+// smf
+#include "integration_tests/non_root_port.h"
+#include "smf/log.h"
+#include "smf/random.h"
+#include "smf/rpc_generated.h"
+#include "smf/rpc_server.h"
+
+// generated-templates
+#include "integration_tests/demo_service.smf.fb.h"
+
+// Fairness variant of rpc_backpressure. One connection uploads large
+// payloads back to back, enough to fill the core budget; a second connection
+// sends a small request in the middle of it.
+//
+// With memory_avail_per_connection the uploader only ever holds one large
+// request, so the small one is admitted right away instead of queueing
+// behind the uploader for the core budget.
+//
+using namespace std::chrono_literals;  // NOLINT
+constexpr const uint32_t kLargeRequest = 1 << 20;
+constexpr const uint32_t kLargeRequests = 4;
+constexpr const auto kLargeRequestDuration = 200ms;
+
+class storage_service final : public smf_gen::demo::SmfStorage {
+  virtual seastar::future<smf::rpc_typed_envelope<smf_gen::demo::Response>>
+  Get(smf::rpc_recv_typed_context<smf_gen::demo::Request> &&rec) final {
+    const bool large = rec->name()->size() >= kLargeRequest;
+    return seastar::sleep(large ? kLargeRequestDuration : 0ms).then([] {
+      smf::rpc_typed_envelope<smf_gen::demo::Response> data;
+      data.envelope.set_status(200);
+      return seastar::make_ready_future<
+        smf::rpc_typed_envelope<smf_gen::demo::Response>>(std::move(data));
+    });
+  }
+};
+
+using client_t = seastar::shared_ptr<smf_gen::demo::SmfStorageClient>;
+
+static client_t
+make_client(uint16_t port) {
+  smf::rpc_client_opts opts{};
+  opts.server_addr = seastar::ipv4_addr{"127.0.0.1", port};
+  return seastar::make_shared<smf_gen::demo::SmfStorageClient>(
+    std::move(opts));
+}
+
+static seastar::future<std::chrono::milliseconds>
+timed_get(client_t client, uint32_t size) {
+  smf::random r;
+  smf::rpc_typed_envelope<smf_gen::demo::Request> req;
+  req.data->name = r.next_alphanum(size);
+  auto begin = std::chrono::steady_clock::now();
+  return client->Get(req.serialize_data()).then([begin](auto ret) {
+    LOG_THROW_IF(!ret, "Empty response from server");
+    LOG_THROW_IF(ret.ctx->status() != 200, "Bad status: {}",
+                 ret.ctx->status());
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - begin);
+  });
+}
+
+static seastar::future<>
+fairness_requests(uint16_t port) {
+  auto uploader = make_client(port);
+  auto small = make_client(port);
+  return seastar::when_all_succeed(uploader->connect(), small->connect())
+    .then([=] {
+      std::vector<seastar::future<std::chrono::milliseconds>> uploads;
+      for (auto i = 0u; i < kLargeRequests; ++i) {
+        uploads.push_back(timed_get(uploader, kLargeRequest));
+      }
+      auto small_req = seastar::sleep(50ms).then(
+        [small] { return timed_get(small, 64); });
+      return seastar::when_all_succeed(uploads.begin(), uploads.end())
+        .then([small_req = std::move(small_req)](auto upload_times) mutable {
+          return small_req.then([upload_times](auto small_time) {
+            auto slowest =
+              *std::max_element(upload_times.begin(), upload_times.end());
+            LOG_INFO("Small request: {}ms, slowest upload: {}ms",
+                     small_time.count(), slowest.count());
+            LOG_THROW_IF(small_time >= kLargeRequestDuration,
+                         "Small request queued behind the uploader: {}ms",
+                         small_time.count());
+            // one large request at a time on the uploader connection
+            LOG_THROW_IF(slowest < kLargeRequestDuration * kLargeRequests,
+                         "Uploader exceeded its connection limit: {}ms",
+                         slowest.count());
+          });
+        });
+    })
+    .finally([=] {
+      return seastar::when_all(uploader->stop(), small->stop())
+        .discard_result()
+        .finally([=] {});
+    });
+}
+
+int
+main(int args, char **argv, char **env) {
+  seastar::distributed<smf::rpc_server> rpc;
+  seastar::app_template app;
+  smf::random rand;
+  uint16_t random_port =
+    smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+  return app.run(args, argv, [&]() -> seastar::future<int> {
+    seastar::engine().at_exit([&] { return rpc.stop(); });
+    smf::rpc_server_args sargs;
+    sargs.ip = "127.0.0.1";
+    sargs.rpc_port = random_port;
+    sargs.http_port =
+      smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+    sargs.flags |= smf::rpc_server_flags::rpc_server_flags_disable_http_server;
+
+    // -- MAIN TEST --
+    // without the connection limit the uploader fills the core budget
+    sargs.memory_avail_per_core =
+      static_cast<uint64_t>(2 * kLargeRequest + 400 /*some slack bytes*/);
+    sargs.memory_avail_per_connection =
+      static_cast<uint64_t>(kLargeRequest + 200 /*some slack bytes*/);
+
+    return rpc.start(sargs)
+      .then([&rpc] {
+        return rpc.invoke_on_all(
+          &smf::rpc_server::register_service<storage_service>);
+      })
+      .then([&rpc] { return rpc.invoke_on_all(&smf::rpc_server::start); })
+      .then([&] { return fairness_requests(random_port); })
+      .then([] { return seastar::make_ready_future<int>(0); });
+  });
+}
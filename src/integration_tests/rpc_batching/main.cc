@@ -0,0 +1,123 @@
+// Copyright 2019 SMF Authors
+//
+// std
+#include <chrono>
+#include <iostream>
+#include <vector>
+// seastar
+#include <seastar/core/app-template.hh>
+#include <seastar/core/distributed.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/core/when_all.hh>
+// smf
+#include "integration_tests/non_root_port.h"
+#include "smf/log.h"
+#include "smf/random.h"
+#include "smf/rpc_generated.h"
+#include "smf/rpc_server.h"
+
+// generated-templates
+#include "integration_tests/demo_service.smf.fb.h"
+
+// Write is declared with `(batch_size: "8", batch_wait_us: "50000")` in
+// demo_service.fbs.
+//
+// Concurrent requests are handed to WriteBatch() together: a batch runs as
+// soon as it is full, the rest after the wait. Every caller gets its own
+// reply, on its own session.
+//
+constexpr const uint32_t kBatchSize = 8;
+
+static std::vector<uint32_t> batches;
+
+class storage_service final : public smf_gen::demo::SmfStorage {
+  virtual seastar::future<
+    std::vector<smf::rpc_builder_envelope<smf_gen::demo::Response>>>
+  WriteBatch(std::vector<smf::rpc_recv_typed_context<smf_gen::demo::Request>>
+               &&recs) final {
+    using env_t = smf::rpc_builder_envelope<smf_gen::demo::Response>;
+    batches.push_back(recs.size());
+    std::vector<env_t> out;
+    for (auto &rec : recs) {
+      smf::rpc_typed_envelope<smf_gen::demo::Response> data;
+      data.data->name = rec->name()->str();
+      data.envelope.set_status(200);
+      out.emplace_back(std::move(data));
+    }
+    return seastar::make_ready_future<std::vector<env_t>>(std::move(out));
+  }
+};
+
+/// \brief sends `count` distinct requests at once; the batch sizes the
+/// handler saw must be `expected`
+static void
+write(smf_gen::demo::SmfStorageClient &c, uint32_t count,
+      std::vector<uint32_t> expected) {
+  batches.clear();
+  std::vector<seastar::sstring> names;
+  std::vector<seastar::future<
+    smf::rpc_recv_typed_context<smf_gen::demo::Response>>>
+    replies;
+  for (auto i = 0u; i < count; ++i) {
+    names.push_back(fmt::format("write-{}", i));
+    smf::rpc_typed_envelope<smf_gen::demo::Request> req;
+    req.data->name = names.back();
+    replies.push_back(c.Write(req.serialize_data()));
+  }
+  auto done = seastar::when_all(replies.begin(), replies.end()).get0();
+  for (auto i = 0u; i < done.size(); ++i) {
+    auto ret = done[i].get0();
+    LOG_THROW_IF(!ret, "Empty response from server");
+    LOG_THROW_IF(ret.ctx->status() != 200, "Bad status: {}",
+                 ret.ctx->status());
+    LOG_THROW_IF(ret->name()->str() != names[i],
+                 "Reply for another request: {}, expected {}",
+                 ret->name()->str(), names[i]);
+  }
+  LOG_THROW_IF(batches.size() != expected.size(), "{} batches, expected {}",
+               batches.size(), expected.size());
+  for (auto i = 0u; i < batches.size(); ++i) {
+    LOG_THROW_IF(batches[i] != expected[i], "Batch {} of {}, expected {}", i,
+                 batches[i], expected[i]);
+  }
+}
+
+static void
+run(uint16_t port) {
+  smf::rpc_client_opts opts{};
+  opts.server_addr = seastar::ipv4_addr{"127.0.0.1", port};
+  smf_gen::demo::SmfStorageClient client(std::move(opts));
+  client.connect().get();
+  write(client, kBatchSize, {kBatchSize});
+  write(client, 3, {3});
+  write(client, 2 * kBatchSize + 4, {kBatchSize, kBatchSize, 4});
+  client.stop().get();
+}
+
+int
+main(int args, char **argv, char **env) {
+  seastar::distributed<smf::rpc_server> rpc;
+  seastar::app_template app;
+  smf::random rand;
+  uint16_t random_port =
+    smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+  return app.run(args, argv, [&]() -> seastar::future<int> {
+    seastar::engine().at_exit([&] { return rpc.stop(); });
+    smf::rpc_server_args sargs;
+    sargs.ip = "127.0.0.1";
+    sargs.rpc_port = random_port;
+    sargs.http_port =
+      smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+    sargs.flags |= smf::rpc_server_flags::rpc_server_flags_disable_http_server;
+
+    return rpc.start(sargs)
+      .then([&rpc] {
+        return rpc.invoke_on_all(
+          &smf::rpc_server::register_service<storage_service>);
+      })
+      .then([&rpc] { return rpc.invoke_on_all(&smf::rpc_server::start); })
+      .then([&] { return seastar::async([&] { run(random_port); }); })
+      .then([] { return seastar::make_ready_future<int>(0); });
+  });
+}
@@ -0,0 +1,100 @@
+// Copyright 2019 SMF Authors
+//
+// std
+#include <iostream>
+#include <vector>
+// seastar
+#include <seastar/core/app-template.hh>
+#include <seastar/core/distributed.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/core/when_all.hh>
+// smf
+#include "integration_tests/non_root_port.h"
+#include "smf/log.h"
+#include "smf/random.h"
+#include "smf/rpc_generated.h"
+#include "smf/rpc_server.h"
+
+// generated-templates
+#include "integration_tests/demo_service.smf.fb.h"
+
+// Write is declared with a batch_size in demo_service.fbs, but this service
+// only implements its builder API overload, like a service written before
+// the method was batched. The generated WriteBatch() must run that handler
+// for every request, not the unimplemented object API one.
+//
+constexpr const uint32_t kRequests = 8;
+
+static uint32_t handler_calls = 0;
+
+class storage_service final : public smf_gen::demo::SmfStorage {
+  virtual seastar::future<smf::rpc_builder_envelope<smf_gen::demo::Response>>
+  Write(smf::rpc_recv_typed_context<smf_gen::demo::Request> &&rec,
+        smf::rpc_builder_envelope<smf_gen::demo::Response> &&out) final {
+    ++handler_calls;
+    auto name = out.builder().CreateString(rec->name());
+    out.finish(smf_gen::demo::CreateResponse(out.builder(), name));
+    out.envelope.set_status(200);
+    return seastar::make_ready_future<
+      smf::rpc_builder_envelope<smf_gen::demo::Response>>(std::move(out));
+  }
+};
+
+static void
+run(uint16_t port) {
+  smf::rpc_client_opts opts{};
+  opts.server_addr = seastar::ipv4_addr{"127.0.0.1", port};
+  smf_gen::demo::SmfStorageClient client(std::move(opts));
+  client.connect().get();
+  std::vector<seastar::sstring> names;
+  std::vector<seastar::future<
+    smf::rpc_recv_typed_context<smf_gen::demo::Response>>>
+    replies;
+  for (auto i = 0u; i < kRequests; ++i) {
+    names.push_back(fmt::format("write-{}", i));
+    smf::rpc_typed_envelope<smf_gen::demo::Request> req;
+    req.data->name = names.back();
+    replies.push_back(client.Write(req.serialize_data()));
+  }
+  auto done = seastar::when_all(replies.begin(), replies.end()).get0();
+  for (auto i = 0u; i < done.size(); ++i) {
+    auto ret = done[i].get0();
+    LOG_THROW_IF(!ret, "Empty response from server");
+    LOG_THROW_IF(ret.ctx->status() != 200, "Bad status: {}",
+                 ret.ctx->status());
+    LOG_THROW_IF(ret->name()->str() != names[i],
+                 "Reply for another request: {}, expected {}",
+                 ret->name()->str(), names[i]);
+  }
+  LOG_THROW_IF(handler_calls != kRequests, "Handler ran {} times, expected {}",
+               handler_calls, kRequests);
+  client.stop().get();
+}
+
+int
+main(int args, char **argv, char **env) {
+  seastar::distributed<smf::rpc_server> rpc;
+  seastar::app_template app;
+  smf::random rand;
+  uint16_t random_port =
+    smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+  return app.run(args, argv, [&]() -> seastar::future<int> {
+    seastar::engine().at_exit([&] { return rpc.stop(); });
+    smf::rpc_server_args sargs;
+    sargs.ip = "127.0.0.1";
+    sargs.rpc_port = random_port;
+    sargs.http_port =
+      smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+    sargs.flags |= smf::rpc_server_flags::rpc_server_flags_disable_http_server;
+
+    return rpc.start(sargs)
+      .then([&rpc] {
+        return rpc.invoke_on_all(
+          &smf::rpc_server::register_service<storage_service>);
+      })
+      .then([&rpc] { return rpc.invoke_on_all(&smf::rpc_server::start); })
+      .then([&] { return seastar::async([&] { run(random_port); }); })
+      .then([] { return seastar::make_ready_future<int>(0); });
+  });
+}
@@ -0,0 +1,134 @@
+// Copyright 2019 SMF Authors
+//
+// std
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+// seastar
+#include <seastar/core/app-template.hh>
+#include <seastar/core/distributed.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/core/when_all.hh>
+// smf
+#include "integration_tests/non_root_port.h"
+#include "smf/log.h"
+#include "smf/pooled_client.h"
+#include "smf/random.h"
+#include "smf/rpc_generated.h"
+#include "smf/rpc_server.h"
+
+// generated-templates
+#include "integration_tests/demo_service.smf.fb.h"
+
+// A pool grows while its connections are busy, spreads calls over them and
+// shrinks back once they are idle.
+//
+using namespace std::chrono_literals;  // NOLINT
+using pool_t = smf::pooled_client<smf_gen::demo::SmfStorageClient>;
+constexpr const auto kHandlerTime = 50ms;
+constexpr const auto kIdleTimeout = 200ms;
+constexpr const uint32_t kMaxConnections = 4;
+constexpr const uint32_t kCalls = 16;
+
+/// \brief connections the server saw calls on
+static std::unordered_set<std::string> peers;
+
+class storage_service final : public smf_gen::demo::SmfStorage {
+  virtual seastar::future<smf::rpc_typed_envelope<smf_gen::demo::Response>>
+  Get(smf::rpc_recv_typed_context<smf_gen::demo::Request> &&rec) final {
+    peers.insert(fmt::format("{}", rec.ctx->remote_address));
+    return seastar::sleep(kHandlerTime).then([name = rec->name()->str()] {
+      smf::rpc_typed_envelope<smf_gen::demo::Response> data;
+      data.data->name = name;
+      data.envelope.set_status(200);
+      return seastar::make_ready_future<
+        smf::rpc_typed_envelope<smf_gen::demo::Response>>(std::move(data));
+    });
+  }
+};
+
+static void
+burst(pool_t &pool) {
+  peers.clear();
+  std::vector<seastar::future<
+    smf::rpc_recv_typed_context<smf_gen::demo::Response>>>
+    replies;
+  for (auto i = 0u; i < kCalls; ++i) {
+    smf::rpc_typed_envelope<smf_gen::demo::Request> req;
+    req.data->name = "pooled";
+    replies.push_back(pool->Get(req.serialize_data()));
+  }
+  LOG_THROW_IF(pool.outstanding() != kCalls, "{} calls outstanding, sent {}",
+               pool.outstanding(), kCalls);
+  auto done = seastar::when_all(replies.begin(), replies.end()).get0();
+  for (auto &f : done) {
+    auto ret = f.get0();
+    LOG_THROW_IF(!ret, "Empty response from server");
+    LOG_THROW_IF(ret.ctx->status() != 200, "Bad status: {}",
+                 ret.ctx->status());
+    LOG_THROW_IF(ret->name()->str() != "pooled", "Bad reply: {}",
+                 ret->name()->str());
+  }
+}
+
+static void
+run(uint16_t port) {
+  smf::pooled_client_opts opts{};
+  opts.client.server_addr = seastar::ipv4_addr{"127.0.0.1", port};
+  opts.min_connections = 1;
+  opts.max_connections = kMaxConnections;
+  opts.grow_outstanding = 2;
+  opts.idle_timeout = kIdleTimeout;
+  opts.maintenance_interval = kIdleTimeout / 4;
+  pool_t pool(std::move(opts));
+  pool.connect().get();
+  LOG_THROW_IF(pool.size() != 1, "Pool of {} connections, expected 1",
+               pool.size());
+
+  // the first connection gets busy; another one opens meanwhile
+  burst(pool);
+  LOG_THROW_IF(pool.size() < 2, "Pool did not grow");
+  // now the calls are spread over the open connections
+  burst(pool);
+  LOG_THROW_IF(peers.size() < 2, "Calls went over {} connections",
+               peers.size());
+  LOG_THROW_IF(pool.size() > kMaxConnections, "Pool of {} connections",
+               pool.size());
+
+  seastar::sleep(kIdleTimeout * 3).get();
+  LOG_THROW_IF(pool.size() != 1, "Pool of {} idle connections, expected 1",
+               pool.size());
+  burst(pool);
+  pool.stop().get();
+}
+
+int
+main(int args, char **argv, char **env) {
+  seastar::distributed<smf::rpc_server> rpc;
+  seastar::app_template app;
+  smf::random rand;
+  uint16_t random_port =
+    smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+  return app.run(args, argv, [&]() -> seastar::future<int> {
+    seastar::engine().at_exit([&] { return rpc.stop(); });
+    smf::rpc_server_args sargs;
+    sargs.ip = "127.0.0.1";
+    sargs.rpc_port = random_port;
+    sargs.http_port =
+      smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+    sargs.flags |= smf::rpc_server_flags::rpc_server_flags_disable_http_server;
+
+    return rpc.start(sargs)
+      .then([&rpc] {
+        return rpc.invoke_on_all(
+          &smf::rpc_server::register_service<storage_service>);
+      })
+      .then([&rpc] { return rpc.invoke_on_all(&smf::rpc_server::start); })
+      .then([&] { return seastar::async([&] { run(random_port); }); })
+      .then([] { return seastar::make_ready_future<int>(0); });
+  });
+}
@@ -0,0 +1,121 @@
+// Copyright 2019 SMF Authors
+//
+// std
+#include <chrono>
+#include <iostream>
+#include <vector>
+// seastar
+#include <seastar/core/app-template.hh>
+#include <seastar/core/distributed.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/core/when_all.hh>
+// smf
+#include "integration_tests/non_root_port.h"
+#include "smf/log.h"
+#include "smf/random.h"
+#include "smf/rpc_generated.h"
+#include "smf/rpc_server.h"
+
+// generated-templates
+#include "integration_tests/demo_service.smf.fb.h"
+
+// Search is declared with `(coalesce: "true")` in demo_service.fbs.
+//
+// Identical requests sent while the handler runs share its one execution;
+// every caller still gets the reply on its own session. Requests sent after
+// it finished, or with another payload, run it again.
+//
+using namespace std::chrono_literals;  // NOLINT
+constexpr const auto kHandlerTime = 200ms;
+constexpr const uint32_t kConcurrent = 10;
+
+static uint32_t handler_calls = 0;
+
+class storage_service final : public smf_gen::demo::SmfStorage {
+  virtual seastar::future<smf::rpc_typed_envelope<smf_gen::demo::Response>>
+  Search(smf::rpc_recv_typed_context<smf_gen::demo::Request> &&rec) final {
+    ++handler_calls;
+    return seastar::sleep(kHandlerTime).then([name = rec->name()->str()] {
+      smf::rpc_typed_envelope<smf_gen::demo::Response> data;
+      data.data->name = name;
+      data.envelope.set_status(200);
+      return seastar::make_ready_future<
+        smf::rpc_typed_envelope<smf_gen::demo::Response>>(std::move(data));
+    });
+  }
+};
+
+static smf::rpc_envelope
+make_request(const char *name) {
+  smf::rpc_typed_envelope<smf_gen::demo::Request> req;
+  req.data->name = name;
+  return req.serialize_data();
+}
+
+/// \brief sends `names` all at once; the replies must match them in order
+static void
+search(smf_gen::demo::SmfStorageClient &c,
+       const std::vector<const char *> &names, uint32_t calls) {
+  std::vector<seastar::future<
+    smf::rpc_recv_typed_context<smf_gen::demo::Response>>>
+    replies;
+  for (auto name : names) { replies.push_back(c.Search(make_request(name))); }
+  auto done = seastar::when_all(replies.begin(), replies.end()).get0();
+  for (auto i = 0u; i < done.size(); ++i) {
+    auto ret = done[i].get0();
+    LOG_THROW_IF(!ret, "Empty response from server");
+    LOG_THROW_IF(ret.ctx->status() != 200, "Bad status: {}",
+                 ret.ctx->status());
+    LOG_THROW_IF(ret->name()->str() != names[i],
+                 "Reply for another request: {}, expected {}",
+                 ret->name()->str(), names[i]);
+  }
+  LOG_THROW_IF(handler_calls != calls, "Handler ran {} times, expected {}",
+               handler_calls, calls);
+}
+
+static void
+run(uint16_t port) {
+  smf::rpc_client_opts opts{};
+  opts.server_addr = seastar::ipv4_addr{"127.0.0.1", port};
+  smf_gen::demo::SmfStorageClient client(std::move(opts));
+  client.connect().get();
+  search(client, std::vector<const char *>(kConcurrent, "hot"), 1);
+  // the previous run is over; nothing to join
+  search(client, {"hot"}, 2);
+  std::vector<const char *> mixed;
+  for (auto i = 0u; i < kConcurrent; ++i) {
+    mixed.push_back(i % 2 ? "odd" : "even");
+  }
+  search(client, mixed, 4);
+  client.stop().get();
+}
+
+int
+main(int args, char **argv, char **env) {
+  seastar::distributed<smf::rpc_server> rpc;
+  seastar::app_template app;
+  smf::random rand;
+  uint16_t random_port =
+    smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+  return app.run(args, argv, [&]() -> seastar::future<int> {
+    seastar::engine().at_exit([&] { return rpc.stop(); });
+    smf::rpc_server_args sargs;
+    sargs.ip = "127.0.0.1";
+    sargs.rpc_port = random_port;
+    sargs.http_port =
+      smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+    sargs.flags |= smf::rpc_server_flags::rpc_server_flags_disable_http_server;
+
+    return rpc.start(sargs)
+      .then([&rpc] {
+        return rpc.invoke_on_all(
+          &smf::rpc_server::register_service<storage_service>);
+      })
+      .then([&rpc] { return rpc.invoke_on_all(&smf::rpc_server::start); })
+      .then([&] { return seastar::async([&] { run(random_port); }); })
+      .then([] { return seastar::make_ready_future<int>(0); });
+  });
+}
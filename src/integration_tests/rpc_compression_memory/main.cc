@@ -0,0 +1,152 @@
+// Copyright 2019 SMF Authors
+//
+// std
+#include <chrono>
+#include <iostream>
+#include <vector>
+// seastar
+#include <seastar/core/app-template.hh>
+#include <seastar/core/distributed.hh>
+#include <seastar/core/memory.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/net/api.hh>
+// smf
+#include "integration_tests/non_root_port.h"
+#include "smf/human_bytes.h"
+#include "smf/log.h"
+#include "smf/lz4_filter.h"
+#include "smf/random.h"
+#include "smf/rpc_generated.h"
+#include "smf/rpc_server.h"
+#include "smf/zstd_filter.h"
+
+// generated-templates
+#include "integration_tests/demo_service.smf.fb.h"
+
+// Incompressible payloads are the worst case for the compression filters:
+// the output is slightly *larger* than the input and the codec needs a
+// `*_compressBound()` sized scratch area. This test holds a queue worth of
+// compressed envelopes - as the server output stream would - and checks that
+// the memory retained is close to the wire size, not the compress bound.
+//
+constexpr const uint32_t kPayloadSize = 1 << 20;
+constexpr const uint32_t kQueuedEnvelopes = 32;
+// lz4 & zstd worst case expansion for 1MB is well under 1%
+constexpr const double kMaxOverheadRatio = 1.05;
+
+class storage_service final : public smf_gen::demo::SmfStorage {
+  virtual seastar::future<smf::rpc_typed_envelope<smf_gen::demo::Response>>
+  Get(smf::rpc_recv_typed_context<smf_gen::demo::Request> &&rec) final {
+    smf::rpc_typed_envelope<smf_gen::demo::Response> data;
+    if (rec) { data.data->name = rec->name()->c_str(); }
+    data.envelope.set_status(200);
+    return seastar::make_ready_future<
+      smf::rpc_typed_envelope<smf_gen::demo::Response>>(std::move(data));
+  }
+};
+
+static smf::rpc_envelope
+incompressible_envelope(smf::random &r) {
+  smf::rpc_typed_envelope<smf_gen::demo::Request> req;
+  req.data->name = r.next_str(kPayloadSize);
+  return req.serialize_data();
+}
+
+template <typename Filter>
+static seastar::future<>
+measure_queued_memory(const char *name) {
+  return seastar::do_with(
+    std::vector<smf::rpc_envelope>{}, smf::random{},
+    [name](std::vector<smf::rpc_envelope> &queue, smf::random &r) {
+      queue.reserve(kQueuedEnvelopes);
+      std::vector<smf::rpc_envelope> plain;
+      plain.reserve(kQueuedEnvelopes);
+      const auto before = seastar::memory::stats().allocated_memory();
+      for (auto i = 0u; i < kQueuedEnvelopes; ++i) {
+        plain.push_back(incompressible_envelope(r));
+      }
+      uint64_t wire_bytes = 0;
+      for (auto &e : plain) {
+        auto out = Filter(1024)(std::move(e)).get0();
+        wire_bytes += out.letter.body.size();
+        queue.push_back(std::move(out));
+      }
+      // the filter replaced every uncompressed body; what is still
+      // allocated is the compressed queue
+      plain.clear();
+      const auto after = seastar::memory::stats().allocated_memory();
+      const auto retained = after > before ? after - before : 0;
+      LOG_INFO("{}: queued {} envelopes, wire: {}, retained: {}, ratio: {}",
+               name, queue.size(), smf::human_bytes(wire_bytes),
+               smf::human_bytes(retained),
+               static_cast<double>(retained) / wire_bytes);
+      LOG_THROW_IF(retained > kMaxOverheadRatio * wire_bytes,
+                   "{} retained {} for {} on the wire", name, retained,
+                   wire_bytes);
+      return seastar::make_ready_future<>();
+    });
+}
+
+static seastar::future<>
+round_trip(uint16_t port) {
+  smf::rpc_client_opts opts{};
+  opts.server_addr = seastar::ipv4_addr{"127.0.0.1", port};
+  auto client =
+    seastar::make_shared<smf_gen::demo::SmfStorageClient>(std::move(opts));
+  client->incoming_filters().push_back(smf::lz4_decompression_filter());
+  client->outgoing_filters().push_back(smf::lz4_compression_filter(1024));
+  return client->connect()
+    .then([client] {
+      smf::random r;
+      return client->Get(incompressible_envelope(r)).then([](auto ret) {
+        LOG_THROW_IF(!ret, "Empty response from server");
+        LOG_THROW_IF(ret.ctx->status() != 200, "Bad status: {}",
+                     ret.ctx->status());
+        LOG_THROW_IF(ret->name()->size() != kPayloadSize,
+                     "Payload did not survive the round trip");
+        return seastar::make_ready_future<>();
+      });
+    })
+    .finally([client] { return client->stop().finally([client] {}); });
+}
+
+int
+main(int args, char **argv, char **env) {
+  seastar::distributed<smf::rpc_server> rpc;
+  seastar::app_template app;
+  smf::random rand;
+  uint16_t random_port =
+    smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+  return app.run(args, argv, [&]() -> seastar::future<int> {
+    seastar::engine().at_exit([&] { return rpc.stop(); });
+    smf::rpc_server_args sargs;
+    sargs.ip = "127.0.0.1";
+    sargs.rpc_port = random_port;
+    sargs.http_port =
+      smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+    sargs.flags |= smf::rpc_server_flags::rpc_server_flags_disable_http_server;
+
+    return measure_queued_memory<smf::lz4_compression_filter>("lz4")
+      .then([] {
+        return measure_queued_memory<smf::zstd_compression_filter>("zstd");
+      })
+      .then([&rpc, sargs] { return rpc.start(sargs); })
+      .then([&rpc] {
+        return rpc.invoke_on_all(
+          &smf::rpc_server::register_service<storage_service>);
+      })
+      .then([&rpc] {
+        return rpc.invoke_on_all(&smf::rpc_server::register_incoming_filter<
+                                 smf::lz4_decompression_filter>);
+      })
+      .then([&rpc] {
+        return rpc.invoke_on_all([](smf::rpc_server &s) {
+          s.register_outgoing_filter<smf::lz4_compression_filter>(1024);
+        });
+      })
+      .then([&rpc] { return rpc.invoke_on_all(&smf::rpc_server::start); })
+      .then([&] { return round_trip(random_port); })
+      .then([] { return seastar::make_ready_future<int>(0); });
+  });
+}
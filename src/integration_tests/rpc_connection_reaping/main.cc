@@ -0,0 +1,145 @@
+// Copyright 2019 SMF Authors
+//
+// std
+#include <chrono>
+#include <iostream>
+#include <vector>
+// seastar
+#include <seastar/core/app-template.hh>
+#include <seastar/core/distributed.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/net/api.hh>
+// smf
+#include "integration_tests/non_root_port.h"
+#include "smf/log.h"
+#include "smf/random.h"
+#include "smf/rpc_generated.h"
+#include "smf/rpc_server.h"
+
+// generated-templates
+#include "integration_tests/demo_service.smf.fb.h"
+
+// With room for two connections, a third one is closed on accept. Once the
+// first two sit idle past the timeout the server closes them as well, and
+// a new client gets in.
+//
+using namespace std::chrono_literals;  // NOLINT
+constexpr const auto kIdleTimeout = 200ms;
+constexpr const uint32_t kMaxConnections = 2;
+
+class storage_service final : public smf_gen::demo::SmfStorage {
+  virtual seastar::future<smf::rpc_typed_envelope<smf_gen::demo::Response>>
+  Get(smf::rpc_recv_typed_context<smf_gen::demo::Request> &&rec) final {
+    smf::rpc_typed_envelope<smf_gen::demo::Response> data;
+    data.envelope.set_status(200);
+    return seastar::make_ready_future<
+      smf::rpc_typed_envelope<smf_gen::demo::Response>>(std::move(data));
+  }
+};
+
+using client_t = seastar::shared_ptr<smf_gen::demo::SmfStorageClient>;
+
+static smf::rpc_envelope
+make_request() {
+  smf::rpc_typed_envelope<smf_gen::demo::Request> req;
+  req.data->name = "reaping";
+  return req.serialize_data();
+}
+
+static seastar::future<client_t>
+connect(uint16_t port) {
+  smf::rpc_client_opts opts{};
+  opts.server_addr = seastar::ipv4_addr{"127.0.0.1", port};
+  auto client =
+    seastar::make_shared<smf_gen::demo::SmfStorageClient>(std::move(opts));
+  return client->connect().then([client] { return client; });
+}
+
+static seastar::future<>
+expect_ok(client_t c) {
+  return c->Get(make_request()).then([](auto ret) {
+    LOG_THROW_IF(!ret, "Empty response from server");
+    LOG_THROW_IF(ret.ctx->status() != 200, "Bad status: {}",
+                 ret.ctx->status());
+  });
+}
+
+static seastar::future<>
+expect_closed(client_t c) {
+  return c->Get(make_request()).then_wrapped([](auto f) {
+    LOG_THROW_IF(!f.failed(), "Request over a closed connection succeeded");
+    f.ignore_ready_future();
+  });
+}
+
+static seastar::future<>
+stop_all(std::vector<client_t> clients) {
+  return seastar::do_with(std::move(clients), [](auto &cs) {
+    return seastar::do_for_each(cs, [](client_t c) {
+      return c->stop().finally([c] {});
+    });
+  });
+}
+
+static seastar::future<>
+run(uint16_t port) {
+  return seastar::do_with(std::vector<client_t>{}, [port](auto &clients) {
+    return connect(port)
+      .then([&clients, port](client_t c) {
+        clients.push_back(c);
+        return expect_ok(c).then([port] { return connect(port); });
+      })
+      .then([&clients, port](client_t c) {
+        clients.push_back(c);
+        return expect_ok(c).then([port] { return connect(port); });
+      })
+      .then([&clients](client_t c) {
+        clients.push_back(c);
+        LOG_INFO("Expecting connection over the limit to be closed");
+        return expect_closed(c);
+      })
+      .then([] { return seastar::sleep(kIdleTimeout * 3); })
+      .then([&clients, port] {
+        for (auto i = 0u; i < kMaxConnections; ++i) {
+          LOG_THROW_IF(clients[i]->is_conn_valid(),
+                       "Idle connection {} was not closed", i);
+        }
+        return connect(port);
+      })
+      .then([&clients](client_t c) {
+        clients.push_back(c);
+        return expect_ok(c);
+      })
+      .finally([&clients] { return stop_all(std::move(clients)); });
+  });
+}
+
+int
+main(int args, char **argv, char **env) {
+  seastar::distributed<smf::rpc_server> rpc;
+  seastar::app_template app;
+  smf::random rand;
+  uint16_t random_port =
+    smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+  return app.run(args, argv, [&]() -> seastar::future<int> {
+    seastar::engine().at_exit([&] { return rpc.stop(); });
+    smf::rpc_server_args sargs;
+    sargs.ip = "127.0.0.1";
+    sargs.rpc_port = random_port;
+    sargs.http_port =
+      smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+    sargs.flags |= smf::rpc_server_flags::rpc_server_flags_disable_http_server;
+    sargs.idle_timeout = kIdleTimeout;
+    sargs.max_connections_per_core = kMaxConnections;
+
+    return rpc.start(sargs)
+      .then([&rpc] {
+        return rpc.invoke_on_all(
+          &smf::rpc_server::register_service<storage_service>);
+      })
+      .then([&rpc] { return rpc.invoke_on_all(&smf::rpc_server::start); })
+      .then([&] { return run(random_port); })
+      .then([] { return seastar::make_ready_future<int>(0); });
+  });
+}
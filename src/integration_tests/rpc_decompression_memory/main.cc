@@ -0,0 +1,111 @@
+// Copyright 2019 SMF Authors
+//
+// std
+#include <iostream>
+// seastar
+#include <seastar/core/app-template.hh>
+#include <seastar/core/distributed.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/net/api.hh>
+// smf
+#include "integration_tests/non_root_port.h"
+#include "smf/log.h"
+#include "smf/random.h"
+#include "smf/rpc_generated.h"
+#include "smf/rpc_server.h"
+#include "smf/zstd_filter.h"
+
+// generated-templates
+#include "integration_tests/demo_service.smf.fb.h"
+
+// A zstd frame of a few KB that declares 64MB must be rejected with a 413
+// *before* the server allocates the 64MB, since the core budget is 8MB.
+// Frames that fit the budget still decompress, and the connection survives
+// the rejection.
+//
+constexpr const uint64_t kCoreMemory = 8 << 20;
+constexpr const uint32_t kBombSize = 64 << 20;
+constexpr const uint32_t kFitSize = 1 << 20;
+
+class storage_service final : public smf_gen::demo::SmfStorage {
+  virtual seastar::future<smf::rpc_typed_envelope<smf_gen::demo::Response>>
+  Get(smf::rpc_recv_typed_context<smf_gen::demo::Request> &&rec) final {
+    smf::rpc_typed_envelope<smf_gen::demo::Response> data;
+    data.data->name = seastar::to_sstring(rec->name()->size());
+    data.envelope.set_status(200);
+    return seastar::make_ready_future<
+      smf::rpc_typed_envelope<smf_gen::demo::Response>>(std::move(data));
+  }
+};
+
+static smf::rpc_envelope
+compressed_request(uint32_t size) {
+  smf::rpc_typed_envelope<smf_gen::demo::Request> req;
+  req.data->name = seastar::sstring(size, 'x');
+  return smf::zstd_compression_filter(1024)(req.serialize_data()).get0();
+}
+
+static seastar::future<>
+run(uint16_t port) {
+  smf::rpc_client_opts opts{};
+  opts.server_addr = seastar::ipv4_addr{"127.0.0.1", port};
+  auto client =
+    seastar::make_shared<smf_gen::demo::SmfStorageClient>(std::move(opts));
+  return client->connect()
+    .then([client] {
+      auto e = compressed_request(kBombSize);
+      LOG_INFO("Sending a {} frame that declares {}",
+               smf::human_bytes(e.letter.body.size()),
+               smf::human_bytes(kBombSize));
+      return client->Get(std::move(e)).then([](auto ret) {
+        LOG_THROW_IF(!ret.ctx, "Empty response from server");
+        LOG_THROW_IF(!ret.ctx->is_error_reply(), "Bomb was decompressed");
+        LOG_THROW_IF(ret.ctx->status() != 413, "Bad status: {}",
+                     ret.ctx->status());
+      });
+    })
+    .then([client] {
+      return client->Get(compressed_request(kFitSize)).then([](auto ret) {
+        LOG_THROW_IF(!ret, "Empty response from server");
+        LOG_THROW_IF(ret.ctx->status() != 200, "Bad status: {}",
+                     ret.ctx->status());
+        LOG_THROW_IF(ret->name()->str() != seastar::to_sstring(kFitSize),
+                     "Bad decompressed size: {}", ret->name()->str());
+      });
+    })
+    .finally([client] { return client->stop().finally([client] {}); });
+}
+
+int
+main(int args, char **argv, char **env) {
+  seastar::distributed<smf::rpc_server> rpc;
+  seastar::app_template app;
+  smf::random rand;
+  uint16_t random_port =
+    smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+  return app.run(args, argv, [&]() -> seastar::future<int> {
+    seastar::engine().at_exit([&] { return rpc.stop(); });
+    smf::rpc_server_args sargs;
+    sargs.ip = "127.0.0.1";
+    sargs.rpc_port = random_port;
+    sargs.http_port =
+      smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+    sargs.flags |= smf::rpc_server_flags::rpc_server_flags_disable_http_server;
+    sargs.memory_avail_per_core = kCoreMemory;
+
+    return rpc.start(sargs)
+      .then([&rpc] {
+        return rpc.invoke_on_all(
+          &smf::rpc_server::register_service<storage_service>);
+      })
+      .then([&rpc] {
+        using zstd_t = smf::zstd_decompression_filter;
+        return rpc.invoke_on_all(
+          &smf::rpc_server::register_incoming_filter<zstd_t>);
+      })
+      .then([&rpc] { return rpc.invoke_on_all(&smf::rpc_server::start); })
+      .then([&] { return run(random_port); })
+      .then([] { return seastar::make_ready_future<int>(0); });
+  });
+}
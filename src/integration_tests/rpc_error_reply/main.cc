@@ -0,0 +1,161 @@
+// Copyright 2019 SMF Authors
+//
+// std
+#include <iostream>
+#include <stdexcept>
+#include <tuple>
+// seastar
+#include <seastar/core/app-template.hh>
+#include <seastar/core/distributed.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/when_all.hh>
+#include <seastar/net/api.hh>
+// smf
+#include "integration_tests/non_root_port.h"
+#include "smf/log.h"
+#include "smf/random.h"
+#include "smf/rpc_generated.h"
+#include "smf/rpc_server.h"
+
+// generated-templates
+#include "integration_tests/demo_service.smf.fb.h"
+
+// Request scoped failures are answered with an rpc::error_reply and must
+// not take down the connection: every request below goes over the same
+// client, and a good request sent alongside a bad one still succeeds.
+//
+using response_t = smf::rpc_recv_typed_context<smf_gen::demo::Response>;
+
+class storage_service final : public smf_gen::demo::SmfStorage {
+  virtual seastar::future<smf::rpc_typed_envelope<smf_gen::demo::Response>>
+  Get(smf::rpc_recv_typed_context<smf_gen::demo::Request> &&rec) final {
+    using ret_t = smf::rpc_typed_envelope<smf_gen::demo::Response>;
+    if (rec->name()->str() == "throw") {
+      throw std::runtime_error("Handler threw");
+    }
+    if (rec->name()->str() == "fail") {
+      return seastar::make_exception_future<ret_t>(
+        std::runtime_error("Handler failed"));
+    }
+    smf::rpc_typed_envelope<smf_gen::demo::Response> data;
+    data.data->name = rec->name()->str();
+    data.envelope.set_status(200);
+    return seastar::make_ready_future<
+      smf::rpc_typed_envelope<smf_gen::demo::Response>>(std::move(data));
+  }
+};
+
+static smf::rpc_envelope
+make_request(const char *name = "error_reply") {
+  smf::rpc_typed_envelope<smf_gen::demo::Request> req;
+  req.data->name = name;
+  return req.serialize_data();
+}
+
+static void
+check_error(response_t &ret, uint32_t status) {
+  LOG_THROW_IF(!ret.ctx, "Empty response from server");
+  LOG_THROW_IF(!ret.ctx->is_error_reply(), "Expected an error reply");
+  LOG_THROW_IF(ret, "Error reply tests true, as if it had a response");
+  LOG_THROW_IF(ret.ctx->status() != status, "Expected status: {}, got: {}",
+               status, ret.ctx->status());
+  auto reason = ret.ctx->error_reason();
+  LOG_THROW_IF(!reason || reason->empty(), "Error reply without a reason");
+  LOG_THROW_IF(ret.verify_fbs(), "Error reply parsed as the response type");
+}
+
+static void
+check_ok(response_t &ret) {
+  LOG_THROW_IF(!ret, "Empty response from server");
+  LOG_THROW_IF(ret.ctx->is_error_reply(), "Unexpected error reply: {}",
+               ret.ctx->error_reason().value_or("?"));
+  LOG_THROW_IF(ret.ctx->status() != 200, "Bad status: {}", ret.ctx->status());
+}
+
+static seastar::future<>
+run(uint16_t port) {
+  smf::rpc_client_opts opts{};
+  opts.server_addr = seastar::ipv4_addr{"127.0.0.1", port};
+  auto client =
+    seastar::make_shared<smf_gen::demo::SmfStorageClient>(std::move(opts));
+  return client->connect()
+    .then([client] {
+      // no request id
+      return client->send<smf_gen::demo::Response>(make_request())
+        .then([](auto ret) { check_error(ret, 400); });
+    })
+    .then([client] {
+      // no such method
+      auto e = make_request();
+      e.set_request_id(42);
+      return client->send<smf_gen::demo::Response>(std::move(e))
+        .then([](auto ret) { check_error(ret, 404); });
+    })
+    .then([client] {
+      // the server has no decompression filter
+      auto e = make_request();
+      e.letter.header.mutate_compression(
+        smf::rpc::compression_flags::compression_flags_lz4);
+      return client->Get(std::move(e)).then([](auto ret) {
+        check_error(ret, 415);
+      });
+    })
+    .then([client] {
+      // the handler throws
+      return client->Get(make_request("throw")).then([](auto ret) {
+        check_error(ret, 500);
+      });
+    })
+    .then([client] {
+      // the handler returns a failed future
+      return client->Get(make_request("fail")).then([](auto ret) {
+        check_error(ret, 500);
+      });
+    })
+    .then([client] {
+      // in flight alongside a bad request
+      auto bad = make_request();
+      bad.set_request_id(42);
+      return seastar::when_all_succeed(
+               client->send<smf_gen::demo::Response>(std::move(bad)),
+               client->Get(make_request()))
+        .then([](response_t bad_ret, response_t good_ret) {
+          check_error(bad_ret, 404);
+          check_ok(good_ret);
+        });
+    })
+    .then([client] {
+      LOG_THROW_IF(!client->is_conn_valid(), "Connection was closed");
+      return client->Get(make_request()).then([](auto ret) {
+        check_ok(ret);
+      });
+    })
+    .finally([client] { return client->stop().finally([client] {}); });
+}
+
+int
+main(int args, char **argv, char **env) {
+  seastar::distributed<smf::rpc_server> rpc;
+  seastar::app_template app;
+  smf::random rand;
+  uint16_t random_port =
+    smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+  return app.run(args, argv, [&]() -> seastar::future<int> {
+    seastar::engine().at_exit([&] { return rpc.stop(); });
+    smf::rpc_server_args sargs;
+    sargs.ip = "127.0.0.1";
+    sargs.rpc_port = random_port;
+    sargs.http_port =
+      smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+    sargs.flags |= smf::rpc_server_flags::rpc_server_flags_disable_http_server;
+
+    return rpc.start(sargs)
+      .then([&rpc] {
+        return rpc.invoke_on_all(
+          &smf::rpc_server::register_service<storage_service>);
+      })
+      .then([&rpc] { return rpc.invoke_on_all(&smf::rpc_server::start); })
+      .then([&] { return run(random_port); })
+      .then([] { return seastar::make_ready_future<int>(0); });
+  });
+}
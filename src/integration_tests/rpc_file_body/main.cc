@@ -0,0 +1,161 @@
+// Copyright 2019 SMF Authors
+//
+// std
+#include <chrono>
+#include <iostream>
+// seastar
+#include <seastar/core/align.hh>
+#include <seastar/core/app-template.hh>
+#include <seastar/core/distributed.hh>
+#include <seastar/core/file.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/net/api.hh>
+// smf
+#include "integration_tests/non_root_port.h"
+#include "smf/crc32c.h"
+#include "smf/log.h"
+#include "smf/random.h"
+#include "smf/rpc_generated.h"
+#include "smf/rpc_header_utils.h"
+#include "smf/rpc_server.h"
+
+// generated-templates
+#include "integration_tests/demo_service.smf.fb.h"
+
+// Replies whose tail is a range of an immutable segment file. The range is
+// streamed from disk in rpc_envelope::kFileChunkSize chunks. Unaligned on
+// purpose, and larger than a chunk.
+//
+static const char *kSegmentFile = "rpc_file_body.segment";
+constexpr const uint64_t kFileSize = 4 << 20;
+constexpr const uint64_t kRangeOffset = 100;
+constexpr const uint64_t kRangeSize = kFileSize - 2 * kRangeOffset - 7;
+
+static char
+segment_byte(uint64_t i) {
+  return static_cast<char>((i * 31 + 7) & 0xff);
+}
+
+static seastar::future<seastar::file>
+write_segment() {
+  auto flags = seastar::open_flags::rw | seastar::open_flags::create |
+               seastar::open_flags::truncate;
+  return seastar::open_file_dma(kSegmentFile, flags).then([](auto f) {
+    auto buf = seastar::allocate_aligned_buffer<char>(kFileSize, 4096);
+    for (uint64_t i = 0; i < kFileSize; ++i) {
+      buf.get()[i] = segment_byte(i);
+    }
+    auto ptr = buf.get();
+    return f.dma_write(0, ptr, kFileSize)
+      .then([f, buf = std::move(buf)](size_t written) mutable {
+        LOG_THROW_IF(written != kFileSize, "Short write: {}", written);
+        return f.flush().then([f]() mutable { return f; });
+      });
+  });
+}
+
+/// \brief as if it was stored next to the segment
+static uint32_t
+range_crc32c() {
+  seastar::temporary_buffer<char> buf(kRangeSize);
+  for (uint64_t i = 0; i < kRangeSize; ++i) {
+    buf.get_write()[i] = segment_byte(kRangeOffset + i);
+  }
+  return smf::crc32c(buf.get(), buf.size());
+}
+
+class storage_service final : public smf_gen::demo::SmfStorage {
+ public:
+  explicit storage_service(seastar::file f) : segment_(std::move(f)) {}
+
+ private:
+  virtual seastar::future<smf::rpc_typed_envelope<smf_gen::demo::Response>>
+  Get(smf::rpc_recv_typed_context<smf_gen::demo::Request> &&rec) final {
+    smf::rpc_typed_envelope<smf_gen::demo::Response> data;
+    data.data->name = seastar::to_sstring(kRangeSize);
+    smf::rpc_file_range range;
+    range.file = segment_;
+    range.offset = kRangeOffset;
+    range.size = kRangeSize;
+    // only used for crc32c replies; the others read the range twice
+    range.checksum = crc_;
+    range.checksum_algorithm = smf::checksum_type::crc32c;
+    data.envelope.set_file_range(std::move(range));
+    data.envelope.set_status(200);
+    return seastar::make_ready_future<
+      smf::rpc_typed_envelope<smf_gen::demo::Response>>(std::move(data));
+  }
+
+  seastar::file segment_;
+  const uint32_t crc_ = range_crc32c();
+};
+
+static seastar::future<>
+round_trip(uint16_t port, smf::checksum_type checksum) {
+  smf::rpc_client_opts opts{};
+  opts.server_addr = seastar::ipv4_addr{"127.0.0.1", port};
+  opts.checksum = checksum;
+  auto client =
+    seastar::make_shared<smf_gen::demo::SmfStorageClient>(std::move(opts));
+  return client->connect()
+    .then([client] {
+      smf::rpc_typed_envelope<smf_gen::demo::Request> req;
+      req.data->name = "segment";
+      return client->Get(req.serialize_data()).then([](auto ret) {
+        LOG_THROW_IF(!ret, "Empty response from server");
+        LOG_THROW_IF(ret.ctx->status() != 200, "Bad status: {}",
+                     ret.ctx->status());
+        LOG_THROW_IF(!ret.verify_fbs(), "Reply flatbuffer did not verify");
+        const uint64_t sz = std::stoull(ret->name()->str());
+        auto &payload = ret.ctx->payload;
+        auto tail = ret.ctx->payload_slice(payload.size() - sz, sz);
+        LOG_THROW_IF(!tail, "Reply is missing the file range");
+        for (uint64_t i = 0; i < sz; ++i) {
+          LOG_THROW_IF((*tail)[i] != segment_byte(kRangeOffset + i),
+                       "File range corrupted at byte: {}", i);
+        }
+        return seastar::make_ready_future<>();
+      });
+    })
+    .finally([client] { return client->stop().finally([client] {}); });
+}
+
+int
+main(int args, char **argv, char **env) {
+  seastar::distributed<smf::rpc_server> rpc;
+  seastar::app_template app;
+  smf::random rand;
+  uint16_t random_port =
+    smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+  return app.run(args, argv, [&]() -> seastar::future<int> {
+    seastar::engine().at_exit([&] { return rpc.stop(); });
+    smf::rpc_server_args sargs;
+    sargs.ip = "127.0.0.1";
+    sargs.rpc_port = random_port;
+    sargs.http_port =
+      smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+    sargs.flags |= smf::rpc_server_flags::rpc_server_flags_disable_http_server;
+    // smaller than the file; the range must still stream through
+    sargs.memory_avail_per_core = kFileSize / 2;
+
+    return write_segment().then([&rpc, sargs, random_port](seastar::file f) {
+      return rpc.start(sargs)
+        .then([&rpc, f] {
+          return rpc.invoke_on_all([f](smf::rpc_server &s) {
+            s.register_service<storage_service>(f);
+          });
+        })
+        .then([&rpc] { return rpc.invoke_on_all(&smf::rpc_server::start); })
+        .then([random_port] {
+          // checksum computed by reading the range once more
+          return round_trip(random_port, smf::checksum_type::xxhash64);
+        })
+        .then([random_port] {
+          // precomputed crc32c of the range, combined with the body's
+          return round_trip(random_port, smf::checksum_type::crc32c);
+        })
+        .then([] { return seastar::make_ready_future<int>(0); });
+    });
+  });
+}
@@ -0,0 +1,160 @@
+// Copyright 2019 SMF Authors
+//
+// std
+#include <chrono>
+#include <iostream>
+// seastar
+#include <seastar/core/app-template.hh>
+#include <seastar/core/distributed.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/net/api.hh>
+// smf
+#include "integration_tests/non_root_port.h"
+#include "smf/log.h"
+#include "smf/random.h"
+#include "smf/rpc_generated.h"
+#include "smf/rpc_header_utils.h"
+#include "smf/rpc_server.h"
+
+// generated-templates
+#include "integration_tests/demo_service.smf.fb.h"
+
+// A reply made of a small flatbuffer plus a large blob the server already
+// holds in memory - i.e.: a cache value in slab memory. The blob is sent as
+// a shared fragment, never copied into the flatbuffer. The flatbuffer only
+// carries the blob size; the blob is the tail of the payload.
+//
+constexpr const uint32_t kBlobSize = 1 << 20;
+
+static char
+blob_byte(size_t i) {
+  return static_cast<char>((i * 31 + 7) & 0xff);
+}
+
+static seastar::temporary_buffer<char>
+make_blob() {
+  seastar::temporary_buffer<char> b(kBlobSize);
+  for (size_t i = 0; i < b.size(); ++i) {
+    b.get_write()[i] = blob_byte(i);
+  }
+  return b;
+}
+
+static bool
+is_blob(const seastar::temporary_buffer<char> &b) {
+  if (b.size() != kBlobSize) { return false; }
+  for (size_t i = 0; i < b.size(); ++i) {
+    if (b[i] != blob_byte(i)) { return false; }
+  }
+  return true;
+}
+
+class storage_service final : public smf_gen::demo::SmfStorage {
+  // stands in for the slab memory of a cache
+  seastar::temporary_buffer<char> blob_ = make_blob();
+
+  virtual seastar::future<smf::rpc_typed_envelope<smf_gen::demo::Response>>
+  Get(smf::rpc_recv_typed_context<smf_gen::demo::Request> &&rec) final {
+    smf::rpc_typed_envelope<smf_gen::demo::Response> data;
+    LOG_THROW_IF(!rec, "Bad request");
+    // the request is fragmented too; it arrives contiguous
+    auto &payload = rec.ctx->payload;
+    auto tail = rec.ctx->payload_slice(payload.size() - kBlobSize, kBlobSize);
+    LOG_THROW_IF(!tail, "Request is missing its trailing blob");
+    LOG_THROW_IF(!is_blob(*tail), "Request blob was corrupted");
+    data.data->name = seastar::to_sstring(kBlobSize);
+    data.envelope.letter.append_fragment(blob_.share());
+    data.envelope.set_status(200);
+    return seastar::make_ready_future<
+      smf::rpc_typed_envelope<smf_gen::demo::Response>>(std::move(data));
+  }
+};
+
+static void
+check_reply(smf::rpc_recv_typed_context<smf_gen::demo::Response> &ret) {
+  LOG_THROW_IF(!ret, "Empty response from server");
+  LOG_THROW_IF(ret.ctx->status() != 200, "Bad status: {}", ret.ctx->status());
+  LOG_THROW_IF(!ret.verify_fbs(), "Reply flatbuffer did not verify");
+  const uint32_t sz = std::stoul(ret->name()->str());
+  auto &payload = ret.ctx->payload;
+  auto tail = ret.ctx->payload_slice(payload.size() - sz, sz);
+  LOG_THROW_IF(!tail, "Reply is missing its trailing blob");
+  LOG_THROW_IF(!is_blob(*tail), "Reply blob was corrupted");
+  LOG_THROW_IF(ret.ctx->payload_slice(payload.size(), 1),
+               "Out of bounds slice must be rejected");
+}
+
+static seastar::future<>
+round_trip(uint16_t port, smf::checksum_type checksum) {
+  smf::rpc_client_opts opts{};
+  opts.server_addr = seastar::ipv4_addr{"127.0.0.1", port};
+  opts.checksum = checksum;
+  auto client =
+    seastar::make_shared<smf_gen::demo::SmfStorageClient>(std::move(opts));
+  return client->connect()
+    .then([client] {
+      smf::rpc_typed_envelope<smf_gen::demo::Request> req;
+      req.data->name = "fragments";
+      auto e = req.serialize_data();
+      const auto offset = e.append_fragment(make_blob());
+      LOG_THROW_IF(offset + kBlobSize != e.letter.payload_size(),
+                   "Bad fragment offset: {}", offset);
+      return client->Get(std::move(e)).then([](auto ret) {
+        check_reply(ret);
+      });
+    })
+    .then([client] {
+      // no body at all, only fragments; switching the checksum algorithm
+      // must still checksum them
+      smf::rpc_typed_envelope<smf_gen::demo::Request> req;
+      req.data->name = "fragments";
+      auto serialized = req.serialize_data();
+      smf::rpc_envelope e;
+      e.append_fragment(std::move(serialized.letter.body));
+      e.append_fragment(make_blob());
+      LOG_THROW_IF(!e.letter.body.empty(), "Envelope must have no body");
+      return client->Get(std::move(e)).then([](auto ret) {
+        check_reply(ret);
+      });
+    })
+    .finally([client] { return client->stop().finally([client] {}); });
+}
+
+int
+main(int args, char **argv, char **env) {
+  seastar::distributed<smf::rpc_server> rpc;
+  seastar::app_template app;
+  smf::random rand;
+  uint16_t random_port =
+    smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+  return app.run(args, argv, [&]() -> seastar::future<int> {
+    seastar::engine().at_exit([&] { return rpc.stop(); });
+    smf::rpc_server_args sargs;
+    sargs.ip = "127.0.0.1";
+    sargs.rpc_port = random_port;
+    sargs.http_port =
+      smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+    sargs.flags |= smf::rpc_server_flags::rpc_server_flags_disable_http_server;
+
+    return rpc.start(sargs)
+      .then([&rpc] {
+        return rpc.invoke_on_all(
+          &smf::rpc_server::register_service<storage_service>);
+      })
+      .then([&rpc] { return rpc.invoke_on_all(&smf::rpc_server::start); })
+      .then([&] {
+        // the incremental checksum must match the receiver's one-shot
+        return round_trip(random_port, smf::checksum_type::xxhash64);
+      })
+      .then([&] {
+        if (!smf::rpc_checksum_supported(smf::checksum_type::xxh3)) {
+          return seastar::make_ready_future<>();
+        }
+        return round_trip(random_port, smf::checksum_type::xxh3);
+      })
+      .then(
+        [&] { return round_trip(random_port, smf::checksum_type::crc32c); })
+      .then([] { return seastar::make_ready_future<int>(0); });
+  });
+}
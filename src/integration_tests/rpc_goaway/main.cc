@@ -0,0 +1,114 @@
+// Copyright 2019 SMF Authors
+//
+// std
+#include <chrono>
+#include <iostream>
+#include <vector>
+// seastar
+#include <seastar/core/app-template.hh>
+#include <seastar/core/distributed.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/when_all.hh>
+#include <seastar/net/api.hh>
+// smf
+#include "integration_tests/non_root_port.h"
+#include "smf/log.h"
+#include "smf/random.h"
+#include "smf/rpc_generated.h"
+#include "smf/rpc_server.h"
+
+// generated-templates
+#include "integration_tests/demo_service.smf.fb.h"
+
+// Slow Get requests are in flight when the server starts draining. Every
+// one of them must still be answered on the old connection, and drain()
+// must resolve once the client let go of it - not at the end of the grace
+// period.
+//
+using namespace std::chrono_literals;  // NOLINT
+constexpr const uint32_t kRequests = 20;
+constexpr const auto kHandlerDelay = 200ms;
+constexpr const auto kGrace = 10s;
+
+class storage_service final : public smf_gen::demo::SmfStorage {
+  virtual seastar::future<smf::rpc_typed_envelope<smf_gen::demo::Response>>
+  Get(smf::rpc_recv_typed_context<smf_gen::demo::Request> &&rec) final {
+    return seastar::sleep(kHandlerDelay).then([] {
+      smf::rpc_typed_envelope<smf_gen::demo::Response> data;
+      data.envelope.set_status(200);
+      return seastar::make_ready_future<
+        smf::rpc_typed_envelope<smf_gen::demo::Response>>(std::move(data));
+    });
+  }
+};
+
+static smf::rpc_envelope
+make_request() {
+  smf::rpc_typed_envelope<smf_gen::demo::Request> req;
+  req.data->name = "goaway";
+  return req.serialize_data();
+}
+
+static seastar::future<>
+run(seastar::distributed<smf::rpc_server> &rpc, uint16_t port) {
+  smf::rpc_client_opts opts{};
+  opts.server_addr = seastar::ipv4_addr{"127.0.0.1", port};
+  auto client =
+    seastar::make_shared<smf_gen::demo::SmfStorageClient>(std::move(opts));
+  return client->connect()
+    .then([&rpc, client] {
+      std::vector<seastar::future<>> calls;
+      for (auto i = 0u; i < kRequests; ++i) {
+        calls.push_back(client->Get(make_request()).then([](auto ret) {
+          LOG_THROW_IF(!ret, "Call in flight was dropped by the drain");
+          LOG_THROW_IF(ret.ctx->status() != 200, "Bad status: {}",
+                       ret.ctx->status());
+        }));
+      }
+      auto drain = seastar::sleep(50ms).then([&rpc] {
+        auto start = std::chrono::steady_clock::now();
+        return rpc
+          .invoke_on_all([](smf::rpc_server &s) { return s.drain(kGrace); })
+          .then([start] {
+            auto took = std::chrono::steady_clock::now() - start;
+            LOG_INFO("Drained in {}ms",
+                     std::chrono::duration_cast<std::chrono::milliseconds>(
+                       took)
+                       .count());
+            LOG_THROW_IF(took >= kGrace / 2,
+                         "Drain waited for the grace period");
+          });
+      });
+      calls.push_back(std::move(drain));
+      return seastar::when_all_succeed(calls.begin(), calls.end());
+    })
+    .finally([client] { return client->stop().finally([client] {}); });
+}
+
+int
+main(int args, char **argv, char **env) {
+  seastar::distributed<smf::rpc_server> rpc;
+  seastar::app_template app;
+  smf::random rand;
+  uint16_t random_port =
+    smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+  return app.run(args, argv, [&]() -> seastar::future<int> {
+    seastar::engine().at_exit([&] { return rpc.stop(); });
+    smf::rpc_server_args sargs;
+    sargs.ip = "127.0.0.1";
+    sargs.rpc_port = random_port;
+    sargs.http_port =
+      smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+    sargs.flags |= smf::rpc_server_flags::rpc_server_flags_disable_http_server;
+
+    return rpc.start(sargs)
+      .then([&rpc] {
+        return rpc.invoke_on_all(
+          &smf::rpc_server::register_service<storage_service>);
+      })
+      .then([&rpc] { return rpc.invoke_on_all(&smf::rpc_server::start); })
+      .then([&] { return run(rpc, random_port); })
+      .then([] { return seastar::make_ready_future<int>(0); });
+  });
+}
@@ -0,0 +1,135 @@
+// Copyright 2019 SMF Authors
+//
+// std
+#include <chrono>
+#include <iostream>
+#include <vector>
+// seastar
+#include <seastar/core/app-template.hh>
+#include <seastar/core/distributed.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/core/when_all.hh>
+// smf
+#include "integration_tests/non_root_port.h"
+#include "smf/log.h"
+#include "smf/random.h"
+#include "smf/rpc_generated.h"
+#include "smf/rpc_server.h"
+
+// generated-templates
+#include "integration_tests/demo_service.smf.fb.h"
+
+// The server drains and restarts on the same port. The client's first
+// attempts to move to a new connection fail while nothing listens; it keeps
+// trying. Calls in flight at the GOAWAY are answered by the old server, calls
+// made during the migration wait for it and are answered by the new one.
+//
+using namespace std::chrono_literals;  // NOLINT
+constexpr const uint32_t kRequests = 10;
+constexpr const auto kHandlerDelay = 200ms;
+// shorter than the client's reconnect attempts, longer than the calls
+constexpr const auto kGrace = 250ms;
+
+/// \brief of the server answering; the restarted one is the second
+static uint32_t generation = 1;
+
+class storage_service final : public smf_gen::demo::SmfStorage {
+  virtual seastar::future<smf::rpc_typed_envelope<smf_gen::demo::Response>>
+  Get(smf::rpc_recv_typed_context<smf_gen::demo::Request> &&rec) final {
+    return seastar::sleep(kHandlerDelay).then([g = generation] {
+      smf::rpc_typed_envelope<smf_gen::demo::Response> data;
+      data.data->name = fmt::format("{}", g);
+      data.envelope.set_status(200);
+      return seastar::make_ready_future<
+        smf::rpc_typed_envelope<smf_gen::demo::Response>>(std::move(data));
+    });
+  }
+};
+
+static smf::rpc_envelope
+make_request() {
+  smf::rpc_typed_envelope<smf_gen::demo::Request> req;
+  req.data->name = "goaway";
+  return req.serialize_data();
+}
+
+static smf::rpc_server_args
+server_args(uint16_t port) {
+  smf::rpc_server_args sargs;
+  sargs.ip = "127.0.0.1";
+  sargs.rpc_port = port;
+  sargs.flags |= smf::rpc_server_flags::rpc_server_flags_disable_http_server;
+  return sargs;
+}
+
+static void
+start(seastar::distributed<smf::rpc_server> &rpc, uint16_t port) {
+  rpc.start(server_args(port)).get();
+  rpc.invoke_on_all(&smf::rpc_server::register_service<storage_service>)
+    .get();
+  rpc.invoke_on_all(&smf::rpc_server::start).get();
+}
+
+static void
+check(smf::rpc_recv_typed_context<smf_gen::demo::Response> ret,
+      uint32_t expected_generation) {
+  LOG_THROW_IF(!ret, "Call was dropped by the restart");
+  LOG_THROW_IF(ret.ctx->status() != 200, "Bad status: {}", ret.ctx->status());
+  LOG_THROW_IF(ret->name()->str() != fmt::format("{}", expected_generation),
+               "Answered by server {}, expected {}", ret->name()->str(),
+               expected_generation);
+}
+
+static void
+run(seastar::distributed<smf::rpc_server> &first,
+    seastar::distributed<smf::rpc_server> &second, uint16_t port) {
+  start(first, port);
+  smf::rpc_client_opts opts{};
+  opts.server_addr = seastar::ipv4_addr{"127.0.0.1", port};
+  smf_gen::demo::SmfStorageClient client(std::move(opts));
+  client.connect().get();
+
+  std::vector<seastar::future<
+    smf::rpc_recv_typed_context<smf_gen::demo::Response>>>
+    inflight;
+  for (auto i = 0u; i < kRequests; ++i) {
+    inflight.push_back(client.Get(make_request()));
+  }
+  seastar::sleep(50ms).get();
+  auto drained =
+    first.invoke_on_all([](smf::rpc_server &s) { return s.drain(kGrace); });
+  seastar::sleep(20ms).get();
+  LOG_THROW_IF(!client.is_migrating(), "Client did not see the GOAWAY");
+  auto migrated = client.Get(make_request());
+
+  for (auto &f : seastar::when_all(inflight.begin(), inflight.end()).get0()) {
+    check(f.get0(), 1);
+  }
+  // the client can only reconnect once the old server is gone for good
+  drained.get();
+  first.stop().get();
+  generation = 2;
+  start(second, port);
+
+  check(migrated.get0(), 2);
+  LOG_THROW_IF(client.is_migrating(), "Client still migrating");
+  check(client.Get(make_request()).get0(), 2);
+  client.stop().get();
+}
+
+int
+main(int args, char **argv, char **env) {
+  seastar::distributed<smf::rpc_server> first;
+  seastar::distributed<smf::rpc_server> second;
+  seastar::app_template app;
+  smf::random rand;
+  uint16_t random_port =
+    smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+  return app.run(args, argv, [&]() -> seastar::future<int> {
+    seastar::engine().at_exit([&] { return second.stop(); });
+    return seastar::async([&] { run(first, second, random_port); })
+      .then([] { return seastar::make_ready_future<int>(0); });
+  });
+}
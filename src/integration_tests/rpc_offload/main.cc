@@ -0,0 +1,134 @@
+// Copyright 2019 SMF Authors
+//
+// std
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+// seastar
+#include <seastar/core/app-template.hh>
+#include <seastar/core/distributed.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/core/when_all.hh>
+// smf
+#include "integration_tests/non_root_port.h"
+#include "smf/log.h"
+#include "smf/random.h"
+#include "smf/rpc_generated.h"
+#include "smf/rpc_server.h"
+
+// generated-templates
+#include "integration_tests/demo_service.smf.fb.h"
+
+// Digest is declared with `(offload_concurrency: "2")` in demo_service.fbs.
+//
+// Its handler spins on the CPU, yielding now and then. It runs in a
+// seastar::thread, never more than two at a time, and a request of another
+// method sent behind a queue of them is answered before they are done.
+//
+using namespace std::chrono_literals;  // NOLINT
+constexpr const auto kSpin = 20ms;
+constexpr const uint32_t kConcurrency = 2;
+constexpr const uint32_t kDigests = 6;
+
+static uint32_t running = 0;
+static uint32_t max_running = 0;
+static uint32_t digested = 0;
+
+class storage_service final : public smf_gen::demo::SmfStorage {
+  virtual seastar::future<smf::rpc_typed_envelope<smf_gen::demo::Response>>
+  Digest(smf::rpc_recv_typed_context<smf_gen::demo::Request> &&rec) final {
+    LOG_THROW_IF(!seastar::thread::running_in_thread(),
+                 "Offloaded handler outside of a seastar::thread");
+    max_running = std::max(max_running, ++running);
+    const auto end = std::chrono::steady_clock::now() + kSpin;
+    while (std::chrono::steady_clock::now() < end) {
+      seastar::thread::maybe_yield();
+    }
+    --running;
+    ++digested;
+    return reply(rec->name()->str());
+  }
+  virtual seastar::future<smf::rpc_typed_envelope<smf_gen::demo::Response>>
+  Get(smf::rpc_recv_typed_context<smf_gen::demo::Request> &&rec) final {
+    return reply(rec->name()->str());
+  }
+
+  static seastar::future<smf::rpc_typed_envelope<smf_gen::demo::Response>>
+  reply(seastar::sstring name) {
+    smf::rpc_typed_envelope<smf_gen::demo::Response> data;
+    data.data->name = name;
+    data.envelope.set_status(200);
+    return seastar::make_ready_future<
+      smf::rpc_typed_envelope<smf_gen::demo::Response>>(std::move(data));
+  }
+};
+
+static smf::rpc_envelope
+make_request(const char *name) {
+  smf::rpc_typed_envelope<smf_gen::demo::Request> req;
+  req.data->name = name;
+  return req.serialize_data();
+}
+
+static void
+check(smf::rpc_recv_typed_context<smf_gen::demo::Response> ret,
+      const char *name) {
+  LOG_THROW_IF(!ret, "Empty response from server");
+  LOG_THROW_IF(ret.ctx->status() != 200, "Bad status: {}", ret.ctx->status());
+  LOG_THROW_IF(ret->name()->str() != name, "Reply for another request: {}",
+               ret->name()->str());
+}
+
+static void
+run(uint16_t port) {
+  smf::rpc_client_opts opts{};
+  opts.server_addr = seastar::ipv4_addr{"127.0.0.1", port};
+  smf_gen::demo::SmfStorageClient client(std::move(opts));
+  client.connect().get();
+  std::vector<seastar::future<
+    smf::rpc_recv_typed_context<smf_gen::demo::Response>>>
+    digests;
+  for (auto i = 0u; i < kDigests; ++i) {
+    digests.push_back(client.Digest(make_request("digest")));
+  }
+  check(client.Get(make_request("get")).get0(), "get");
+  LOG_THROW_IF(digested == kDigests,
+               "Get waited for the offloaded handlers to finish");
+  auto done = seastar::when_all(digests.begin(), digests.end()).get0();
+  for (auto &f : done) { check(f.get0(), "digest"); }
+  LOG_THROW_IF(digested != kDigests, "Handler ran {} times, expected {}",
+               digested, kDigests);
+  LOG_THROW_IF(max_running != kConcurrency,
+               "{} handlers ran at once, expected {}", max_running,
+               kConcurrency);
+  client.stop().get();
+}
+
+int
+main(int args, char **argv, char **env) {
+  seastar::distributed<smf::rpc_server> rpc;
+  seastar::app_template app;
+  smf::random rand;
+  uint16_t random_port =
+    smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+  return app.run(args, argv, [&]() -> seastar::future<int> {
+    seastar::engine().at_exit([&] { return rpc.stop(); });
+    smf::rpc_server_args sargs;
+    sargs.ip = "127.0.0.1";
+    sargs.rpc_port = random_port;
+    sargs.http_port =
+      smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+    sargs.flags |= smf::rpc_server_flags::rpc_server_flags_disable_http_server;
+
+    return rpc.start(sargs)
+      .then([&rpc] {
+        return rpc.invoke_on_all(
+          &smf::rpc_server::register_service<storage_service>);
+      })
+      .then([&rpc] { return rpc.invoke_on_all(&smf::rpc_server::start); })
+      .then([&] { return seastar::async([&] { run(random_port); }); })
+      .then([] { return seastar::make_ready_future<int>(0); });
+  });
+}
@@ -0,0 +1,118 @@
+// Copyright 2019 SMF Authors
+//
+// std
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+// seastar
+#include <seastar/core/app-template.hh>
+#include <seastar/core/distributed.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/when_all.hh>
+#include <seastar/net/api.hh>
+// smf
+#include "integration_tests/non_root_port.h"
+#include "smf/log.h"
+#include "smf/random.h"
+#include "smf/rpc_generated.h"
+#include "smf/rpc_server.h"
+
+// generated-templates
+#include "integration_tests/demo_service.smf.fb.h"
+
+// The core budget fits one request at a time and every request takes
+// kRequestDuration, so concurrent clients queue for memory well past the
+// codel target. Once a whole interval goes by with that standing queue the
+// server must answer the queued requests with a 503 instead of serving them
+// late, while the ones admitted before still succeed.
+//
+using namespace std::chrono_literals;  // NOLINT
+constexpr const uint32_t kRequest = 4096;
+constexpr const uint32_t kClients = 16;
+constexpr const auto kRequestDuration = 20ms;
+
+class storage_service final : public smf_gen::demo::SmfStorage {
+  virtual seastar::future<smf::rpc_typed_envelope<smf_gen::demo::Response>>
+  Get(smf::rpc_recv_typed_context<smf_gen::demo::Request> &&rec) final {
+    return seastar::sleep(kRequestDuration).then([] {
+      smf::rpc_typed_envelope<smf_gen::demo::Response> data;
+      data.envelope.set_status(200);
+      return seastar::make_ready_future<
+        smf::rpc_typed_envelope<smf_gen::demo::Response>>(std::move(data));
+    });
+  }
+};
+
+static seastar::future<uint32_t>
+get_status(uint16_t port) {
+  smf::rpc_client_opts opts{};
+  opts.server_addr = seastar::ipv4_addr{"127.0.0.1", port};
+  auto client =
+    seastar::make_shared<smf_gen::demo::SmfStorageClient>(std::move(opts));
+  return client->connect()
+    .then([client] {
+      smf::random r;
+      smf::rpc_typed_envelope<smf_gen::demo::Request> req;
+      req.data->name = r.next_alphanum(kRequest);
+      return client->Get(req.serialize_data());
+    })
+    .then([](auto ret) {
+      LOG_THROW_IF(!ret.ctx, "Empty response from server");
+      if (ret.ctx->is_error_reply()) {
+        LOG_THROW_IF(!ret.ctx->error_reason(), "Error reply without reason");
+      }
+      return ret.ctx->status();
+    })
+    .finally([client] { return client->stop().finally([client] {}); });
+}
+
+static seastar::future<>
+overload(uint16_t port) {
+  std::vector<seastar::future<uint32_t>> reqs;
+  for (auto i = 0u; i < kClients; ++i) { reqs.push_back(get_status(port)); }
+  return seastar::when_all_succeed(reqs.begin(), reqs.end())
+    .then([](std::vector<uint32_t> statuses) {
+      auto ok = std::count(statuses.begin(), statuses.end(), 200);
+      auto shed = std::count(statuses.begin(), statuses.end(),
+                             smf::rpc_codel::kOverloadedStatus);
+      LOG_INFO("Served: {}, shed: {}", ok, shed);
+      LOG_THROW_IF(ok + shed != kClients, "Unexpected status codes");
+      LOG_THROW_IF(ok == 0, "Every request was shed");
+      LOG_THROW_IF(shed == 0, "No request was shed");
+    });
+}
+
+int
+main(int args, char **argv, char **env) {
+  seastar::distributed<smf::rpc_server> rpc;
+  seastar::app_template app;
+  smf::random rand;
+  uint16_t random_port =
+    smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+  return app.run(args, argv, [&]() -> seastar::future<int> {
+    seastar::engine().at_exit([&] { return rpc.stop(); });
+    smf::rpc_server_args sargs;
+    sargs.ip = "127.0.0.1";
+    sargs.rpc_port = random_port;
+    sargs.http_port =
+      smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+    sargs.flags |= smf::rpc_server_flags::rpc_server_flags_disable_http_server;
+    sargs.memory_avail_per_core =
+      static_cast<uint64_t>(kRequest + 400 /*some slack bytes*/);
+    sargs.codel.enabled = true;
+    sargs.codel.target = 1ms;
+    sargs.codel.interval = 10ms;
+    sargs.codel.lifo_when_overloaded = true;
+
+    return rpc.start(sargs)
+      .then([&rpc] {
+        return rpc.invoke_on_all(
+          &smf::rpc_server::register_service<storage_service>);
+      })
+      .then([&rpc] { return rpc.invoke_on_all(&smf::rpc_server::start); })
+      .then([&] { return overload(random_port); })
+      .then([] { return seastar::make_ready_future<int>(0); });
+  });
+}
@@ -0,0 +1,118 @@
+// Copyright 2019 SMF Authors
+//
+// std
+#include <chrono>
+#include <iostream>
+#include <set>
+#include <vector>
+// third party
+#include <boost/iterator/counting_iterator.hpp>
+// seastar
+#include <seastar/core/app-template.hh>
+#include <seastar/core/distributed.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/when_all.hh>
+#include <seastar/net/api.hh>
+// smf
+#include "integration_tests/non_root_port.h"
+#include "smf/log.h"
+#include "smf/random.h"
+#include "smf/rpc_generated.h"
+#include "smf/rpc_server.h"
+
+// generated-templates
+#include "integration_tests/demo_service.smf.fb.h"
+
+// A single connection - so a single core - keeps many slow requests in
+// flight while the other core sits idle. Once the cores have published
+// their load, the busy one must hand requests to the idle one; the handler
+// answers with the core it ran on.
+//
+using namespace std::chrono_literals;  // NOLINT
+constexpr const uint32_t kRounds = 20;
+constexpr const uint32_t kRequestsPerRound = 32;
+constexpr const auto kRequestDuration = 5ms;
+
+class storage_service final : public smf_gen::demo::SmfStorage {
+  virtual seastar::future<smf::rpc_typed_envelope<smf_gen::demo::Response>>
+  Get(smf::rpc_recv_typed_context<smf_gen::demo::Request> &&rec) final {
+    return seastar::sleep(kRequestDuration).then([] {
+      smf::rpc_typed_envelope<smf_gen::demo::Response> data;
+      data.data->name = seastar::to_sstring(seastar::engine().cpu_id());
+      data.envelope.set_status(200);
+      return seastar::make_ready_future<
+        smf::rpc_typed_envelope<smf_gen::demo::Response>>(std::move(data));
+    });
+  }
+};
+
+using client_t = seastar::shared_ptr<smf_gen::demo::SmfStorageClient>;
+
+static seastar::future<>
+one_round(client_t client,
+          seastar::lw_shared_ptr<std::set<seastar::sstring>> s) {
+  std::vector<seastar::future<>> reqs;
+  for (auto i = 0u; i < kRequestsPerRound; ++i) {
+    smf::rpc_typed_envelope<smf_gen::demo::Request> req;
+    req.data->name = "rebalance";
+    reqs.push_back(client->Get(req.serialize_data()).then([s](auto ret) {
+      LOG_THROW_IF(!ret, "Empty response from server");
+      LOG_THROW_IF(ret.ctx->status() != 200, "Bad status: {}",
+                   ret.ctx->status());
+      s->insert(ret->name()->str());
+    }));
+  }
+  return seastar::when_all_succeed(reqs.begin(), reqs.end());
+}
+
+static seastar::future<>
+rebalance(uint16_t port) {
+  smf::rpc_client_opts opts{};
+  opts.server_addr = seastar::ipv4_addr{"127.0.0.1", port};
+  auto client =
+    seastar::make_shared<smf_gen::demo::SmfStorageClient>(std::move(opts));
+  auto cores = seastar::make_lw_shared<std::set<seastar::sstring>>();
+  return client->connect()
+    .then([client, cores] {
+      return seastar::do_for_each(
+        boost::counting_iterator<uint32_t>(0),
+        boost::counting_iterator<uint32_t>(kRounds),
+        [client, cores](uint32_t) { return one_round(client, cores); });
+    })
+    .then([cores] {
+      LOG_THROW_IF(cores->size() < 2,
+                   "Every request ran on the core of the connection");
+    })
+    .finally([client] { return client->stop().finally([client] {}); });
+}
+
+int
+main(int args, char **argv, char **env) {
+  seastar::distributed<smf::rpc_server> rpc;
+  seastar::app_template app;
+  smf::random rand;
+  uint16_t random_port =
+    smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+  return app.run(args, argv, [&]() -> seastar::future<int> {
+    seastar::engine().at_exit([&] { return rpc.stop(); });
+    smf::rpc_server_args sargs;
+    sargs.ip = "127.0.0.1";
+    sargs.rpc_port = random_port;
+    sargs.http_port =
+      smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+    sargs.flags |= smf::rpc_server_flags::rpc_server_flags_disable_http_server;
+    sargs.rebalance.enabled = true;
+    sargs.rebalance.interval = 10ms;
+    sargs.rebalance.imbalance = 1.5;
+
+    return rpc.start(sargs)
+      .then([&rpc] {
+        return rpc.invoke_on_all(
+          &smf::rpc_server::register_service<storage_service>);
+      })
+      .then([&rpc] { return rpc.invoke_on_all(&smf::rpc_server::start); })
+      .then([&] { return rebalance(random_port); })
+      .then([] { return seastar::make_ready_future<int>(0); });
+  });
+}
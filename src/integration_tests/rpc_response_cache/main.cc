@@ -0,0 +1,121 @@
+// Copyright 2019 SMF Authors
+//
+// std
+#include <chrono>
+#include <iostream>
+// seastar
+#include <seastar/core/app-template.hh>
+#include <seastar/core/distributed.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/net/api.hh>
+// smf
+#include "integration_tests/non_root_port.h"
+#include "smf/log.h"
+#include "smf/random.h"
+#include "smf/rpc_generated.h"
+#include "smf/rpc_server.h"
+
+// generated-templates
+#include "integration_tests/demo_service.smf.fb.h"
+
+// Stat is declared with `(cache_ttl_ms: "200")` in demo_service.fbs.
+//
+// Repeating a request is answered from the cache without running the
+// handler; a different payload, or the same one after the ttl, runs it.
+// Failed replies are never cached.
+//
+using namespace std::chrono_literals;  // NOLINT
+constexpr const auto kTtl = 200ms;
+constexpr const uint32_t kRepeats = 10;
+
+static uint32_t handler_calls = 0;
+static bool flaky_failed = false;
+
+class storage_service final : public smf_gen::demo::SmfStorage {
+  virtual seastar::future<smf::rpc_typed_envelope<smf_gen::demo::Response>>
+  Stat(smf::rpc_recv_typed_context<smf_gen::demo::Request> &&rec) final {
+    ++handler_calls;
+    smf::rpc_typed_envelope<smf_gen::demo::Response> data;
+    data.data->name = rec->name()->str();
+    // a transient failure, the first time only
+    if (data.data->name == "flaky" && !flaky_failed) {
+      flaky_failed = true;
+      data.envelope.set_status(503);
+    } else {
+      data.envelope.set_status(200);
+    }
+    return seastar::make_ready_future<
+      smf::rpc_typed_envelope<smf_gen::demo::Response>>(std::move(data));
+  }
+};
+
+static smf::rpc_envelope
+make_request(const char *name) {
+  smf::rpc_typed_envelope<smf_gen::demo::Request> req;
+  req.data->name = name;
+  return req.serialize_data();
+}
+
+static void
+expect_calls(smf_gen::demo::SmfStorageClient &c, const char *name,
+             uint32_t repeats, uint32_t calls) {
+  for (auto i = 0u; i < repeats; ++i) {
+    auto ret = c.Stat(make_request(name)).get0();
+    LOG_THROW_IF(!ret, "Empty response from server");
+    LOG_THROW_IF(ret.ctx->status() != 200, "Bad status: {}",
+                 ret.ctx->status());
+    LOG_THROW_IF(ret->name()->str() != name, "Reply for another request: {}",
+                 ret->name()->str());
+  }
+  LOG_THROW_IF(handler_calls != calls, "Handler ran {} times, expected {}",
+               handler_calls, calls);
+}
+
+static void
+run(uint16_t port) {
+  smf::rpc_client_opts opts{};
+  opts.server_addr = seastar::ipv4_addr{"127.0.0.1", port};
+  smf_gen::demo::SmfStorageClient client(std::move(opts));
+  client.connect().get();
+  expect_calls(client, "cached", kRepeats, 1);
+  expect_calls(client, "other", kRepeats, 2);
+  seastar::sleep(kTtl * 2).get();
+  expect_calls(client, "cached", kRepeats, 3);
+  auto failed = client.Stat(make_request("flaky")).get0();
+  LOG_THROW_IF(!failed.ctx, "Empty response from server");
+  LOG_THROW_IF(failed.ctx->status() != 503, "Expected 503, got: {}",
+               failed.ctx->status());
+  // the retry runs the handler again, and only its reply is cached
+  expect_calls(client, "flaky", kRepeats, 5);
+  client.stop().get();
+}
+
+int
+main(int args, char **argv, char **env) {
+  seastar::distributed<smf::rpc_server> rpc;
+  seastar::app_template app;
+  smf::random rand;
+  uint16_t random_port =
+    smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+  return app.run(args, argv, [&]() -> seastar::future<int> {
+    seastar::engine().at_exit([&] { return rpc.stop(); });
+    smf::rpc_server_args sargs;
+    sargs.ip = "127.0.0.1";
+    sargs.rpc_port = random_port;
+    sargs.http_port =
+      smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+    sargs.flags |= smf::rpc_server_flags::rpc_server_flags_disable_http_server;
+    sargs.response_cache.max_bytes = 1 << 20;
+
+    return rpc.start(sargs)
+      .then([&rpc] {
+        return rpc.invoke_on_all(
+          &smf::rpc_server::register_service<storage_service>);
+      })
+      .then([&rpc] { return rpc.invoke_on_all(&smf::rpc_server::start); })
+      .then([&] { return seastar::async([&] { run(random_port); }); })
+      .then([] { return seastar::make_ready_future<int>(0); });
+  });
+}
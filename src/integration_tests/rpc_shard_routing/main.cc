@@ -0,0 +1,113 @@
+// Copyright 2019 SMF Authors
+//
+// std
+#include <iostream>
+#include <string>
+#include <vector>
+// seastar
+#include <seastar/core/app-template.hh>
+#include <seastar/core/distributed.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/when_all.hh>
+#include <seastar/net/api.hh>
+// third party
+#include <xxhash.h>
+// smf
+#include "integration_tests/non_root_port.h"
+#include "smf/log.h"
+#include "smf/random.h"
+#include "smf/rpc_generated.h"
+#include "smf/rpc_server.h"
+#include "smf/rpc_shard_routing.h"
+
+// generated-templates
+#include "integration_tests/demo_service.smf.fb.h"
+
+// Lookup is declared with `(shard_key: "name")` in demo_service.fbs.
+//
+// Connections land on every core, yet each Lookup must run on the core
+// that owns its name - the handler answers with the core it ran on - and
+// the reply must come back on the connection that sent it.
+//
+constexpr const uint32_t kClients = 4;
+constexpr const uint32_t kRequestsPerClient = 64;
+
+class storage_service final : public smf_gen::demo::SmfStorage {
+  virtual seastar::future<smf::rpc_typed_envelope<smf_gen::demo::Response>>
+  Lookup(smf::rpc_recv_typed_context<smf_gen::demo::Request> &&rec) final {
+    smf::rpc_typed_envelope<smf_gen::demo::Response> data;
+    data.data->name = seastar::to_sstring(seastar::engine().cpu_id()) + ":" +
+                      rec->name()->str();
+    data.envelope.set_status(200);
+    return seastar::make_ready_future<
+      smf::rpc_typed_envelope<smf_gen::demo::Response>>(std::move(data));
+  }
+};
+
+static seastar::future<>
+lookup(seastar::shared_ptr<smf_gen::demo::SmfStorageClient> client,
+       seastar::sstring name) {
+  smf::rpc_typed_envelope<smf_gen::demo::Request> req;
+  req.data->name = name;
+  return client->Lookup(req.serialize_data()).then([name](auto ret) {
+    LOG_THROW_IF(!ret, "Empty response from server");
+    LOG_THROW_IF(ret.ctx->status() != 200, "Bad status: {}",
+                 ret.ctx->status());
+    const uint32_t owner =
+      smf::rpc_shard_for(XXH64(name.data(), name.size(), 0));
+    const auto expected = seastar::to_sstring(owner) + ":" + name;
+    LOG_THROW_IF(ret->name()->str() != expected,
+                 "Expected reply: {}, got: {}", expected, ret->name()->str());
+  });
+}
+
+static seastar::future<>
+run_client(uint16_t port) {
+  smf::rpc_client_opts opts{};
+  opts.server_addr = seastar::ipv4_addr{"127.0.0.1", port};
+  auto client =
+    seastar::make_shared<smf_gen::demo::SmfStorageClient>(std::move(opts));
+  return client->connect()
+    .then([client] {
+      smf::random r;
+      std::vector<seastar::future<>> reqs;
+      for (auto i = 0u; i < kRequestsPerClient; ++i) {
+        reqs.push_back(lookup(client, r.next_alphanum(16)));
+      }
+      return seastar::when_all_succeed(reqs.begin(), reqs.end());
+    })
+    .finally([client] { return client->stop().finally([client] {}); });
+}
+
+int
+main(int args, char **argv, char **env) {
+  seastar::distributed<smf::rpc_server> rpc;
+  seastar::app_template app;
+  smf::random rand;
+  uint16_t random_port =
+    smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+  return app.run(args, argv, [&]() -> seastar::future<int> {
+    seastar::engine().at_exit([&] { return rpc.stop(); });
+    smf::rpc_server_args sargs;
+    sargs.ip = "127.0.0.1";
+    sargs.rpc_port = random_port;
+    sargs.http_port =
+      smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+    sargs.flags |= smf::rpc_server_flags::rpc_server_flags_disable_http_server;
+
+    return rpc.start(sargs)
+      .then([&rpc] {
+        return rpc.invoke_on_all(
+          &smf::rpc_server::register_service<storage_service>);
+      })
+      .then([&rpc] { return rpc.invoke_on_all(&smf::rpc_server::start); })
+      .then([&] {
+        std::vector<seastar::future<>> clients;
+        for (auto i = 0u; i < kClients; ++i) {
+          clients.push_back(run_client(random_port));
+        }
+        return seastar::when_all_succeed(clients.begin(), clients.end());
+      })
+      .then([] { return seastar::make_ready_future<int>(0); });
+  });
+}
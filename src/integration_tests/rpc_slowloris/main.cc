@@ -0,0 +1,127 @@
+// Copyright 2019 SMF Authors
+//
+// std
+#include <chrono>
+#include <iostream>
+// seastar
+#include <seastar/core/app-template.hh>
+#include <seastar/core/distributed.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/core/with_timeout.hh>
+#include <seastar/net/api.hh>
+// smf
+#include "integration_tests/non_root_port.h"
+#include "smf/log.h"
+#include "smf/random.h"
+#include "smf/rpc_generated.h"
+#include "smf/rpc_server.h"
+
+// generated-templates
+#include "integration_tests/demo_service.smf.fb.h"
+
+// A client that sends part of a header, and one that sends the header but
+// trickles the body, must both be disconnected - while a client that
+// merely waits between requests keeps its connection.
+//
+using namespace std::chrono_literals;  // NOLINT
+constexpr const auto kHeaderTimeout = 200ms;
+constexpr const uint64_t kMinBodyRate = 1 << 20;
+// one second of slack plus a small body at the minimum rate
+constexpr const auto kBodyTimeout = 1500ms;
+
+class storage_service final : public smf_gen::demo::SmfStorage {
+  virtual seastar::future<smf::rpc_typed_envelope<smf_gen::demo::Response>>
+  Get(smf::rpc_recv_typed_context<smf_gen::demo::Request> &&rec) final {
+    smf::rpc_typed_envelope<smf_gen::demo::Response> data;
+    data.envelope.set_status(200);
+    return seastar::make_ready_future<
+      smf::rpc_typed_envelope<smf_gen::demo::Response>>(std::move(data));
+  }
+};
+
+static smf::rpc_envelope
+make_request() {
+  smf::rpc_typed_envelope<smf_gen::demo::Request> req;
+  req.data->name = "slowloris";
+  auto e = req.serialize_data();
+  e.set_request_id(42);
+  return e;
+}
+
+/// \brief writes `header_bytes` of the header & `body_bytes` of the body,
+/// then waits for the server to hang up
+static void
+send_partial(uint16_t port, size_t header_bytes, size_t body_bytes,
+             seastar::timer<>::duration wait) {
+  auto e = make_request();
+  auto fd = seastar::engine()
+              .connect(seastar::make_ipv4_address({"127.0.0.1", port}))
+              .get0();
+  auto in = fd.input();
+  auto out = fd.output();
+  const char *hdr = reinterpret_cast<const char *>(&e.letter.header);
+  out.write(hdr, header_bytes).get();
+  out.write(e.letter.body.get(), body_bytes).get();
+  out.flush().get();
+  auto start = std::chrono::steady_clock::now();
+  auto buf =
+    seastar::with_timeout(seastar::timer<>::clock::now() + wait, in.read())
+      .get0();
+  LOG_THROW_IF(!buf.empty(), "Server replied to a partial request");
+  LOG_INFO("Server hung up after {}ms",
+           std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now() - start)
+             .count());
+  fd.shutdown_output();
+}
+
+static void
+run(uint16_t port) {
+  LOG_INFO("Sending half a header");
+  send_partial(port, sizeof(smf::rpc::header) / 2, 0, kHeaderTimeout * 5);
+  LOG_INFO("Sending a header & trickling the body");
+  send_partial(port, sizeof(smf::rpc::header), 1, kBodyTimeout * 2);
+
+  smf::rpc_client_opts opts{};
+  opts.server_addr = seastar::ipv4_addr{"127.0.0.1", port};
+  auto client =
+    seastar::make_shared<smf_gen::demo::SmfStorageClient>(std::move(opts));
+  client->connect().get();
+  // idle, not slow
+  seastar::sleep(kHeaderTimeout * 2).get();
+  auto ret = client->Get(make_request()).get0();
+  LOG_THROW_IF(!ret, "Empty response from server");
+  LOG_THROW_IF(ret.ctx->status() != 200, "Bad status: {}", ret.ctx->status());
+  client->stop().get();
+}
+
+int
+main(int args, char **argv, char **env) {
+  seastar::distributed<smf::rpc_server> rpc;
+  seastar::app_template app;
+  smf::random rand;
+  uint16_t random_port =
+    smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+  return app.run(args, argv, [&]() -> seastar::future<int> {
+    seastar::engine().at_exit([&] { return rpc.stop(); });
+    smf::rpc_server_args sargs;
+    sargs.ip = "127.0.0.1";
+    sargs.rpc_port = random_port;
+    sargs.http_port =
+      smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+    sargs.flags |= smf::rpc_server_flags::rpc_server_flags_disable_http_server;
+    sargs.header_timeout = kHeaderTimeout;
+    sargs.min_body_bytes_per_sec = kMinBodyRate;
+
+    return rpc.start(sargs)
+      .then([&rpc] {
+        return rpc.invoke_on_all(
+          &smf::rpc_server::register_service<storage_service>);
+      })
+      .then([&rpc] { return rpc.invoke_on_all(&smf::rpc_server::start); })
+      .then([&] { return seastar::async([&] { run(random_port); }); })
+      .then([] { return seastar::make_ready_future<int>(0); });
+  });
+}
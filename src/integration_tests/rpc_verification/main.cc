@@ -0,0 +1,123 @@
+// Copyright 2019 SMF Authors
+//
+// std
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+// seastar
+#include <seastar/core/app-template.hh>
+#include <seastar/core/distributed.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/net/api.hh>
+// smf
+#include "integration_tests/non_root_port.h"
+#include "smf/log.h"
+#include "smf/random.h"
+#include "smf/rpc_generated.h"
+#include "smf/rpc_header_utils.h"
+#include "smf/rpc_server.h"
+
+// generated-templates
+#include "integration_tests/demo_service.smf.fb.h"
+
+// The server default is root_only; Get is declared with
+// `(verification: "full")` in demo_service.fbs.
+//
+// A request whose string length points past the end of the buffer has a
+// valid root table, so root_only lets it through, but full must reject it
+// before the handler ever sees it - with a 400 rpc::error_reply.
+//
+static const char *kName = "verification";
+
+class storage_service final : public smf_gen::demo::SmfStorage {
+  virtual seastar::future<smf::rpc_typed_envelope<smf_gen::demo::Response>>
+  Get(smf::rpc_recv_typed_context<smf_gen::demo::Request> &&rec) final {
+    LOG_THROW_IF(!rec.verify_fbs(), "Unverified request reached Get");
+    smf::rpc_typed_envelope<smf_gen::demo::Response> data;
+    data.data->name = rec->name()->str();
+    data.envelope.set_status(200);
+    return seastar::make_ready_future<
+      smf::rpc_typed_envelope<smf_gen::demo::Response>>(std::move(data));
+  }
+  // root_only: must not read the (corrupt) name
+  virtual seastar::future<smf::rpc_typed_envelope<smf_gen::demo::Response>>
+  Put(smf::rpc_recv_typed_context<smf_gen::demo::Request> &&rec) final {
+    smf::rpc_typed_envelope<smf_gen::demo::Response> data;
+    data.envelope.set_status(200);
+    return seastar::make_ready_future<
+      smf::rpc_typed_envelope<smf_gen::demo::Response>>(std::move(data));
+  }
+};
+
+static smf::rpc_envelope
+make_request(bool corrupt) {
+  smf::rpc_typed_envelope<smf_gen::demo::Request> req;
+  req.data->name = kName;
+  auto e = req.serialize_data();
+  if (!corrupt) { return e; }
+  auto &body = e.letter.body;
+  auto name = std::search(body.get(), body.get() + body.size(), kName,
+                          kName + std::strlen(kName));
+  LOG_THROW_IF(name == body.get() + body.size(), "Name not in payload");
+  // the string length prefix
+  const uint32_t huge = 0x7fffffff;
+  std::memcpy(name - sizeof(uint32_t), &huge, sizeof(huge));
+  smf::checksum_rpc(e.letter.header, body.get(), body.size());
+  return e;
+}
+
+static seastar::future<>
+expect(uint16_t port, bool corrupt, bool use_put, bool rejected) {
+  smf::rpc_client_opts opts{};
+  opts.server_addr = seastar::ipv4_addr{"127.0.0.1", port};
+  auto client =
+    seastar::make_shared<smf_gen::demo::SmfStorageClient>(std::move(opts));
+  return client->connect()
+    .then([client, corrupt, use_put] {
+      auto e = make_request(corrupt);
+      return use_put ? client->Put(std::move(e)) : client->Get(std::move(e));
+    })
+    .then([=](auto ret) {
+      LOG_THROW_IF(!ret.ctx, "Empty response from server");
+      if (rejected) {
+        LOG_THROW_IF(!ret.ctx->is_error_reply(),
+                     "Corrupt request was dispatched, put: {}", use_put);
+        LOG_THROW_IF(ret.ctx->status() != 400, "Bad status: {}",
+                     ret.ctx->status());
+        return;
+      }
+      LOG_THROW_IF(ret.ctx->status() != 200, "Bad status: {}, corrupt: {}",
+                   ret.ctx->status(), corrupt);
+    })
+    .finally([client] { return client->stop().finally([client] {}); });
+}
+
+int
+main(int args, char **argv, char **env) {
+  seastar::distributed<smf::rpc_server> rpc;
+  seastar::app_template app;
+  smf::random rand;
+  uint16_t random_port =
+    smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+  return app.run(args, argv, [&]() -> seastar::future<int> {
+    seastar::engine().at_exit([&] { return rpc.stop(); });
+    smf::rpc_server_args sargs;
+    sargs.ip = "127.0.0.1";
+    sargs.rpc_port = random_port;
+    sargs.http_port =
+      smf::non_root_port(rand.next() % std::numeric_limits<uint16_t>::max());
+    sargs.flags |= smf::rpc_server_flags::rpc_server_flags_disable_http_server;
+    sargs.verification = smf::rpc_verification_policy::root_only;
+
+    return rpc.start(sargs)
+      .then([&rpc] {
+        return rpc.invoke_on_all(
+          &smf::rpc_server::register_service<storage_service>);
+      })
+      .then([&rpc] { return rpc.invoke_on_all(&smf::rpc_server::start); })
+      .then([&] { return expect(random_port, false, false, false); })
+      .then([&] { return expect(random_port, true, false, true); })
+      .then([&] { return expect(random_port, true, true, false); })
+      .then([] { return seastar::make_ready_future<int>(0); });
+  });
+}
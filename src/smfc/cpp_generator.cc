@@ -106,11 +106,78 @@ print_header_service_ctor_dtor(smf_printer &printer,
       "e.letter.header.mutate_session(session_id);\n"
       "return seastar::make_ready_future<smf::rpc_envelope>(std::move(e));\n");
     printer.outdent();
-    if (i < max - 1) {
-      printer.print("});}),\n");
-    } else {
-      printer.print("});})\n");
+    const uint32_t alignment = method->payload_alignment();
+    CHECK((alignment & (alignment - 1)) == 0)
+      << "payload_alignment must be a power of 2, method: " << method->name();
+    vars["PayloadAlignment"] = std::to_string(alignment);
+    const std::string verification = method->verification();
+    CHECK(verification == "inherit" || verification == "none" ||
+          verification == "root_only" || verification == "full")
+      << "verification must be one of none, root_only, full, method: "
+      << method->name();
+    vars["Verification"] = verification;
+    const std::string priority = method->priority();
+    CHECK(priority.find_first_of("\"\\$") == std::string::npos)
+      << "priority must be a plain name, method: " << method->name();
+    vars["Priority"] = priority.empty() ? "nullptr" : "\"" + priority + "\"";
+    vars["ShardKey"] = "nullptr";
+    if (!method->shard_key().empty()) {
+      const std::string key_type = method->shard_key_type();
+      CHECK(!key_type.empty())
+        << "shard_key must name a string or integer field of the request, "
+        << "method: " << method->name();
+      vars["ShardKey"] = "&smf::rpc_shard_key<" + key_type + ", " +
+                         vars["InType"] + "::" +
+                         method->shard_key_offset_name() + ">";
+    }
+    vars["CacheTtl"] = std::to_string(method->cache_ttl_ms());
+    vars["OffloadConcurrency"] = std::to_string(method->offload_concurrency());
+    // only the attributes the method sets; the rest keep their defaults
+    vars["OptionsCapture"] = method->batch_size() > 0 ? "this" : "";
+    printer.print(vars, "});}, [$OptionsCapture$] {\n");
+    printer.indent();
+    printer.print(vars, "smf::rpc_method_options o;\n"
+                        "o.verify = &smf::rpc_verify_payload<$InType$>;\n");
+    if (alignment != 0) {
+      printer.print(vars, "o.payload_alignment = $PayloadAlignment$;\n");
+    }
+    if (verification != "inherit") {
+      printer.print(vars, "o.verification = "
+                          "smf::rpc_verification_policy::$Verification$;\n");
+    }
+    if (!priority.empty()) {
+      printer.print(vars, "o.priority = $Priority$;\n");
+    }
+    if (!method->shard_key().empty()) {
+      printer.print(vars, "o.shard_key = $ShardKey$;\n");
+    }
+    if (method->cache_ttl_ms() > 0) {
+      printer.print(vars,
+                    "o.cache_ttl = std::chrono::milliseconds($CacheTtl$);\n");
     }
+    if (method->coalesce()) { printer.print("o.coalesce = true;\n"); }
+    if (method->offload_concurrency() > 0) {
+      printer.print(vars,
+                    "o.offload_concurrency = $OffloadConcurrency$;\n");
+    }
+    if (method->batch_size() > 0) {
+      vars["RawBatchMethodName"] = proper_prefix_token(
+        "raw", proper_postfix_token(method->name(), "batch"));
+      vars["BatchSize"] = std::to_string(method->batch_size());
+      vars["BatchWait"] = std::to_string(method->batch_wait_us());
+      printer.print(vars,
+                    "o.batch = [this](std::vector<smf::rpc_recv_context> cs) "
+                    "{\n"
+                    "  return $RawBatchMethodName$(std::move(cs));\n"
+                    "};\n"
+                    "o.batch_size = $BatchSize$;\n"
+                    "o.batch_wait = std::chrono::microseconds($BatchWait$);\n");
+    }
+    printer.print("return o;\n");
+    printer.outdent();
+    printer.print("}()");
+    printer.print(")");
+    printer.print(i < max - 1 ? ",\n" : "\n");
     printer.outdent();
     printer.outdent();
   }
@@ -187,6 +254,27 @@ print_header_service_method(smf_printer &printer, const smf_method *method) {
   printer.outdent();
   printer.print("}\n");
 
+  // BUILDER
+  printer.print(vars,
+                "inline virtual\n"
+                "seastar::future<smf::rpc_builder_envelope<$OutType$>>\n");
+  printer.print(vars,
+                "$MethodName$(smf::rpc_recv_typed_context<$InType$> &&rec,\n"
+                "    smf::rpc_builder_envelope<$OutType$> &&out) {\n");
+  printer.indent();
+  printer.print(
+    vars, "using out_type = $OutType$;\n"
+          "using env_t = smf::rpc_builder_envelope<out_type>;\n"
+          "// Override this method instead of the one above to build the\n"
+          "// reply in place with out.builder(), skipping the object API.\n"
+          "// By default it defers to the object API method.\n"
+          "return $MethodName$(std::move(rec)).then(\n"
+          "  [](smf::rpc_typed_envelope<out_type> x) {\n"
+          "    return seastar::make_ready_future<env_t>(env_t(std::move(x)));\n"
+          "  });\n");
+  printer.outdent();
+  printer.print("}\n");
+
   // RAW
 
   printer.print(vars, "inline virtual\n"
@@ -197,10 +285,14 @@ print_header_service_method(smf_printer &printer, const smf_method *method) {
     vars,
     "using inner_t = $InType$;\n"
     "using input_t = smf::rpc_recv_typed_context<inner_t>;\n"
-    "using mid_t = smf::rpc_typed_envelope<$OutType$>;\n"
-    "return $MethodName$(input_t(std::move(c))).then([this](mid_t x) {\n");
+    "using mid_t = smf::rpc_builder_envelope<$OutType$>;\n"
+    "// reply with the checksum algorithm the client chose\n"
+    "auto checksum = smf::rpc_checksum_type(c.header);\n"
+    "return $MethodName$(input_t(std::move(c)), mid_t()).then("
+    "[this, checksum](mid_t x) {\n");
   printer.indent();
-  printer.print("return "
+  printer.print("x.envelope.set_checksum_type(checksum);\n"
+                "return "
                 "seastar::make_ready_future<smf::rpc_envelope>(x.serialize_"
                 "data());\n");
   printer.outdent();
@@ -209,6 +301,87 @@ print_header_service_method(smf_printer &printer, const smf_method *method) {
   printer.print("}\n");
 }
 
+static void
+print_header_service_batch_method(smf_printer &printer,
+                                  const smf_method *method) {
+  VLOG(1) << "print_header_service_batch_method: " << method->name();
+
+  std::map<std::string, std::string> vars;
+  vars["MethodName"] = method->name();
+  vars["BatchMethodName"] = proper_postfix_token(method->name(), "batch");
+  vars["RawBatchMethodName"] =
+    proper_prefix_token("raw", vars["BatchMethodName"]);
+  vars["InType"] = method->input_type_name();
+  vars["OutType"] = method->output_type_name();
+  printer.print(
+    vars, "inline virtual\n"
+          "seastar::future<std::vector<smf::rpc_builder_envelope<$OutType$>>>\n"
+          "$BatchMethodName$(\n"
+          "    std::vector<smf::rpc_recv_typed_context<$InType$>> &&recs) {\n");
+  printer.indent();
+  printer.print(
+    vars,
+    "using env_t = smf::rpc_builder_envelope<$OutType$>;\n"
+    "// Override this method to run the requests the server collected at\n"
+    "// once, i.e.: one write to a storage engine. Return one reply per\n"
+    "// request, in the same order; wrap object API replies with\n"
+    "// env_t(std::move(typed_envelope)).\n"
+    "// By default it runs $MethodName$(rec, out) for each, one after the\n"
+    "// other - the same handler as an unbatched request.\n"
+    "return seastar::do_with(std::move(recs), std::vector<env_t>(),\n"
+    "  [this](auto &batch, auto &out) {\n"
+    "    return seastar::do_for_each(batch, [this, &out](auto &rec) {\n"
+    "      return $MethodName$(std::move(rec), env_t()).then(\n"
+    "        [&out](env_t x) { out.push_back(std::move(x)); });\n"
+    "    }).then([&out] { return std::move(out); });\n"
+    "  });\n");
+  printer.outdent();
+  printer.print("}\n");
+
+  // RAW
+
+  printer.print(vars, "inline virtual\n"
+                      "seastar::future<std::vector<smf::rpc_envelope>>\n");
+  printer.print(
+    vars,
+    "$RawBatchMethodName$(std::vector<smf::rpc_recv_context> &&cs) {\n");
+  printer.indent();
+  printer.print(
+    vars,
+    "using input_t = smf::rpc_recv_typed_context<$InType$>;\n"
+    "using env_t = smf::rpc_builder_envelope<$OutType$>;\n"
+    "// Session accounting & the checksum algorithm each client chose\n"
+    "std::vector<std::pair<uint16_t, smf::checksum_type>> sessions;\n"
+    "std::vector<input_t> recs;\n"
+    "sessions.reserve(cs.size());\n"
+    "recs.reserve(cs.size());\n"
+    "for (auto &c : cs) {\n"
+    "  sessions.emplace_back(c.session(), smf::rpc_checksum_type(c.header));\n"
+    "  recs.emplace_back(std::move(c));\n"
+    "}\n"
+    "return $BatchMethodName$(std::move(recs)).then(\n"
+    "  [sessions = std::move(sessions)](std::vector<env_t> xs) {\n");
+  printer.indent();
+  printer.print(
+    "// a short or long batch fails in the server, see rpc_request_batcher\n"
+    "std::vector<smf::rpc_envelope> out;\n"
+    "out.reserve(xs.size());\n"
+    "for (auto i = 0u; i < xs.size(); ++i) {\n"
+    "  if (i < sessions.size()) {\n"
+    "    xs[i].envelope.set_checksum_type(sessions[i].second);\n"
+    "  }\n"
+    "  out.push_back(xs[i].serialize_data());\n"
+    "  if (i < sessions.size()) {\n"
+    "    out.back().letter.header.mutate_session(sessions[i].first);\n"
+    "  }\n"
+    "}\n"
+    "return out;\n");
+  printer.outdent();
+  printer.print("});\n");
+  printer.outdent();
+  printer.print("}\n");
+}
+
 static void
 print_header_service(smf_printer &printer, const smf_service *service) {
   VLOG(1) << "print_header_service: " << service->name();
@@ -252,6 +425,9 @@ print_header_service(smf_printer &printer, const smf_service *service) {
 
   for (auto &method : service->methods()) {
     print_header_service_method(printer, method.get());
+    if (method->batch_size() > 0) {
+      print_header_service_batch_method(printer, method.get());
+    }
   }
 
   printer.outdent();
@@ -274,6 +450,7 @@ print_header_client_method(smf_printer &printer, const smf_method *method) {
                 "inline virtual\n"
                 "seastar::future<smf::rpc_recv_typed_context<$OutType$>>\n"
                 "$MethodName$(smf::rpc_typed_envelope<$InType$> x) {\n");
+  printer.print("  x.envelope.set_checksum_type(payload_checksum());\n");
   printer.print(vars, "  return $MethodName$(x.serialize_data());\n");
   printer.print("}\n");
 
@@ -442,10 +619,12 @@ cpp_generator::generate_header_prologue_includes() {
   VLOG(1) << "get_header_includes";
   std::map<std::string, std::string> vars;
   static const std::vector<std::string> headers = {
-        "ostream", "seastar/core/sstring.hh",  
+        "ostream", "utility", "vector", "seastar/core/sstring.hh",
+        "seastar/core/do_with.hh", "seastar/core/future-util.hh",
         "smf/rpc_service.h",
         "smf/rpc_client.h", "smf/rpc_recv_typed_context.h",
-        "smf/rpc_typed_envelope.h", "smf/log.h" };
+        "smf/rpc_typed_envelope.h", "smf/rpc_builder_envelope.h",
+        "smf/log.h" };
 
   for (auto &hdr : headers) {
     vars["header"] = hdr;
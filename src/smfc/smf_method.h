@@ -1,11 +1,17 @@
 // Copyright (c) 2016 Alexander Gallego. All rights reserved.
 //
 #pragma once
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
 #include <deque>
+#include <limits>
 #include <memory>
+#include <string>
 
 #include <boost/algorithm/string/join.hpp>
 #include <flatbuffers/idl.h>
+#include <glog/logging.h>
 
 #include "crc.h"
 #include "language.h"
@@ -66,6 +72,113 @@ class smf_method {
     }
   }
 
+  /// \brief from the method attribute `(payload_alignment: "4096")`, which
+  /// the schema must declare with `attribute "payload_alignment";`
+  /// 0 when not set
+  uint32_t
+  payload_alignment() const {
+    return uint_attribute("payload_alignment", 0);
+  }
+
+  /// \brief from the method attribute `(verification: "full")`, which the
+  /// schema must declare with `attribute "verification";`
+  /// One of none, root_only, full. "inherit" when not set
+  std::string
+  verification() const {
+    auto v = method_->attributes.Lookup("verification");
+    if (v == nullptr) { return "inherit"; }
+    return v->constant;
+  }
+
+  /// \brief from the method attribute `(priority: "control")`, which the
+  /// schema must declare with `attribute "priority";`
+  /// Empty when not set
+  std::string
+  priority() const {
+    auto v = method_->attributes.Lookup("priority");
+    if (v == nullptr) { return ""; }
+    return v->constant;
+  }
+
+  /// \brief from the method attribute `(shard_key: "field")`, which the
+  /// schema must declare with `attribute "shard_key";`. Names a string or
+  /// integer field of the request. Empty when not set
+  std::string
+  shard_key() const {
+    auto v = method_->attributes.Lookup("shard_key");
+    if (v == nullptr) { return ""; }
+    return v->constant;
+  }
+
+  /// \brief from the method attribute `(cache_ttl_ms: "1000")`, which the
+  /// schema must declare with `attribute "cache_ttl_ms";`
+  /// 0 when not set
+  uint32_t
+  cache_ttl_ms() const {
+    return uint_attribute("cache_ttl_ms", 0);
+  }
+
+  /// \brief from the method attribute `(coalesce: "true")`, which the
+  /// schema must declare with `attribute "coalesce";`
+  /// false when not set
+  bool
+  coalesce() const {
+    auto v = method_->attributes.Lookup("coalesce");
+    return v != nullptr && v->constant == "true";
+  }
+
+  /// \brief from the method attribute `(offload_concurrency: "2")`, which
+  /// the schema must declare with `attribute "offload_concurrency";`
+  /// 0, run inline, when not set
+  uint32_t
+  offload_concurrency() const {
+    return uint_attribute("offload_concurrency", 0);
+  }
+
+  /// \brief from the method attribute `(batch_size: "64")`, which the
+  /// schema must declare with `attribute "batch_size";`
+  /// 0, not batched, when not set
+  uint32_t
+  batch_size() const {
+    return uint_attribute("batch_size", 0);
+  }
+
+  /// \brief from the method attribute `(batch_wait_us: "200")`, which the
+  /// schema must declare with `attribute "batch_wait_us";`
+  /// 100 when not set
+  uint32_t
+  batch_wait_us() const {
+    return uint_attribute("batch_wait_us", 100);
+  }
+
+  /// \brief c++ type of the shard_key() field; empty if the request has no
+  /// such field, or it is not a string or an integer
+  std::string
+  shard_key_type() const {
+    auto f = method_->request->fields.Lookup(shard_key());
+    if (f == nullptr) { return ""; }
+    switch (f->value.type.base_type) {
+    case flatbuffers::BASE_TYPE_STRING: return "flatbuffers::String";
+    case flatbuffers::BASE_TYPE_CHAR: return "int8_t";
+    case flatbuffers::BASE_TYPE_UCHAR: return "uint8_t";
+    case flatbuffers::BASE_TYPE_SHORT: return "int16_t";
+    case flatbuffers::BASE_TYPE_USHORT: return "uint16_t";
+    case flatbuffers::BASE_TYPE_INT: return "int32_t";
+    case flatbuffers::BASE_TYPE_UINT: return "uint32_t";
+    case flatbuffers::BASE_TYPE_LONG: return "int64_t";
+    case flatbuffers::BASE_TYPE_ULONG: return "uint64_t";
+    default: return "";
+    }
+  }
+
+  /// \brief name of the vtable offset flatc generates for the field
+  std::string
+  shard_key_offset_name() const {
+    std::string ret = "VT_";
+    for (char c : shard_key()) { ret += static_cast<char>(::toupper(c)); }
+    return ret;
+  }
+
   std::string
   input_type_name(language l = language::cpp) const {
     return type(*method_->request, l);
@@ -76,6 +189,24 @@ class smf_method {
   }
 
  private:
+  /// \brief value of a numeric method attribute, `def` when not set. A value
+  /// that is not a plain uint32 number is a schema error
+  uint32_t
+  uint_attribute(const char *attr, uint32_t def) const {
+    auto v = method_->attributes.Lookup(attr);
+    if (v == nullptr) { return def; }
+    const std::string &str = v->constant;
+    char *end = nullptr;
+    errno = 0;
+    const unsigned long long n = std::strtoull(str.c_str(), &end, 10);
+    CHECK(!str.empty() && ::isdigit(static_cast<unsigned char>(str[0])) &&
+          *end == '\0' && errno == 0 &&
+          n <= std::numeric_limits<uint32_t>::max())
+      << attr << " must be a number that fits in 32 bits, got: \"" << str
+      << "\", method: " << name();
+    return static_cast<uint32_t>(n);
+  }
+
   const flatbuffers::RPCCall *method_;
   const std::string service_name_;
   const uint32_t service_id_;
@@ -0,0 +1,70 @@
+// Copyright 2019 SMF Authors
+//
+
+#include <utility>
+
+#include <gtest/gtest.h>
+
+#include "smf/clock_pro_cache.h"
+#include "smf/random.h"
+
+using cache_t = smf::clock_pro_cache<uint32_t, uint32_t>;
+
+TEST(clock_pro_cache, get_put_erase) {
+  cache_t c(100);
+  ASSERT_EQ(c.get(1), nullptr);
+  c.put(1, 10, 10);
+  ASSERT_NE(c.get(1), nullptr);
+  ASSERT_EQ(*c.get(1), 10);
+  c.put(1, 11, 20);
+  ASSERT_EQ(*c.get(1), 11);
+  ASSERT_EQ(c.bytes(), 20);
+  c.erase(1);
+  ASSERT_EQ(c.get(1), nullptr);
+  ASSERT_EQ(c.bytes(), 0);
+  ASSERT_EQ(c.tracked(), 0);
+}
+
+TEST(clock_pro_cache, too_large) {
+  cache_t c(100);
+  c.put(1, 1, 101);
+  ASSERT_EQ(c.get(1), nullptr);
+  ASSERT_EQ(c.bytes(), 0);
+}
+
+TEST(clock_pro_cache, scan_resistant) {
+  cache_t c(100);
+  for (auto round = 0u; round < 10; ++round) {
+    for (auto k = 0u; k < 10; ++k) {
+      if (!c.get(k)) { c.put(k, k, 5); }
+    }
+  }
+  // touched once each; would flush an LRU many times over
+  for (auto k = 1000u; k < 5000u; ++k) {
+    if (!c.get(k)) { c.put(k, k, 5); }
+  }
+  for (auto k = 0u; k < 10; ++k) {
+    ASSERT_NE(c.get(k), nullptr) << "hot key evicted by the scan: " << k;
+  }
+}
+
+TEST(clock_pro_cache, byte_bound) {
+  smf::random r;
+  cache_t c(1000);
+  for (auto i = 0u; i < 100000; ++i) {
+    const uint32_t k = r.next() % 300;
+    if (r.next() % 4 == 0) {
+      c.erase(k);
+    } else if (!c.get(k)) {
+      c.put(k, k, 1 + r.next() % 100);
+    }
+    ASSERT_LE(c.bytes(), c.max_bytes());
+    ASSERT_LE(c.hot_bytes(), c.bytes());
+  }
+}
+
+int
+main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}